@@ -100,12 +100,19 @@ static void sched_clock_poll(unsigned long wrap_ticks)
 void __init setup_sched_clock(u32 (*read)(void), int bits, unsigned long rate)
 {
 	unsigned long r, w;
-	u64 res, wrap;
+	u64 res, wrap, ns;
 	char r_unit;
 
 	BUG_ON(bits > 32);
 	WARN_ON(!irqs_disabled());
 	WARN_ON(read_sched_clock != jiffy_sched_clock_read);
+
+	/*
+	 * Sources which can only be set up after sched_clock_postinit()
+	 * (e.g. from an initcall) take over from the jiffy clock; carry its
+	 * current value over so sched_clock() doesn't go backwards.
+	 */
+	ns = sched_clock();
 	read_sched_clock = read;
 	sched_clock_mask = (1 << bits) - 1;
 
@@ -137,12 +144,13 @@ void __init setup_sched_clock(u32 (*read)(void), int bits, unsigned long rate)
 	 * sets the initial epoch.
 	 */
 	sched_clock_timer.data = msecs_to_jiffies(w - (w / 10));
-	update_sched_clock();
+	cd.epoch_cyc = read_sched_clock();
+	cd.epoch_ns = ns;
+	cd.epoch_cyc_copy = cd.epoch_cyc;
 
-	/*
-	 * Ensure that sched_clock() starts off at 0ns
-	 */
-	cd.epoch_ns = 0;
+	/* The poll timer is still armed for the jiffy clock's wrap */
+	if (timer_pending(&sched_clock_timer))
+		sched_clock_poll(sched_clock_timer.data);
 
 	pr_debug("Registered %pF as sched_clock source\n", read);
 }
@@ -765,6 +765,29 @@ static struct platform_device at91sam9g45_spi1_device = {
 
 static const unsigned spi1_standard_cs[4] = { AT91_PIN_PB17, AT91_PIN_PD28, AT91_PIN_PD18, AT91_PIN_PD19 };
 
+#if defined(CONFIG_SPI_ATMEL_DMA)
+#define SPI_DMA_SLAVE(id)						\
+	{								\
+		.dma_dev	= &at_hdmac_device.dev,			\
+		.reg_width	= AT_DMA_SLAVE_WIDTH_8BIT,		\
+		.cfg		= ATC_SRC_H2SEL_HW | ATC_DST_H2SEL_HW	\
+				| ATC_SRC_PER(id) | ATC_DST_PER(id),	\
+		.ctrla		= ATC_SCSIZE_1 | ATC_DCSIZE_1,		\
+	}
+
+static struct at_dma_slave spi_dma_slaves[4] = {
+	SPI_DMA_SLAVE(AT_DMA_ID_SPI0_RX),
+	SPI_DMA_SLAVE(AT_DMA_ID_SPI0_TX),
+	SPI_DMA_SLAVE(AT_DMA_ID_SPI1_RX),
+	SPI_DMA_SLAVE(AT_DMA_ID_SPI1_TX),
+};
+
+static struct atmel_spi_data spi_data[2] = {
+	{ .dma_rx_slave = &spi_dma_slaves[0], .dma_tx_slave = &spi_dma_slaves[1] },
+	{ .dma_rx_slave = &spi_dma_slaves[2], .dma_tx_slave = &spi_dma_slaves[3] },
+};
+#endif
+
 void __init at91_add_device_spi(struct spi_board_info *devices, int nr_devices)
 {
 	int i;
@@ -801,6 +824,10 @@ void __init at91_add_device_spi(struct spi_board_info *devices, int nr_devices)
 		at91_set_A_periph(AT91_PIN_PB1, 0);	/* SPI0_MOSI */
 		at91_set_A_periph(AT91_PIN_PB2, 0);	/* SPI0_SPCK */
 
+#if defined(CONFIG_SPI_ATMEL_DMA)
+		at91sam9g45_spi0_device.dev.platform_data = &spi_data[0];
+#endif
+
 		platform_device_register(&at91sam9g45_spi0_device);
 	}
 	if (enable_spi1) {
@@ -808,6 +835,10 @@ void __init at91_add_device_spi(struct spi_board_info *devices, int nr_devices)
 		at91_set_A_periph(AT91_PIN_PB15, 0);	/* SPI1_MOSI */
 		at91_set_A_periph(AT91_PIN_PB16, 0);	/* SPI1_SPCK */
 
+#if defined(CONFIG_SPI_ATMEL_DMA)
+		at91sam9g45_spi1_device.dev.platform_data = &spi_data[1];
+#endif
+
 		platform_device_register(&at91sam9g45_spi1_device);
 	}
 }
@@ -1082,6 +1113,16 @@ void __init at91_add_device_tsadcc(struct at91_tsadcc_data *data)
 	at91_set_gpio_input(AT91_PIN_PD22, 0);	/* AD2_YT */
 	at91_set_gpio_input(AT91_PIN_PD23, 0);	/* AD3_TB */
 
+	/* spare channels, for the ADC streaming mode */
+	if (data->adc_channels & (1 << 4))
+		at91_set_gpio_input(AT91_PIN_PD24, 0);	/* AD4 */
+	if (data->adc_channels & (1 << 5))
+		at91_set_gpio_input(AT91_PIN_PD25, 0);	/* AD5 */
+	if (data->adc_channels & (1 << 6))
+		at91_set_gpio_input(AT91_PIN_PD26, 0);	/* AD6 */
+	if (data->adc_channels & (1 << 7))
+		at91_set_gpio_input(AT91_PIN_PD27, 0);	/* AD7 */
+
 	tsadcc_data = *data;
 	platform_device_register(&at91sam9g45_tsadcc_device);
 }
@@ -1298,6 +1339,29 @@ static struct platform_device at91sam9g45_ssc1_device = {
 	.num_resources	= ARRAY_SIZE(ssc1_resources),
 };
 
+#if defined(CONFIG_SND_ATMEL_SOC_DMA)
+#define SSC_DMA_SLAVE(id)						\
+	{								\
+		.dma_dev	= &at_hdmac_device.dev,			\
+		.reg_width	= AT_DMA_SLAVE_WIDTH_16BIT,		\
+		.cfg		= ATC_SRC_H2SEL_HW | ATC_DST_H2SEL_HW	\
+				| ATC_SRC_PER(id) | ATC_DST_PER(id),	\
+		.ctrla		= ATC_SCSIZE_1 | ATC_DCSIZE_1,		\
+	}
+
+static struct at_dma_slave ssc_dma_slaves[4] = {
+	SSC_DMA_SLAVE(AT_DMA_ID_SSC0_RX),
+	SSC_DMA_SLAVE(AT_DMA_ID_SSC0_TX),
+	SSC_DMA_SLAVE(AT_DMA_ID_SSC1_RX),
+	SSC_DMA_SLAVE(AT_DMA_ID_SSC1_TX),
+};
+
+static struct atmel_ssc_data ssc_data[2] = {
+	{ .dma_rx_slave = &ssc_dma_slaves[0], .dma_tx_slave = &ssc_dma_slaves[1] },
+	{ .dma_rx_slave = &ssc_dma_slaves[2], .dma_tx_slave = &ssc_dma_slaves[3] },
+};
+#endif
+
 static inline void configure_ssc1_pins(unsigned pins)
 {
 	if (pins & ATMEL_SSC_TF)
@@ -1332,10 +1396,16 @@ void __init at91_add_device_ssc(unsigned id, unsigned pins)
 	case AT91SAM9G45_ID_SSC0:
 		pdev = &at91sam9g45_ssc0_device;
 		configure_ssc0_pins(pins);
+#if defined(CONFIG_SND_ATMEL_SOC_DMA)
+		pdev->dev.platform_data = &ssc_data[0];
+#endif
 		break;
 	case AT91SAM9G45_ID_SSC1:
 		pdev = &at91sam9g45_ssc1_device;
 		configure_ssc1_pins(pins);
+#if defined(CONFIG_SND_ATMEL_SOC_DMA)
+		pdev->dev.platform_data = &ssc_data[1];
+#endif
 		break;
 	default:
 		return;
@@ -8,22 +8,37 @@
  * warranty of any kind, whether express or implied.
  *
  * The cpu idle uses wait-for-interrupt and RAM self refresh in order
- * to implement two idle states -
+ * to implement up to three idle states -
  * #1 wait-for-interrupt
  * #2 wait-for-interrupt and RAM self refresh
+ * #3 wait-for-interrupt, RAM self refresh and master clock divided down
+ *    (AT91RM9200 only, see below)
+ *
+ * Per-state usage and residency are accounted by the cpuidle core and
+ * show up in /sys/devices/system/cpu/cpu0/cpuidle/stateN/{usage,time}.
  */
 
 #include <linux/kernel.h>
 #include <linux/init.h>
 #include <linux/platform_device.h>
 #include <linux/cpuidle.h>
+#include <linux/ktime.h>
+#include <linux/tick.h>
+#include <linux/moduleparam.h>
 #include <asm/proc-fns.h>
 #include <linux/io.h>
 #include <linux/export.h>
 
+#include <mach/at91_pmc.h>
+#include <mach/cpu.h>
+
 #include "pm.h"
 
-#define AT91_MAX_STATES	2
+#define AT91_MAX_STATES	3
+
+#define AT91_STATE_WFI		0
+#define AT91_STATE_RAM_SR	1
+#define AT91_STATE_MCK_DIV	2
 
 static DEFINE_PER_CPU(struct cpuidle_device, at91_cpuidle_device);
 
@@ -32,61 +47,194 @@ static struct cpuidle_driver at91_idle_driver = {
 	.owner =        THIS_MODULE,
 };
 
+/*
+ * Exit latency and target residency (usec) of each state, per SoC family.
+ *
+ * WFI only restarts the processor clock.  Leaving self-refresh costs the
+ * memory's exit time (tXSR for SDR, 200 clocks for DDR2) plus reopening
+ * the row the CPU wants, and the residency is where the refresh current
+ * saved outweighs the extra wakeup.  Dividing the master clock adds the
+ * MCKRDY handshake on both edges.  The figures are worst cases from the
+ * datasheets, rounded up; scope a GPIO around the enter hook to refine
+ * them for a given board.
+ */
+struct at91_idle_timing {
+	unsigned int	exit_latency;
+	unsigned int	target_residency;
+};
+
+static const struct at91_idle_timing at91rm9200_idle_timing[AT91_MAX_STATES] = {
+	{ .exit_latency = 1,	.target_residency = 10 },
+	{ .exit_latency = 5,	.target_residency = 100 },
+	{ .exit_latency = 60,	.target_residency = 2000 },
+};
+
+/* SAM9260, SAM9261, SAM9263, SAM9G20, SAM9RL: SDRAMC with SDR memory */
+static const struct at91_idle_timing at91sam9_sdr_idle_timing[AT91_MAX_STATES] = {
+	{ .exit_latency = 1,	.target_residency = 10 },
+	{ .exit_latency = 3,	.target_residency = 60 },
+};
+
+/* CAP9, SAM9G45, SAM9M10: DDRSDRC with DDR/DDR2 memory */
+static const struct at91_idle_timing at91sam9_ddr_idle_timing[AT91_MAX_STATES] = {
+	{ .exit_latency = 1,	.target_residency = 10 },
+	{ .exit_latency = 10,	.target_residency = 200 },
+};
+
+static void at91_ram_sr_idle(void)
+{
+	u32 saved_lpr;
+
+	asm("b 1f; .align 5; 1:");
+	asm("mcr p15, 0, r0, c7, c10, 4");	/* drain write buffer */
+	saved_lpr = sdram_selfrefresh_enable();
+	cpu_do_idle();
+	sdram_selfrefresh_disable(saved_lpr);
+}
+
+#ifdef CONFIG_ARCH_AT91RM9200
+/*
+ * The RM9200 System Timer runs from the 32 KHz slow clock, so unlike the
+ * SAM9 PIT and TC based clocksources, timekeeping doesn't notice the
+ * master clock being divided down while we wait.  The USARTs, SPI and
+ * Ethernet clocks do however, so anything arriving during that window
+ * is lost; only boards which can live with that should set this.
+ */
+static bool mck_idle;
+module_param(mck_idle, bool, 0444);
+MODULE_PARM_DESC(mck_idle, "Divide the master clock in the deepest idle state");
+
+static void at91_mck_set(u32 mckr)
+{
+	at91_sys_write(AT91_PMC_MCKR, mckr);
+	while (!(at91_sys_read(AT91_PMC_SR) & AT91_PMC_MCKRDY))
+		cpu_relax();
+}
+
+/*
+ * Self-refresh ends on the first SDRAM access, which may come before the
+ * WFI, so the SDRAM can spend the whole idle period active at MCK/64.
+ * Scale the refresh timer down with MCK to keep refreshing it in time.
+ * The timer is shortened before MCK is divided and restored only once
+ * MCK is back, so refresh is never less frequent than programmed; self
+ * refresh itself is entered at the divided clock, next to the WFI.
+ */
+static void at91_mck_div_idle(void)
+{
+	u32 saved_mckr, saved_tr, tr;
+
+	saved_mckr = at91_sys_read(AT91_PMC_MCKR);
+	saved_tr = at91_sys_read(AT91_SDRAMC_TR);
+
+	tr = (saved_tr & AT91_SDRAMC_COUNT) / 64;
+	at91_sys_write(AT91_SDRAMC_TR, max_t(u32, tr, 1));
+	at91_mck_set((saved_mckr & ~AT91_PMC_PRES) | AT91_PMC_PRES_64);
+
+	at91_ram_sr_idle();
+
+	at91_mck_set(saved_mckr);
+	at91_sys_write(AT91_SDRAMC_TR, saved_tr);
+}
+#else
+static const bool mck_idle;
+
+static inline void at91_mck_div_idle(void)
+{
+}
+#endif
+
+/*
+ * The ladder governor only looks at past residency; don't let it drop
+ * into a state whose break-even point lies beyond the next timer event.
+ */
+static int at91_idle_demote(struct cpuidle_driver *drv, int index)
+{
+	s64 sleep_us = ktime_to_us(tick_nohz_get_sleep_length());
+
+	while (index > AT91_STATE_WFI &&
+	       sleep_us < drv->states[index].target_residency)
+		index--;
+
+	return index;
+}
+
 /* Actual code that puts the SoC in different idle states */
 static int at91_enter_idle(struct cpuidle_device *dev,
 			struct cpuidle_driver *drv,
 			       int index)
 {
-	struct timeval before, after;
-	int idle_time;
-	u32 saved_lpr;
+	ktime_t before, after;
 
 	local_irq_disable();
-	do_gettimeofday(&before);
-	if (index == 0)
-		/* Wait for interrupt state */
-		cpu_do_idle();
-	else if (index == 1) {
-		asm("b 1f; .align 5; 1:");
-		asm("mcr p15, 0, r0, c7, c10, 4");	/* drain write buffer */
-		saved_lpr = sdram_selfrefresh_enable();
+	index = at91_idle_demote(drv, index);
+	before = ktime_get();
+
+	switch (index) {
+	case AT91_STATE_WFI:
 		cpu_do_idle();
-		sdram_selfrefresh_disable(saved_lpr);
+		break;
+	case AT91_STATE_RAM_SR:
+		at91_ram_sr_idle();
+		break;
+	case AT91_STATE_MCK_DIV:
+		at91_mck_div_idle();
+		break;
 	}
-	do_gettimeofday(&after);
+
+	after = ktime_get();
 	local_irq_enable();
-	idle_time = (after.tv_sec - before.tv_sec) * USEC_PER_SEC +
-			(after.tv_usec - before.tv_usec);
 
-	dev->last_residency = idle_time;
+	dev->last_residency = ktime_to_us(ktime_sub(after, before));
 	return index;
 }
 
+static void __init at91_init_state(struct cpuidle_driver *drv, int index,
+				   const struct at91_idle_timing *timing,
+				   const char *name, const char *desc)
+{
+	struct cpuidle_state *state = &drv->states[index];
+
+	state->enter = at91_enter_idle;
+	state->exit_latency = timing[index].exit_latency;
+	state->target_residency = timing[index].target_residency;
+	state->flags = CPUIDLE_FLAG_TIME_VALID;
+	strcpy(state->name, name);
+	strcpy(state->desc, desc);
+}
+
 /* Initialize CPU idle by registering the idle states */
 static int at91_init_cpuidle(void)
 {
 	struct cpuidle_device *device;
 	struct cpuidle_driver *driver = &at91_idle_driver;
+	const struct at91_idle_timing *timing;
+	int count = AT91_STATE_RAM_SR + 1;
 
-	device = &per_cpu(at91_cpuidle_device, smp_processor_id());
-	device->state_count = AT91_MAX_STATES;
-	driver->state_count = AT91_MAX_STATES;
+	if (cpu_is_at91rm9200())
+		timing = at91rm9200_idle_timing;
+	else if (cpu_is_at91cap9() || cpu_is_at91sam9g45())
+		timing = at91sam9_ddr_idle_timing;
+	else
+		timing = at91sam9_sdr_idle_timing;
 
 	/* Wait for interrupt state */
-	driver->states[0].enter = at91_enter_idle;
-	driver->states[0].exit_latency = 1;
-	driver->states[0].target_residency = 10000;
-	driver->states[0].flags = CPUIDLE_FLAG_TIME_VALID;
-	strcpy(driver->states[0].name, "WFI");
-	strcpy(driver->states[0].desc, "Wait for interrupt");
+	at91_init_state(driver, AT91_STATE_WFI, timing,
+			"WFI", "Wait for interrupt");
 
 	/* Wait for interrupt and RAM self refresh state */
-	driver->states[1].enter = at91_enter_idle;
-	driver->states[1].exit_latency = 10;
-	driver->states[1].target_residency = 10000;
-	driver->states[1].flags = CPUIDLE_FLAG_TIME_VALID;
-	strcpy(driver->states[1].name, "RAM_SR");
-	strcpy(driver->states[1].desc, "WFI and RAM Self Refresh");
+	at91_init_state(driver, AT91_STATE_RAM_SR, timing,
+			"RAM_SR", "WFI and RAM Self Refresh");
+
+	/* ... and master clock divided by 64 */
+	if (cpu_is_at91rm9200() && mck_idle) {
+		at91_init_state(driver, AT91_STATE_MCK_DIV, timing,
+				"MCK_DIV", "WFI, RAM SR and MCK/64");
+		count++;
+	}
+
+	device = &per_cpu(at91_cpuidle_device, smp_processor_id());
+	device->state_count = count;
+	driver->state_count = count;
 
 	cpuidle_register_driver(&at91_idle_driver);
 
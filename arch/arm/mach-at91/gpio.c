@@ -32,6 +32,10 @@ struct at91_gpio_chip {
 	int			id;		/* ID of register bank */
 	void __iomem		*regbase;	/* Base of register bank */
 	struct clk		*clock;		/* associated clock */
+	u32			imr;		/* copy of PIO_IMR */
+	u32			fast_mask;	/* pins for fast_handler */
+	at91_gpio_fast_handler_t fast_handler;	/* bypasses genirq */
+	void			*fast_data;
 };
 
 #define to_at91_gpio_chip(c) container_of(c, struct at91_gpio_chip, chip)
@@ -82,6 +86,31 @@ static inline unsigned pin_to_mask(unsigned pin)
 	return 1 << (pin % 32);
 }
 
+static inline struct at91_gpio_chip *pin_to_chip(unsigned pin)
+{
+	pin /= 32;
+	if (likely(pin < gpio_banks))
+		return &gpio_chip[pin];
+
+	return NULL;
+}
+
+/*
+ * Mask a pin's interrupt before it is reconfigured.  The demux works
+ * from the cached IMR, so update it along with PIO_IDR.
+ */
+static void pin_disable_irq(unsigned pin)
+{
+	struct at91_gpio_chip	*at91_gpio = pin_to_chip(pin);
+	unsigned		mask = pin_to_mask(pin);
+	unsigned long		flags;
+
+	local_irq_save(flags);
+	at91_gpio->imr &= ~mask;
+	__raw_writel(mask, at91_gpio->regbase + PIO_IDR);
+	local_irq_restore(flags);
+}
+
 
 /*--------------------------------------------------------------------------*/
 
@@ -109,7 +138,7 @@ int __init_or_module at91_set_GPIO_periph(unsigned pin, int use_pullup)
 
 	if (!pio)
 		return -EINVAL;
-	__raw_writel(mask, pio + PIO_IDR);
+	pin_disable_irq(pin);
 	__raw_writel(mask, pio + (use_pullup ? PIO_PUER : PIO_PUDR));
 	__raw_writel(mask, pio + PIO_PER);
 	return 0;
@@ -128,7 +157,7 @@ int __init_or_module at91_set_A_periph(unsigned pin, int use_pullup)
 	if (!pio)
 		return -EINVAL;
 
-	__raw_writel(mask, pio + PIO_IDR);
+	pin_disable_irq(pin);
 	__raw_writel(mask, pio + (use_pullup ? PIO_PUER : PIO_PUDR));
 	__raw_writel(mask, pio + PIO_ASR);
 	__raw_writel(mask, pio + PIO_PDR);
@@ -148,7 +177,7 @@ int __init_or_module at91_set_B_periph(unsigned pin, int use_pullup)
 	if (!pio)
 		return -EINVAL;
 
-	__raw_writel(mask, pio + PIO_IDR);
+	pin_disable_irq(pin);
 	__raw_writel(mask, pio + (use_pullup ? PIO_PUER : PIO_PUDR));
 	__raw_writel(mask, pio + PIO_BSR);
 	__raw_writel(mask, pio + PIO_PDR);
@@ -169,7 +198,7 @@ int __init_or_module at91_set_gpio_input(unsigned pin, int use_pullup)
 	if (!pio)
 		return -EINVAL;
 
-	__raw_writel(mask, pio + PIO_IDR);
+	pin_disable_irq(pin);
 	__raw_writel(mask, pio + (use_pullup ? PIO_PUER : PIO_PUDR));
 	__raw_writel(mask, pio + PIO_ODR);
 	__raw_writel(mask, pio + PIO_PER);
@@ -190,7 +219,7 @@ int __init_or_module at91_set_gpio_output(unsigned pin, int value)
 	if (!pio)
 		return -EINVAL;
 
-	__raw_writel(mask, pio + PIO_IDR);
+	pin_disable_irq(pin);
 	__raw_writel(mask, pio + PIO_PUDR);
 	__raw_writel(mask, pio + (value ? PIO_SODR : PIO_CODR));
 	__raw_writel(mask, pio + PIO_OER);
@@ -297,9 +326,10 @@ void at91_gpio_suspend(void)
 	for (i = 0; i < gpio_banks; i++) {
 		void __iomem	*pio = gpio_chip[i].regbase;
 
-		backups[i] = __raw_readl(pio + PIO_IMR);
+		backups[i] = gpio_chip[i].imr;
 		__raw_writel(backups[i], pio + PIO_IDR);
 		__raw_writel(wakeups[i], pio + PIO_IER);
+		gpio_chip[i].imr = wakeups[i];
 
 		if (!wakeups[i])
 			clk_disable(gpio_chip[i].clock);
@@ -323,6 +353,7 @@ void at91_gpio_resume(void)
 
 		__raw_writel(wakeups[i], pio + PIO_IDR);
 		__raw_writel(backups[i], pio + PIO_IER);
+		gpio_chip[i].imr = backups[i];
 	}
 }
 
@@ -342,24 +373,32 @@ void at91_gpio_resume(void)
  * IRQ0..IRQ6 should be configurable, e.g. level vs edge triggering.
  */
 
+/*
+ * The demux works from at91_gpio->imr rather than reading PIO_IMR, so
+ * every IER/IDR write must update it too.  Callers have IRQs disabled.
+ */
 static void gpio_irq_mask(struct irq_data *d)
 {
-	unsigned	pin = irq_to_gpio(d->irq);
-	void __iomem	*pio = pin_to_controller(pin);
-	unsigned	mask = pin_to_mask(pin);
+	unsigned		pin = irq_to_gpio(d->irq);
+	struct at91_gpio_chip	*at91_gpio = pin_to_chip(pin);
+	unsigned		mask = pin_to_mask(pin);
 
-	if (pio)
-		__raw_writel(mask, pio + PIO_IDR);
+	if (at91_gpio) {
+		at91_gpio->imr &= ~mask;
+		__raw_writel(mask, at91_gpio->regbase + PIO_IDR);
+	}
 }
 
 static void gpio_irq_unmask(struct irq_data *d)
 {
-	unsigned	pin = irq_to_gpio(d->irq);
-	void __iomem	*pio = pin_to_controller(pin);
-	unsigned	mask = pin_to_mask(pin);
+	unsigned		pin = irq_to_gpio(d->irq);
+	struct at91_gpio_chip	*at91_gpio = pin_to_chip(pin);
+	unsigned		mask = pin_to_mask(pin);
 
-	if (pio)
-		__raw_writel(mask, pio + PIO_IER);
+	if (at91_gpio) {
+		at91_gpio->imr |= mask;
+		__raw_writel(mask, at91_gpio->regbase + PIO_IER);
+	}
 }
 
 static int gpio_irq_type(struct irq_data *d, unsigned type)
@@ -388,8 +427,7 @@ static void gpio_irq_handler(unsigned irq, struct irq_desc *desc)
 	struct irq_data *idata = irq_desc_get_irq_data(desc);
 	struct irq_chip *chip = irq_data_get_irq_chip(idata);
 	struct at91_gpio_chip *at91_gpio = irq_data_get_irq_chip_data(idata);
-	void __iomem	*pio = at91_gpio->regbase;
-	u32		isr;
+	u32		isr, fast;
 
 	/* temporarily mask (level sensitive) parent IRQ */
 	chip->irq_ack(idata);
@@ -398,28 +436,74 @@ static void gpio_irq_handler(unsigned irq, struct irq_desc *desc)
 		 * When there none are pending, we're finished unless we need
 		 * to process multiple banks (like ID_PIOCDE on sam9263).
 		 */
-		isr = __raw_readl(pio + PIO_ISR) & __raw_readl(pio + PIO_IMR);
+		isr = __raw_readl(at91_gpio->regbase + PIO_ISR) & at91_gpio->imr;
 		if (!isr) {
 			if (!at91_gpio->next)
 				break;
 			at91_gpio = at91_gpio->next;
-			pio = at91_gpio->regbase;
 			continue;
 		}
 
+		/* latency-critical pins first, all at once */
+		fast = isr & at91_gpio->fast_mask;
+		if (fast) {
+			at91_gpio->fast_handler(fast, at91_gpio->fast_data);
+			isr &= ~fast;
+		}
+
 		irq_pin = gpio_to_irq(at91_gpio->chip.base);
 
 		while (isr) {
-			if (isr & 1)
-				generic_handle_irq(irq_pin);
-			irq_pin++;
-			isr >>= 1;
+			unsigned	n = __ffs(isr);
+
+			generic_handle_irq(irq_pin + n);
+			isr &= isr - 1;
 		}
 	}
 	chip->irq_unmask(idata);
 	/* now it may re-trigger */
 }
 
+/*
+ * Route pins of one bank straight to @handler from the demux, skipping
+ * the genirq layer.  @handler gets the mask of pending pins in @mask
+ * and runs in hard IRQ context with the bank's parent IRQ masked.  The
+ * pins must be configured as GPIO inputs; they are enabled here and
+ * disabled again when @handler is NULL.  Pins in @mask should not be
+ * requested as regular IRQs.
+ */
+int at91_gpio_set_fast_handler(unsigned pin, u32 mask,
+			       at91_gpio_fast_handler_t handler, void *data)
+{
+	struct at91_gpio_chip	*at91_gpio = pin_to_chip(pin);
+	unsigned long		flags;
+
+	if (!at91_gpio)
+		return -EINVAL;
+	if (handler && at91_gpio->fast_handler)
+		return -EBUSY;
+
+	local_irq_save(flags);
+	if (handler) {
+		at91_gpio->fast_handler = handler;
+		at91_gpio->fast_data = data;
+		at91_gpio->fast_mask = mask;
+		at91_gpio->imr |= mask;
+		__raw_writel(mask, at91_gpio->regbase + PIO_IER);
+	} else {
+		mask = at91_gpio->fast_mask;
+		at91_gpio->imr &= ~mask;
+		__raw_writel(mask, at91_gpio->regbase + PIO_IDR);
+		at91_gpio->fast_mask = 0;
+		at91_gpio->fast_handler = NULL;
+		at91_gpio->fast_data = NULL;
+	}
+	local_irq_restore(flags);
+
+	return 0;
+}
+EXPORT_SYMBOL(at91_gpio_set_fast_handler);
+
 /*--------------------------------------------------------------------------*/
 
 #ifdef CONFIG_DEBUG_FS
@@ -503,6 +587,7 @@ void __init at91_gpio_irq_setup(void)
 		unsigned	i;
 
 		__raw_writel(~0, this->regbase + PIO_IDR);
+		this->imr = 0;
 
 		for (i = 0, irq = gpio_to_irq(this->chip.base); i < 32;
 		     i++, irq++) {
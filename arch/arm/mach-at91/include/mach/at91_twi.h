@@ -16,6 +16,9 @@
 #ifndef AT91_TWI_H
 #define AT91_TWI_H
 
+#include <linux/io.h>
+#include <linux/kernel.h>
+
 #define	AT91_TWI_CR		0x00		/* Control Register */
 #define		AT91_TWI_START		(1 <<  0)	/* Send a Start Condition */
 #define		AT91_TWI_STOP		(1 <<  1)	/* Send a Stop Condition */
@@ -64,5 +67,9 @@
 #define	AT91_TWI_RHR		0x30		/* Receive Holding Register */
 #define	AT91_TWI_THR		0x34		/* Transmit Holding Register */
 
+#ifndef __ASSEMBLY__
+AT91_IO_ACCESSORS(twi)
+#endif
+
 #endif
 
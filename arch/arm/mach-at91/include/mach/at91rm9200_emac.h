@@ -16,6 +16,9 @@
 #ifndef AT91RM9200_EMAC_H
 #define AT91RM9200_EMAC_H
 
+#include <linux/io.h>
+#include <linux/kernel.h>
+
 #define	AT91_EMAC_CTL		0x00	/* Control Register */
 #define		AT91_EMAC_LB		(1 <<  0)	/* Loopback */
 #define		AT91_EMAC_LBL		(1 <<  1)	/* Loopback Local */
@@ -135,4 +138,8 @@
 #define AT91_EMAC_SA4L		0xb0	/* Specific Address 4 Low, bytes 0-3 */
 #define AT91_EMAC_SA4H		0xb4	/* Specific Address 4 High, bytes 4-5 */
 
+#ifndef __ASSEMBLY__
+AT91_IO_ACCESSORS(emac)
+#endif
+
 #endif
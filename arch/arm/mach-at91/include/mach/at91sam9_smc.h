@@ -41,10 +41,45 @@ struct sam9_smc_config {
 	u8 tdf_cycles:4;
 };
 
+/*
+ * Device timings in nanoseconds, with the same meaning as the fields of
+ * struct sam9_smc_config; the cycle counts are derived from the MCK rate.
+ */
+struct sam9_smc_timings {
+	/* Setup */
+	u16 ncs_read_setup;
+	u16 nrd_setup;
+	u16 ncs_write_setup;
+	u16 nwe_setup;
+
+	/* Pulse */
+	u16 ncs_read_pulse;
+	u16 nrd_pulse;
+	u16 ncs_write_pulse;
+	u16 nwe_pulse;
+
+	/* Cycle */
+	u16 read_cycle;
+	u16 write_cycle;
+
+	/* Data float time */
+	u16 tdf;
+};
+
 extern void sam9_smc_configure(int id, int cs, struct sam9_smc_config *config);
 extern void sam9_smc_read(int id, int cs, struct sam9_smc_config *config);
 extern void sam9_smc_read_mode(int id, int cs, struct sam9_smc_config *config);
 extern void sam9_smc_write_mode(int id, int cs, struct sam9_smc_config *config);
+
+extern int sam9_smc_timings_to_config(const struct sam9_smc_timings *timings,
+				      unsigned long mck_hz,
+				      struct sam9_smc_config *config);
+extern int sam9_smc_configure_timings(int id, int cs,
+				      const struct sam9_smc_timings *timings,
+				      u32 mode);
+extern int sam9_smc_onfi_nand_timings(int onfi_mode,
+				      struct sam9_smc_timings *timings);
+extern void sam9_smc_retime(unsigned long mck_hz);
 #endif
 
 #define AT91_SMC_SETUP		0x00				/* Setup Register for CS n */
@@ -120,6 +120,11 @@ extern void __init at91_add_device_i2c(struct i2c_board_info *devices, int nr_de
 #endif
 
  /* SPI */
+struct at_dma_slave;
+struct atmel_spi_data {
+	struct at_dma_slave	*dma_rx_slave;	/* dmaengine receive, if any */
+	struct at_dma_slave	*dma_tx_slave;	/* dmaengine transmit, if any */
+};
 extern void __init at91_add_device_spi(struct spi_board_info *devices, int nr_devices);
 
  /* Serial */
@@ -135,12 +140,15 @@ extern void __init at91_set_serial_console(unsigned portnr);
 
 extern struct platform_device *atmel_default_console_device;
 
+struct at_dma_slave;
 struct atmel_uart_data {
 	int			num;		/* port num */
 	short			use_dma_tx;	/* use transmit DMA? */
 	short			use_dma_rx;	/* use receive DMA? */
 	void __iomem		*regs;		/* virt. base address, if any */
 	struct serial_rs485	rs485;		/* rs485 settings */
+	struct at_dma_slave	*dma_rx_slave;	/* dmaengine receive, if any */
+	struct at_dma_slave	*dma_tx_slave;	/* dmaengine transmit, if any */
 };
 extern void __init at91_add_device_serial(void);
 
@@ -169,6 +177,11 @@ extern void __init at91_add_device_pwm(u32 mask);
 #define ATMEL_SSC_RD	0x40
 #define ATMEL_SSC_RX	(ATMEL_SSC_RK | ATMEL_SSC_RF | ATMEL_SSC_RD)
 
+struct atmel_ssc_data {
+	struct at_dma_slave	*dma_rx_slave;	/* dmaengine receive, if any */
+	struct at_dma_slave	*dma_tx_slave;	/* dmaengine transmit, if any */
+};
+
 extern void __init at91_add_device_ssc(unsigned id, unsigned pins);
 
  /* LCD Controller */
@@ -186,6 +199,9 @@ struct at91_tsadcc_data {
 	unsigned int    adc_clock;
 	u8		pendet_debounce;
 	u8		ts_sample_hold_time;
+	u16		batch;		/* conversion sequences per interrupt */
+	u8		adc_channels;	/* stream these instead of touch */
+	unsigned int	adc_rate;	/* sequences per second when streaming */
 };
 extern void __init at91_add_device_tsadcc(struct at91_tsadcc_data *data);
 
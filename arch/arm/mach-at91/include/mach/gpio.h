@@ -200,6 +200,11 @@ extern int __init_or_module at91_set_multi_drive(unsigned pin, int is_on);
 extern int at91_set_gpio_value(unsigned pin, int value);
 extern int at91_get_gpio_value(unsigned pin);
 
+/* pins whose interrupts bypass genirq, see at91_gpio_set_fast_handler() */
+typedef void (*at91_gpio_fast_handler_t)(u32 mask, void *data);
+extern int at91_gpio_set_fast_handler(unsigned pin, u32 mask,
+			at91_gpio_fast_handler_t handler, void *data);
+
 /* callable only from core power-management code */
 extern void at91_gpio_suspend(void);
 extern void at91_gpio_resume(void);
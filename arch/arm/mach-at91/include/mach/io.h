@@ -44,6 +44,74 @@ static inline void at91_sys_write(unsigned int reg_offset, unsigned long value)
 	__raw_writel(value, addr + reg_offset);
 }
 
+/*
+ * Per-peripheral register accessors.
+ *
+ * AT91_IO_ACCESSORS(foo) declares 'struct at91_foo_io', holding the mapped
+ * base of a "foo" peripheral, and accessors which only accept that type:
+ *
+ *   at91_foo_read(io, reg)			no barriers; for IRQ handlers
+ *   at91_foo_write(io, reg, val)		and other hot paths
+ *   at91_foo_read_sync(io, reg)		ordered against later memory
+ *						reads (e.g. DMA'd data)
+ *   at91_foo_write_sync(io, reg, val)		ordered after earlier memory
+ *						writes (e.g. DMA descriptors)
+ *   at91_foo_write_block(io, reg, vals, n)	n consecutive registers
+ *
+ * A peripheral at a fixed virtual address can use a const io struct so
+ * base and offset fold into a single constant address.  Constant
+ * offsets are checked for alignment at build time.
+ */
+#define at91_io_check_offset(reg) \
+	BUILD_BUG_ON(__builtin_constant_p(reg) && ((reg) & 3))
+
+#define AT91_IO_ACCESSORS(name)						\
+struct at91_##name##_io {						\
+	void __iomem	*base;						\
+};									\
+									\
+static inline u32 at91_##name##_read(const struct at91_##name##_io *io,	\
+				     unsigned int reg)			\
+{									\
+	at91_io_check_offset(reg);					\
+	return __raw_readl(io->base + reg);				\
+}									\
+									\
+static inline void at91_##name##_write(const struct at91_##name##_io *io,	\
+				       unsigned int reg, u32 val)	\
+{									\
+	at91_io_check_offset(reg);					\
+	__raw_writel(val, io->base + reg);				\
+}									\
+									\
+static inline u32 at91_##name##_read_sync(				\
+		const struct at91_##name##_io *io, unsigned int reg)	\
+{									\
+	at91_io_check_offset(reg);					\
+	return readl(io->base + reg);					\
+}									\
+									\
+static inline void at91_##name##_write_sync(				\
+		const struct at91_##name##_io *io, unsigned int reg,	\
+		u32 val)						\
+{									\
+	at91_io_check_offset(reg);					\
+	writel(val, io->base + reg);					\
+}									\
+									\
+static inline void at91_##name##_write_block(				\
+		const struct at91_##name##_io *io, unsigned int reg,	\
+		const u32 *vals, unsigned int n)			\
+{									\
+	void __iomem *addr = io->base + reg;				\
+									\
+	at91_io_check_offset(reg);					\
+	while (n--) {							\
+		__raw_writel(*vals++, addr);				\
+		addr += 4;						\
+	}								\
+}
+
 #endif
 
 #endif
@@ -13,6 +13,10 @@
 #include <linux/io.h>
 #include <linux/of.h>
 #include <linux/of_address.h>
+#include <linux/clk.h>
+#include <linux/err.h>
+#include <linux/cpufreq.h>
+#include <linux/math64.h>
 
 #include <mach/at91sam9_smc.h>
 
@@ -21,6 +25,8 @@
 
 #define AT91_SMC_CS(id, n)	(smc_base_addr[id] + ((n) * 0x10))
 
+#define SAM9_SMC_NR_CS		8
+
 static void __iomem *smc_base_addr[2];
 
 static void sam9_smc_cs_write_mode(void __iomem *base,
@@ -121,6 +127,299 @@ void sam9_smc_read(int id, int cs, struct sam9_smc_config *config)
 	sam9_smc_cs_read(AT91_SMC_CS(id, cs), config);
 }
 
+/*
+ * Timing based configuration.
+ *
+ * Timings are rounded up to whole MCK cycles and then to the next value
+ * the SMC can encode (see "Coding and Range of Timing Parameters" in the
+ * AT91SAM9 datasheets):
+ *
+ *	SMC_SETUP = 128*setup[5] + setup[4:0]
+ *	SMC_PULSE = 256*pulse[6] + pulse[5:0]
+ *	SMC_CYCLE = 256*cycle[8:7] + cycle[6:0]
+ *
+ * so the resulting access is never faster than asked for.
+ */
+static unsigned int sam9_smc_ns_to_cycles(unsigned int ns, unsigned long mck_hz)
+{
+	return DIV_ROUND_UP_ULL((u64)ns * mck_hz, NSEC_PER_SEC);
+}
+
+/*
+ * Encode @cycles as (hi << @lo_bits | lo), standing for
+ * (hi << @hi_shift) + lo; returns the number of cycles actually encoded.
+ */
+static int sam9_smc_encode(unsigned int cycles, unsigned int lo_bits,
+			   unsigned int hi_shift, unsigned int hi_max,
+			   unsigned int *val)
+{
+	unsigned int hi = cycles >> hi_shift;
+	unsigned int lo = cycles - (hi << hi_shift);
+
+	if (lo >= (1 << lo_bits)) {
+		hi++;
+		lo = 0;
+	}
+	if (hi > hi_max)
+		return -ERANGE;
+
+	*val = (hi << lo_bits) | lo;
+	return (hi << hi_shift) + lo;
+}
+
+#define sam9_smc_encode_setup(c, v)	sam9_smc_encode(c, 5, 7, 1, v)
+#define sam9_smc_encode_pulse(c, v)	sam9_smc_encode(c, 6, 8, 1, v)
+#define sam9_smc_encode_cycle(c, v)	sam9_smc_encode(c, 7, 8, 3, v)
+
+/*
+ * Work out one direction (read or write): the strobe and NCS setup and
+ * pulse, and a cycle long enough to hold both.
+ */
+static int sam9_smc_calc_access(unsigned long mck_hz,
+		u16 setup_ns, u16 pulse_ns, u16 ncs_setup_ns, u16 ncs_pulse_ns,
+		u16 cycle_ns, u8 *setup, u8 *pulse, u8 *ncs_setup,
+		u8 *ncs_pulse, u16 *cycle)
+{
+	unsigned int val = 0;
+	int s, p, ncs_s, ncs_p, c;
+
+	s = sam9_smc_encode_setup(sam9_smc_ns_to_cycles(setup_ns, mck_hz), &val);
+	*setup = val;
+	p = sam9_smc_encode_pulse(sam9_smc_ns_to_cycles(pulse_ns, mck_hz), &val);
+	*pulse = val;
+	ncs_s = sam9_smc_encode_setup(sam9_smc_ns_to_cycles(ncs_setup_ns, mck_hz),
+				      &val);
+	*ncs_setup = val;
+	ncs_p = sam9_smc_encode_pulse(sam9_smc_ns_to_cycles(ncs_pulse_ns, mck_hz),
+				      &val);
+	*ncs_pulse = val;
+	if (s < 0 || p < 0 || ncs_s < 0 || ncs_p < 0)
+		return -ERANGE;
+
+	c = max3((int)sam9_smc_ns_to_cycles(cycle_ns, mck_hz),
+		 s + p, ncs_s + ncs_p);
+	if (sam9_smc_encode_cycle(c, &val) < 0)
+		return -ERANGE;
+	*cycle = val;
+
+	return 0;
+}
+
+/**
+ * sam9_smc_timings_to_config - compute SMC settings from device timings
+ * @timings: device timings, in ns
+ * @mck_hz: MCK rate the settings are for
+ * @config: setup, pulse, cycle and tdf_cycles fields are filled in
+ *
+ * Returns -ERANGE if the timings don't fit the SMC registers at this rate.
+ */
+int sam9_smc_timings_to_config(const struct sam9_smc_timings *t,
+			       unsigned long mck_hz,
+			       struct sam9_smc_config *config)
+{
+	unsigned int tdf;
+	int ret;
+
+	ret = sam9_smc_calc_access(mck_hz, t->nrd_setup, t->nrd_pulse,
+			t->ncs_read_setup, t->ncs_read_pulse, t->read_cycle,
+			&config->nrd_setup, &config->nrd_pulse,
+			&config->ncs_read_setup, &config->ncs_read_pulse,
+			&config->read_cycle);
+	if (ret)
+		return ret;
+
+	ret = sam9_smc_calc_access(mck_hz, t->nwe_setup, t->nwe_pulse,
+			t->ncs_write_setup, t->ncs_write_pulse, t->write_cycle,
+			&config->nwe_setup, &config->nwe_pulse,
+			&config->ncs_write_setup, &config->ncs_write_pulse,
+			&config->write_cycle);
+	if (ret)
+		return ret;
+
+	tdf = sam9_smc_ns_to_cycles(t->tdf, mck_hz);
+	config->tdf_cycles = min(tdf, 15U);
+
+	return 0;
+}
+
+/*
+ * Asynchronous NAND timings for ONFI timing modes 0 to 5, in ns.
+ */
+struct onfi_nand_timings {
+	u8 tWC, tWP, tWH, tRC, tRP, tREH, tREA;
+	u8 tCLS, tCLH, tCS, tDH, tAR, tCLR, tRHZ;
+};
+
+static const struct onfi_nand_timings onfi_nand_timings[] = {
+	{ 100, 50, 30, 100, 50, 30, 40, 50, 20, 70, 20, 25, 20, 200 },
+	{  45, 25, 15,  50, 25, 15, 30, 25, 10, 35, 10, 10, 10, 100 },
+	{  35, 17, 15,  35, 17, 15, 25, 15, 10, 25,  5, 10, 10, 100 },
+	{  30, 15, 10,  30, 15, 10, 20, 10,  5, 25,  5, 10, 10, 100 },
+	{  25, 12, 10,  25, 12, 10, 20, 10,  5, 20,  5, 10, 10, 100 },
+	{  20, 10,  7,  20, 10,  7, 16, 10,  5, 15,  5, 10, 10, 100 },
+};
+
+/* Data setup the SMC needs before sampling on the rising edge of NRD */
+#define SAM9_SMC_DATA_SETUP	5
+
+/**
+ * sam9_smc_onfi_nand_timings - SMC timings for a NAND chip
+ * @onfi_mode: ONFI asynchronous timing mode the chip supports
+ * @timings: filled in
+ *
+ * CLE and ALE come from address lines, valid for the whole access, and
+ * NCS is held across it; data is sampled on the rising edge of NRD.
+ */
+int sam9_smc_onfi_nand_timings(int onfi_mode, struct sam9_smc_timings *timings)
+{
+	const struct onfi_nand_timings *t;
+
+	if (onfi_mode < 0 || onfi_mode >= ARRAY_SIZE(onfi_nand_timings))
+		return -EINVAL;
+	t = &onfi_nand_timings[onfi_mode];
+
+	/* NWE rises tCLS/tALS (and tCS) after the access starts */
+	timings->nwe_pulse = t->tWP;
+	timings->nwe_setup = max(t->tCLS, t->tCS) > t->tWP ?
+			     max(t->tCLS, t->tCS) - t->tWP : 0;
+	timings->write_cycle = max_t(u16, t->tWC, timings->nwe_setup +
+			t->tWP + max3(t->tWH, t->tCLH, t->tDH));
+
+	timings->nrd_setup = max(t->tAR, t->tCLR);
+	timings->nrd_pulse = max_t(u16, t->tRP, t->tREA + SAM9_SMC_DATA_SETUP);
+	timings->read_cycle = max_t(u16, t->tRC, timings->nrd_setup +
+			timings->nrd_pulse + t->tREH);
+
+	timings->ncs_write_setup = 0;
+	timings->ncs_write_pulse = timings->write_cycle;
+	timings->ncs_read_setup = 0;
+	timings->ncs_read_pulse = timings->read_cycle;
+
+	timings->tdf = t->tRHZ;
+
+	return 0;
+}
+
+/*
+ * Chip selects configured from timings, so they can be worked out again
+ * when MCK changes.
+ */
+static struct sam9_smc_timed_cs {
+	struct sam9_smc_timings	timings;
+	u32			mode;
+	bool			used;
+} smc_timed_cs[2][SAM9_SMC_NR_CS];
+
+static unsigned long smc_mck_hz;
+
+static int sam9_smc_apply_timings(int id, int cs, unsigned long mck_hz)
+{
+	struct sam9_smc_timed_cs *tcs = &smc_timed_cs[id][cs];
+	struct sam9_smc_config config;
+	int ret;
+
+	ret = sam9_smc_timings_to_config(&tcs->timings, mck_hz, &config);
+	if (ret) {
+		pr_warn("smc.%d: CS%d timings out of range at %lu Hz\n",
+			id, cs, mck_hz);
+		return ret;
+	}
+	config.mode = tcs->mode;
+
+	sam9_smc_configure(id, cs, &config);
+	return 0;
+}
+
+/**
+ * sam9_smc_configure_timings - configure a chip select from device timings
+ * @id: SMC instance
+ * @cs: chip select
+ * @timings: device timings, in ns
+ * @mode: value for the mode register, without the TDF cycles
+ *
+ * The settings are computed for the current MCK rate, and again each
+ * time sam9_smc_retime() is called.
+ */
+int sam9_smc_configure_timings(int id, int cs,
+			       const struct sam9_smc_timings *timings, u32 mode)
+{
+	struct sam9_smc_timed_cs *tcs;
+
+	if (id > 1 || cs >= SAM9_SMC_NR_CS)
+		return -EINVAL;
+
+	if (!smc_mck_hz) {
+		struct clk *mck = clk_get(NULL, "mck");
+
+		if (IS_ERR(mck))
+			return PTR_ERR(mck);
+		smc_mck_hz = clk_get_rate(mck);
+		clk_put(mck);
+	}
+
+	tcs = &smc_timed_cs[id][cs];
+	tcs->timings = *timings;
+	tcs->mode = mode;
+	tcs->used = true;
+
+	return sam9_smc_apply_timings(id, cs, smc_mck_hz);
+}
+
+/**
+ * sam9_smc_retime - recompute timing based chip selects for a new MCK rate
+ * @mck_hz: MCK rate to compute the settings for
+ *
+ * When slowing MCK down call this after the change, when speeding it up
+ * call it before, so the settings are always safe for the faster clock.
+ */
+void sam9_smc_retime(unsigned long mck_hz)
+{
+	int id, cs;
+
+	for (id = 0; id < 2; id++)
+		for (cs = 0; cs < SAM9_SMC_NR_CS; cs++)
+			if (smc_timed_cs[id][cs].used)
+				sam9_smc_apply_timings(id, cs, mck_hz);
+}
+
+#ifdef CONFIG_CPU_FREQ
+/*
+ * cpufreq on these parts reprograms PLLA, which clocks both the core
+ * and, through the MDIV divider, MCK; so MCK follows the CPU clock.
+ */
+static int sam9_smc_cpufreq_notifier(struct notifier_block *nb,
+				     unsigned long val, void *data)
+{
+	struct cpufreq_freqs *freqs = data;
+	unsigned long mck_hz;
+
+	if (!smc_mck_hz || !freqs->old || freqs->new == freqs->old)
+		return NOTIFY_OK;
+
+	mck_hz = div_u64((u64)smc_mck_hz * freqs->new, freqs->old);
+
+	if ((val == CPUFREQ_PRECHANGE && freqs->new > freqs->old) ||
+	    (val == CPUFREQ_POSTCHANGE && freqs->new < freqs->old))
+		sam9_smc_retime(mck_hz);
+
+	if (val == CPUFREQ_POSTCHANGE)
+		smc_mck_hz = mck_hz;
+
+	return NOTIFY_OK;
+}
+
+static struct notifier_block sam9_smc_cpufreq_nb = {
+	.notifier_call	= sam9_smc_cpufreq_notifier,
+};
+
+static int __init sam9_smc_cpufreq_init(void)
+{
+	return cpufreq_register_notifier(&sam9_smc_cpufreq_nb,
+					 CPUFREQ_TRANSITION_NOTIFIER);
+}
+core_initcall(sam9_smc_cpufreq_init);
+#endif
+
 void __init at91sam9_ioremap_smc(int id, u32 addr)
 {
 	if (id > 1) {
@@ -0,0 +1,891 @@
+/*
+ * Just-In-Time compiler for BPF filters on 32bit ARM
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; version 2 of the License.
+ *
+ * The code generated runs in ARM state and sticks to instructions
+ * available on ARMv4T, with LDR+REV/REV16 used for network order loads on
+ * ARMv6 and later and MOVW/MOVT used to build constants on ARMv7.
+ * Anything the translator doesn't handle (the netlink attribute and
+ * packet type ancillary loads) makes it give up on the whole program,
+ * which then keeps running in sk_run_filter().
+ */
+
+#include <linux/bitops.h>
+#include <linux/compiler.h>
+#include <linux/errno.h>
+#include <linux/filter.h>
+#include <linux/moduleloader.h>
+#include <linux/netdevice.h>
+#include <linux/skbuff.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/workqueue.h>
+#include <asm/cacheflush.h>
+#include <asm/thread_info.h>
+
+#include "bpf_jit_32.h"
+
+/*
+ * ABI:
+ *
+ * r0	scratch register / return value / first argument of the helpers
+ * r1	offset of a packet load, second argument of the helpers
+ * r4	BPF register A
+ * r5	BPF register X
+ * r6	pointer to the skb
+ * r7	skb->data
+ * r8	skb headlen
+ */
+
+#define r_scratch	ARM_R0
+#define r_off		ARM_R1
+#define r_A		ARM_R4
+#define r_X		ARM_R5
+#define r_skb		ARM_R6
+#define r_skb_data	ARM_R7
+#define r_skb_hl	ARM_R8
+
+/* The slow path load helpers return a u64: { err, value } */
+#ifdef __ARMEB__
+#define r_ret_err	ARM_R0
+#define r_ret_val	ARM_R1
+#else
+#define r_ret_val	ARM_R0
+#define r_ret_err	ARM_R1
+#endif
+
+#define SCRATCH_SP_SIZE		(BPF_MEMWORDS * 4)
+
+#define SEEN_MEM		(1 << 0)
+#define SEEN_DATA		(1 << 1)
+#define SEEN_X			(1 << 2)
+#define SEEN_CALL		(1 << 3)
+#define SEEN_SKB		(1 << 4)
+
+#define ARM_PUSH(regs)		(ARM_STMDB(ARM_SP, regs) | ARM_INST_WB)
+#define ARM_POP(regs)		(ARM_LDM(ARM_SP, regs) | ARM_INST_WB)
+
+int bpf_jit_enable __read_mostly;
+
+struct jit_ctx {
+	const struct sk_filter *skf;
+	unsigned idx;
+	unsigned prologue_bytes;
+	u32 seen;
+	u32 *offsets;
+	u32 *target;
+};
+
+/*
+ * Copy len bytes at offset k of the packet, with the negative offsets
+ * relative to the link layer and network headers handled the way
+ * sk_run_filter() does.
+ */
+static int jit_copy_bits(const struct sk_buff *skb, int k, void *to,
+			 unsigned int len)
+{
+	u8 *ptr = NULL;
+
+	if (k >= 0)
+		return skb_copy_bits(skb, k, to, len);
+
+	if (k >= SKF_NET_OFF)
+		ptr = skb_network_header(skb) + k - SKF_NET_OFF;
+	else if (k >= SKF_LL_OFF)
+		ptr = skb_mac_header(skb) + k - SKF_LL_OFF;
+
+	if (!ptr || ptr < skb->head || ptr + len > skb_tail_pointer(skb))
+		return -EFAULT;
+
+	memcpy(to, ptr, len);
+	return 0;
+}
+
+static u64 jit_get_skb_b(struct sk_buff *skb, int offset)
+{
+	u8 ret;
+	int err;
+
+	err = jit_copy_bits(skb, offset, &ret, 1);
+
+	return (u64)err << 32 | ret;
+}
+
+static u64 jit_get_skb_h(struct sk_buff *skb, int offset)
+{
+	u16 ret;
+	int err;
+
+	err = jit_copy_bits(skb, offset, &ret, 2);
+
+	return (u64)err << 32 | ntohs(ret);
+}
+
+static u64 jit_get_skb_w(struct sk_buff *skb, int offset)
+{
+	u32 ret;
+	int err;
+
+	err = jit_copy_bits(skb, offset, &ret, 4);
+
+	return (u64)err << 32 | ntohl(ret);
+}
+
+/*
+ * Wrapper that handles both OABI and EABI and assures Thumb2 interworking
+ * (where the assembly routines like __aeabi_uidiv could cause problems).
+ */
+static u32 jit_udiv(u32 dividend, u32 divisor)
+{
+	return dividend / divisor;
+}
+
+static inline void _emit(int cond, u32 inst, struct jit_ctx *ctx)
+{
+	if (ctx->target != NULL)
+		ctx->target[ctx->idx] = inst | (cond << 28);
+
+	ctx->idx++;
+}
+
+/*
+ * Emit an instruction that will be executed unconditionally.
+ */
+static inline void emit(u32 inst, struct jit_ctx *ctx)
+{
+	_emit(ARM_COND_AL, inst, ctx);
+}
+
+static u16 saved_regs(struct jit_ctx *ctx)
+{
+	u16 ret = 1 << r_A;
+
+	/*
+	 * Calls clobber r0-r3, ip and lr; save the whole r4-r8 range so
+	 * that the stack stays 8-byte aligned across them.
+	 */
+	if (ctx->seen & SEEN_CALL)
+		return ret | 1 << r_X | 1 << r_skb | 1 << r_skb_data |
+			1 << r_skb_hl | 1 << ARM_LR;
+
+	if (ctx->seen & SEEN_X)
+		ret |= 1 << r_X;
+	if (ctx->seen & (SEEN_DATA | SEEN_SKB))
+		ret |= 1 << r_skb;
+	if (ctx->seen & SEEN_DATA)
+		ret |= 1 << r_skb_data | 1 << r_skb_hl;
+
+	return ret;
+}
+
+static inline int mem_words_off(unsigned k)
+{
+	return k * 4;
+}
+
+static inline bool is_load_to_a(u16 inst)
+{
+	switch (inst) {
+	case BPF_S_LD_W_LEN:
+	case BPF_S_LD_W_ABS:
+	case BPF_S_LD_H_ABS:
+	case BPF_S_LD_B_ABS:
+	case BPF_S_LD_W_IND:
+	case BPF_S_LD_H_IND:
+	case BPF_S_LD_B_IND:
+	case BPF_S_LD_IMM:
+	case BPF_S_LD_MEM:
+	case BPF_S_ANC_CPU:
+	case BPF_S_ANC_IFINDEX:
+	case BPF_S_ANC_MARK:
+	case BPF_S_ANC_PROTOCOL:
+	case BPF_S_ANC_RXHASH:
+	case BPF_S_ANC_QUEUE:
+	case BPF_S_ANC_HATYPE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static void build_prologue(struct jit_ctx *ctx)
+{
+	u16 reg_set = saved_regs(ctx);
+	u16 first_inst = ctx->skf->insns[0].code;
+
+	emit(ARM_PUSH(reg_set), ctx);
+
+	if (ctx->seen & (SEEN_DATA | SEEN_SKB))
+		emit(ARM_MOV_R(r_skb, ARM_R0), ctx);
+
+	if (ctx->seen & SEEN_DATA) {
+		emit(ARM_LDR_I(r_skb_data, r_skb,
+			       offsetof(struct sk_buff, data)), ctx);
+		/* headlen = len - data_len */
+		emit(ARM_LDR_I(r_skb_hl, r_skb,
+			       offsetof(struct sk_buff, len)), ctx);
+		emit(ARM_LDR_I(r_scratch, r_skb,
+			       offsetof(struct sk_buff, data_len)), ctx);
+		emit(ARM_SUB_R(r_skb_hl, r_skb_hl, r_scratch), ctx);
+	}
+
+	if (ctx->seen & SEEN_X)
+		emit(ARM_MOV_I(r_X, 0), ctx);
+
+	/* do not leak kernel data to userspace */
+	if ((first_inst != BPF_S_RET_K) && !(is_load_to_a(first_inst)))
+		emit(ARM_MOV_I(r_A, 0), ctx);
+
+	/* scratch memory M[] lives on the stack */
+	if (ctx->seen & SEEN_MEM)
+		emit(ARM_SUB_I(ARM_SP, ARM_SP, SCRATCH_SP_SIZE), ctx);
+}
+
+static void build_epilogue(struct jit_ctx *ctx)
+{
+	u16 reg_set = saved_regs(ctx);
+
+	if (ctx->seen & SEEN_MEM)
+		emit(ARM_ADD_I(ARM_SP, ARM_SP, SCRATCH_SP_SIZE), ctx);
+
+	if (reg_set & (1 << ARM_LR)) {
+		reg_set &= ~(1 << ARM_LR);
+		reg_set |= 1 << ARM_PC;
+		emit(ARM_POP(reg_set), ctx);
+		return;
+	}
+
+	emit(ARM_POP(reg_set), ctx);
+#if __LINUX_ARM_ARCH__ < 5
+	emit(ARM_MOV_R(ARM_PC, ARM_LR), ctx);
+#else
+	emit(ARM_BX_R(ARM_LR), ctx);
+#endif
+}
+
+/*
+ * Return the 12 bit immediate operand encoding of x (an 8 bit value
+ * rotated right by an even amount), or -1 if it can't be encoded.
+ */
+static int imm8m(u32 x)
+{
+	u32 rot;
+
+	for (rot = 0; rot < 16; rot++)
+		if ((x & ~ror32(0xff, 2 * rot)) == 0)
+			return rol32(x, 2 * rot) | (rot << 8);
+
+	return -1;
+}
+
+static void emit_mov_i(int rd, u32 val, struct jit_ctx *ctx)
+{
+	int imm12 = imm8m(val);
+#if __LINUX_ARM_ARCH__ < 7
+	int shift;
+	bool first = true;
+#endif
+
+	if (imm12 >= 0) {
+		emit(ARM_MOV_I(rd, imm12), ctx);
+		return;
+	}
+
+	imm12 = imm8m(~val);
+	if (imm12 >= 0) {
+		emit(ARM_MVN_I(rd, imm12), ctx);
+		return;
+	}
+
+#if __LINUX_ARM_ARCH__ >= 7
+	emit(ARM_MOVW(rd, val & 0xffff), ctx);
+	if (val > 0xffff)
+		emit(ARM_MOVT(rd, val >> 16), ctx);
+#else
+	/* one byte at a time, skipping the zero ones */
+	for (shift = 0; shift < 32; shift += 8) {
+		u32 chunk = val & (0xff << shift);
+
+		if (!chunk)
+			continue;
+		if (first)
+			emit(ARM_MOV_I(rd, imm8m(chunk)), ctx);
+		else
+			emit(ARM_ORR_I(rd, rd, imm8m(chunk)), ctx);
+		first = false;
+	}
+#endif
+}
+
+static inline void emit_blx_r(u8 tgt_reg, struct jit_ctx *ctx)
+{
+#if __LINUX_ARM_ARCH__ < 5
+	emit(ARM_MOV_R(ARM_LR, ARM_PC), ctx);
+	emit(ARM_MOV_R(ARM_PC, tgt_reg), ctx);
+#else
+	emit(ARM_BLX_R(tgt_reg), ctx);
+#endif
+}
+
+/*
+ * Load a network order word or halfword from r_addr into r_res.  r_res
+ * must differ from r_addr; ip is clobbered.
+ */
+static void emit_load_be32(u8 cond, u8 r_res, u8 r_addr, struct jit_ctx *ctx)
+{
+#if __LINUX_ARM_ARCH__ < 6
+	int i;
+
+	_emit(cond, ARM_LDRB_I(r_res, r_addr, 0), ctx);
+	for (i = 1; i < 4; i++) {
+		_emit(cond, ARM_LDRB_I(ARM_IP, r_addr, i), ctx);
+		_emit(cond, ARM_ORR_S(r_res, ARM_IP, r_res, SRTYPE_LSL, 8),
+		      ctx);
+	}
+#else
+	_emit(cond, ARM_LDR_I(r_res, r_addr, 0), ctx);
+#ifndef __ARMEB__
+	_emit(cond, ARM_REV(r_res, r_res), ctx);
+#endif
+#endif
+}
+
+static void emit_load_be16(u8 cond, u8 r_res, u8 r_addr, struct jit_ctx *ctx)
+{
+#if __LINUX_ARM_ARCH__ < 6
+	_emit(cond, ARM_LDRB_I(r_res, r_addr, 0), ctx);
+	_emit(cond, ARM_LDRB_I(ARM_IP, r_addr, 1), ctx);
+	_emit(cond, ARM_ORR_S(r_res, ARM_IP, r_res, SRTYPE_LSL, 8), ctx);
+#else
+	_emit(cond, ARM_LDRH_I(r_res, r_addr, 0), ctx);
+#ifndef __ARMEB__
+	_emit(cond, ARM_REV16(r_res, r_res), ctx);
+#endif
+#endif
+}
+
+/* Swap the bytes of the halfword held in the low half of r_res */
+static void emit_swap16(u8 r_res, struct jit_ctx *ctx)
+{
+#ifndef __ARMEB__
+#if __LINUX_ARM_ARCH__ < 6
+	emit(ARM_LSR_I(ARM_IP, r_res, 8), ctx);
+	emit(ARM_AND_I(r_res, r_res, 0xff), ctx);
+	emit(ARM_ORR_S(r_res, ARM_IP, r_res, SRTYPE_LSL, 8), ctx);
+#else
+	emit(ARM_REV16(r_res, r_res), ctx);
+#endif
+#endif
+}
+
+/* LDRH only has an 8 bit immediate offset */
+static void emit_ldrh(u8 rt, u8 rn, u32 off, struct jit_ctx *ctx)
+{
+	if (off < 256) {
+		emit(ARM_LDRH_I(rt, rn, off), ctx);
+	} else {
+		emit_mov_i(ARM_IP, off, ctx);
+		emit(ARM_LDRH_R(rt, rn, ARM_IP), ctx);
+	}
+}
+
+/* X = (X & 0xf) << 2, for BPF_S_LDX_B_MSH */
+static inline void emit_msh(u8 cond, struct jit_ctx *ctx)
+{
+	_emit(cond, ARM_AND_I(r_X, r_X, 0xf), ctx);
+	_emit(cond, ARM_LSL_I(r_X, r_X, 2), ctx);
+}
+
+/*
+ * BPF only allows forward jumps and the offsets recorded during the
+ * sizing pass stay valid, only shifted by the prologue.
+ */
+static inline int b_imm(unsigned tgt, struct jit_ctx *ctx)
+{
+	int imm;
+
+	if (ctx->target == NULL)
+		return 0;
+
+	imm = ctx->offsets[tgt] + ctx->prologue_bytes - (ctx->idx * 4 + 8);
+
+	return imm >> 2;
+}
+
+/* Return 0 from the filter if cond holds */
+static inline void emit_err_ret(u8 cond, struct jit_ctx *ctx)
+{
+	_emit(cond, ARM_MOV_I(ARM_R0, 0), ctx);
+	_emit(cond, ARM_B(b_imm(ctx->skf->len, ctx)), ctx);
+}
+
+/* A = A op K, through r_scratch when K doesn't fit an immediate operand */
+static void emit_alu_k(u32 inst_i, u32 inst_r, u32 k, struct jit_ctx *ctx)
+{
+	int imm12 = imm8m(k);
+
+	if (imm12 >= 0) {
+		emit(inst_i | r_A << 12 | r_A << 16 | imm12, ctx);
+	} else {
+		emit_mov_i(r_scratch, k, ctx);
+		emit(inst_r | r_A << 12 | r_A << 16 | r_scratch, ctx);
+	}
+}
+
+static int build_body(struct jit_ctx *ctx)
+{
+	void *load_func[] = {jit_get_skb_b, jit_get_skb_h, jit_get_skb_w};
+	const struct sk_filter *prog = ctx->skf;
+	const struct sock_filter *inst;
+	unsigned i, load_order, condt;
+	u8 r_dst;
+	int imm12;
+	u32 k;
+
+	for (i = 0; i < prog->len; i++) {
+		inst = &(prog->insns[i]);
+		/* K as an immediate value operand */
+		k = inst->k;
+
+		/* compute offsets only in the fake pass */
+		if (ctx->target == NULL)
+			ctx->offsets[i] = ctx->idx * 4;
+
+		switch (inst->code) {
+		case BPF_S_LD_IMM:
+			emit_mov_i(r_A, k, ctx);
+			break;
+		case BPF_S_LD_W_LEN:
+			ctx->seen |= SEEN_SKB;
+			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, len) != 4);
+			emit(ARM_LDR_I(r_A, r_skb,
+				       offsetof(struct sk_buff, len)), ctx);
+			break;
+		case BPF_S_LD_MEM:
+			/* A = scratch[k] */
+			ctx->seen |= SEEN_MEM;
+			emit(ARM_LDR_I(r_A, ARM_SP, mem_words_off(k)), ctx);
+			break;
+		case BPF_S_LD_W_ABS:
+			load_order = 2;
+			goto load;
+		case BPF_S_LD_H_ABS:
+			load_order = 1;
+			goto load;
+		case BPF_S_LD_B_ABS:
+			load_order = 0;
+load:
+			emit_mov_i(r_off, k, ctx);
+			r_dst = r_A;
+load_common:
+			ctx->seen |= SEEN_DATA | SEEN_CALL;
+
+			/*
+			 * Fast path: the bytes are in the linear part of the
+			 * skb.  Negative offsets wrap to huge unsigned values
+			 * and always take the slow path.
+			 */
+			if (load_order > 0) {
+				/* off <= headlen - size, without underflow */
+				emit(ARM_SUBS_I(r_scratch, r_skb_hl,
+						1 << load_order), ctx);
+				_emit(ARM_COND_HS, ARM_CMP_R(r_scratch, r_off),
+				      ctx);
+				condt = ARM_COND_HS;
+			} else {
+				emit(ARM_CMP_R(r_skb_hl, r_off), ctx);
+				condt = ARM_COND_HI;
+			}
+
+			_emit(condt, ARM_ADD_R(r_scratch, r_off, r_skb_data),
+			      ctx);
+
+			if (load_order == 0)
+				_emit(condt, ARM_LDRB_I(r_dst, r_scratch, 0),
+				      ctx);
+			else if (load_order == 1)
+				emit_load_be16(condt, r_dst, r_scratch, ctx);
+			else if (load_order == 2)
+				emit_load_be32(condt, r_dst, r_scratch, ctx);
+
+			if (inst->code == BPF_S_LDX_B_MSH)
+				emit_msh(condt, ctx);
+			_emit(condt, ARM_B(b_imm(i + 1, ctx)), ctx);
+
+			/* the slow path */
+			emit_mov_i(ARM_R3, (u32)load_func[load_order], ctx);
+			emit(ARM_MOV_R(ARM_R0, r_skb), ctx);
+			/* the offset is already in R1 */
+			emit_blx_r(ARM_R3, ctx);
+			/* check the result of skb_copy_bits */
+			emit(ARM_CMP_I(r_ret_err, 0), ctx);
+			emit_err_ret(ARM_COND_NE, ctx);
+			emit(ARM_MOV_R(r_dst, r_ret_val), ctx);
+			if (inst->code == BPF_S_LDX_B_MSH)
+				emit_msh(ARM_COND_AL, ctx);
+			break;
+		case BPF_S_LD_W_IND:
+			load_order = 2;
+			goto load_ind;
+		case BPF_S_LD_H_IND:
+			load_order = 1;
+			goto load_ind;
+		case BPF_S_LD_B_IND:
+			load_order = 0;
+load_ind:
+			ctx->seen |= SEEN_X;
+			if (k) {
+				emit_mov_i(r_off, k, ctx);
+				emit(ARM_ADD_R(r_off, r_off, r_X), ctx);
+			} else {
+				emit(ARM_MOV_R(r_off, r_X), ctx);
+			}
+			r_dst = r_A;
+			goto load_common;
+		case BPF_S_LDX_IMM:
+			ctx->seen |= SEEN_X;
+			emit_mov_i(r_X, k, ctx);
+			break;
+		case BPF_S_LDX_W_LEN:
+			ctx->seen |= SEEN_X | SEEN_SKB;
+			emit(ARM_LDR_I(r_X, r_skb,
+				       offsetof(struct sk_buff, len)), ctx);
+			break;
+		case BPF_S_LDX_MEM:
+			ctx->seen |= SEEN_X | SEEN_MEM;
+			emit(ARM_LDR_I(r_X, ARM_SP, mem_words_off(k)), ctx);
+			break;
+		case BPF_S_LDX_B_MSH:
+			/* x = ((*(frame + k)) & 0xf) << 2; */
+			ctx->seen |= SEEN_X;
+			load_order = 0;
+			emit_mov_i(r_off, k, ctx);
+			r_dst = r_X;
+			goto load_common;
+		case BPF_S_ST:
+			ctx->seen |= SEEN_MEM;
+			emit(ARM_STR_I(r_A, ARM_SP, mem_words_off(k)), ctx);
+			break;
+		case BPF_S_STX:
+			ctx->seen |= SEEN_MEM | SEEN_X;
+			emit(ARM_STR_I(r_X, ARM_SP, mem_words_off(k)), ctx);
+			break;
+		case BPF_S_ALU_ADD_K:
+			/* A += K */
+			emit_alu_k(ARM_INST_ADD_I, ARM_INST_ADD_R, k, ctx);
+			break;
+		case BPF_S_ALU_ADD_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_ADD_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_SUB_K:
+			/* A -= K */
+			emit_alu_k(ARM_INST_SUB_I, ARM_INST_SUB_R, k, ctx);
+			break;
+		case BPF_S_ALU_SUB_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_SUB_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_MUL_K:
+			/* A *= K */
+			emit_mov_i(r_scratch, k, ctx);
+			emit(ARM_MUL(r_A, r_A, r_scratch), ctx);
+			break;
+		case BPF_S_ALU_MUL_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_MUL(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_DIV_K:
+			/*
+			 * sk_chk_filter() turned K into its reciprocal:
+			 * A = ((u64)A * K) >> 32
+			 */
+			emit_mov_i(r_off, k, ctx);
+			emit(ARM_UMULL(r_scratch, r_A, r_off, r_A), ctx);
+			break;
+		case BPF_S_ALU_DIV_X:
+			ctx->seen |= SEEN_X | SEEN_CALL;
+			emit(ARM_CMP_I(r_X, 0), ctx);
+			emit_err_ret(ARM_COND_EQ, ctx);
+			emit(ARM_MOV_R(ARM_R0, r_A), ctx);
+			emit(ARM_MOV_R(ARM_R1, r_X), ctx);
+			emit_mov_i(ARM_R3, (u32)jit_udiv, ctx);
+			emit_blx_r(ARM_R3, ctx);
+			emit(ARM_MOV_R(r_A, ARM_R0), ctx);
+			break;
+		case BPF_S_ALU_OR_K:
+			/* A |= K */
+			emit_alu_k(ARM_INST_ORR_I, ARM_INST_ORR_R, k, ctx);
+			break;
+		case BPF_S_ALU_OR_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_ORR_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_AND_K:
+			/* A &= K */
+			emit_alu_k(ARM_INST_AND_I, ARM_INST_AND_R, k, ctx);
+			break;
+		case BPF_S_ALU_AND_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_AND_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_LSH_K:
+			/* register shifts by 32 or more give 0 on ARM too */
+			if (k >= 32)
+				emit(ARM_MOV_I(r_A, 0), ctx);
+			else if (k)
+				emit(ARM_LSL_I(r_A, r_A, k), ctx);
+			break;
+		case BPF_S_ALU_LSH_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_LSL_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_RSH_K:
+			/* LSR #0 encodes LSR #32 */
+			if (k >= 32)
+				emit(ARM_MOV_I(r_A, 0), ctx);
+			else if (k)
+				emit(ARM_LSR_I(r_A, r_A, k), ctx);
+			break;
+		case BPF_S_ALU_RSH_X:
+			ctx->seen |= SEEN_X;
+			emit(ARM_LSR_R(r_A, r_A, r_X), ctx);
+			break;
+		case BPF_S_ALU_NEG:
+			/* A = -A */
+			emit(ARM_RSB_I(r_A, r_A, 0), ctx);
+			break;
+		case BPF_S_JMP_JA:
+			/* pc += K */
+			emit(ARM_B(b_imm(i + k + 1, ctx)), ctx);
+			break;
+		case BPF_S_JMP_JEQ_K:
+			/* pc += (A == K) ? pc->jt : pc->jf */
+			condt  = ARM_COND_EQ;
+			goto cmp_imm;
+		case BPF_S_JMP_JGT_K:
+			/* pc += (A > K) ? pc->jt : pc->jf */
+			condt  = ARM_COND_HI;
+			goto cmp_imm;
+		case BPF_S_JMP_JGE_K:
+			/* pc += (A >= K) ? pc->jt : pc->jf */
+			condt  = ARM_COND_HS;
+cmp_imm:
+			imm12 = imm8m(k);
+			if (imm12 < 0) {
+				emit_mov_i(r_scratch, k, ctx);
+				emit(ARM_CMP_R(r_A, r_scratch), ctx);
+			} else {
+				emit(ARM_CMP_I(r_A, imm12), ctx);
+			}
+cond_jump:
+			if (inst->jt)
+				_emit(condt, ARM_B(b_imm(i + inst->jt + 1,
+						   ctx)), ctx);
+			if (inst->jf)
+				_emit(condt ^ 1, ARM_B(b_imm(i + inst->jf + 1,
+						       ctx)), ctx);
+			break;
+		case BPF_S_JMP_JEQ_X:
+			/* pc += (A == X) ? pc->jt : pc->jf */
+			condt   = ARM_COND_EQ;
+			goto cmp_x;
+		case BPF_S_JMP_JGT_X:
+			/* pc += (A > X) ? pc->jt : pc->jf */
+			condt   = ARM_COND_HI;
+			goto cmp_x;
+		case BPF_S_JMP_JGE_X:
+			/* pc += (A >= X) ? pc->jt : pc->jf */
+			condt   = ARM_COND_HS;
+cmp_x:
+			ctx->seen |= SEEN_X;
+			emit(ARM_CMP_R(r_A, r_X), ctx);
+			goto cond_jump;
+		case BPF_S_JMP_JSET_K:
+			/* pc += (A & K) ? pc->jt : pc->jf */
+			condt  = ARM_COND_NE;
+			imm12 = imm8m(k);
+			if (imm12 < 0) {
+				emit_mov_i(r_scratch, k, ctx);
+				emit(ARM_TST_R(r_A, r_scratch), ctx);
+			} else {
+				emit(ARM_TST_I(r_A, imm12), ctx);
+			}
+			goto cond_jump;
+		case BPF_S_JMP_JSET_X:
+			/* pc += (A & X) ? pc->jt : pc->jf */
+			ctx->seen |= SEEN_X;
+			condt  = ARM_COND_NE;
+			emit(ARM_TST_R(r_A, r_X), ctx);
+			goto cond_jump;
+		case BPF_S_RET_A:
+			emit(ARM_MOV_R(ARM_R0, r_A), ctx);
+			goto b_epilogue;
+		case BPF_S_RET_K:
+			emit_mov_i(ARM_R0, k, ctx);
+b_epilogue:
+			if (i != prog->len - 1)
+				emit(ARM_B(b_imm(prog->len, ctx)), ctx);
+			break;
+		case BPF_S_MISC_TAX:
+			/* X = A */
+			ctx->seen |= SEEN_X;
+			emit(ARM_MOV_R(r_X, r_A), ctx);
+			break;
+		case BPF_S_MISC_TXA:
+			/* A = X */
+			ctx->seen |= SEEN_X;
+			emit(ARM_MOV_R(r_A, r_X), ctx);
+			break;
+		case BPF_S_ANC_PROTOCOL:
+			/* A = ntohs(skb->protocol) */
+			ctx->seen |= SEEN_SKB;
+			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff,
+						  protocol) != 2);
+			emit_ldrh(r_A, r_skb,
+				  offsetof(struct sk_buff, protocol), ctx);
+			emit_swap16(r_A, ctx);
+			break;
+		case BPF_S_ANC_CPU:
+#ifdef CONFIG_SMP
+			/* r_scratch = current_thread_info() */
+			emit(ARM_MOV_R(r_scratch, ARM_SP), ctx);
+			emit(ARM_LSR_I(r_scratch, r_scratch,
+				       ilog2(THREAD_SIZE)), ctx);
+			emit(ARM_LSL_I(r_scratch, r_scratch,
+				       ilog2(THREAD_SIZE)), ctx);
+			BUILD_BUG_ON(FIELD_SIZEOF(struct thread_info, cpu) != 4);
+			emit(ARM_LDR_I(r_A, r_scratch,
+				       offsetof(struct thread_info, cpu)), ctx);
+#else
+			emit(ARM_MOV_I(r_A, 0), ctx);
+#endif
+			break;
+		case BPF_S_ANC_IFINDEX:
+		case BPF_S_ANC_HATYPE:
+			/* A = skb->dev->ifindex */
+			/* A = skb->dev->type */
+			ctx->seen |= SEEN_SKB;
+			emit(ARM_LDR_I(r_scratch, r_skb,
+				       offsetof(struct sk_buff, dev)), ctx);
+			emit(ARM_CMP_I(r_scratch, 0), ctx);
+			emit_err_ret(ARM_COND_EQ, ctx);
+
+			if (inst->code == BPF_S_ANC_IFINDEX) {
+				BUILD_BUG_ON(FIELD_SIZEOF(struct net_device,
+							  ifindex) != 4);
+				BUILD_BUG_ON(offsetof(struct net_device,
+						      ifindex) > 4095);
+				emit(ARM_LDR_I(r_A, r_scratch,
+					       offsetof(struct net_device,
+							ifindex)), ctx);
+			} else {
+				BUILD_BUG_ON(FIELD_SIZEOF(struct net_device,
+							  type) != 2);
+				emit_ldrh(r_A, r_scratch,
+					  offsetof(struct net_device, type),
+					  ctx);
+			}
+			break;
+		case BPF_S_ANC_MARK:
+			ctx->seen |= SEEN_SKB;
+			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, mark) != 4);
+			emit(ARM_LDR_I(r_A, r_skb,
+				       offsetof(struct sk_buff, mark)), ctx);
+			break;
+		case BPF_S_ANC_RXHASH:
+			ctx->seen |= SEEN_SKB;
+			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff, rxhash) != 4);
+			emit(ARM_LDR_I(r_A, r_skb,
+				       offsetof(struct sk_buff, rxhash)), ctx);
+			break;
+		case BPF_S_ANC_QUEUE:
+			ctx->seen |= SEEN_SKB;
+			BUILD_BUG_ON(FIELD_SIZEOF(struct sk_buff,
+						  queue_mapping) != 2);
+			emit_ldrh(r_A, r_skb,
+				  offsetof(struct sk_buff, queue_mapping), ctx);
+			break;
+		default:
+			/* hand the program back to sk_run_filter() */
+			return -ENOTSUPP;
+		}
+	}
+
+	/* compute offsets only during the first pass */
+	if (ctx->target == NULL)
+		ctx->offsets[i] = ctx->idx * 4;
+
+	return 0;
+}
+
+void bpf_jit_compile(struct sk_filter *fp)
+{
+	struct jit_ctx ctx;
+	unsigned tmp_idx;
+	unsigned alloc_size;
+
+	if (!bpf_jit_enable)
+		return;
+
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.skf		= fp;
+
+	/* one more slot for the epilogue */
+	ctx.offsets = kzalloc(4 * (ctx.skf->len + 1), GFP_KERNEL);
+	if (ctx.offsets == NULL)
+		return;
+
+	/* fake pass to fill in ctx.seen and ctx.offsets */
+	if (unlikely(build_body(&ctx)))
+		goto out;
+
+	tmp_idx = ctx.idx;
+	build_prologue(&ctx);
+	ctx.prologue_bytes = (ctx.idx - tmp_idx) * 4;
+
+	build_epilogue(&ctx);
+
+	alloc_size = 4 * ctx.idx;
+	ctx.target = module_alloc(max_t(unsigned, alloc_size,
+					sizeof(struct work_struct)));
+	if (unlikely(ctx.target == NULL))
+		goto out;
+
+	ctx.idx = 0;
+	build_prologue(&ctx);
+	build_body(&ctx);
+	build_epilogue(&ctx);
+
+	flush_icache_range((u32)ctx.target, (u32)(ctx.target + ctx.idx));
+
+	if (bpf_jit_enable > 1)
+		print_hex_dump(KERN_INFO, "BPF JIT code: ",
+			       DUMP_PREFIX_ADDRESS, 16, 4, ctx.target,
+			       alloc_size, false);
+
+	fp->bpf_func = (void *)ctx.target;
+out:
+	kfree(ctx.offsets);
+	return;
+}
+
+static void bpf_jit_free_worker(struct work_struct *work)
+{
+	module_free(NULL, work);
+}
+
+void bpf_jit_free(struct sk_filter *fp)
+{
+	struct work_struct *work;
+
+	if (fp->bpf_func != sk_run_filter) {
+		work = (struct work_struct *)fp->bpf_func;
+
+		INIT_WORK(work, bpf_jit_free_worker);
+		schedule_work(work);
+	}
+}
@@ -11,6 +11,9 @@
 #include <linux/platform_device.h>
 #include <linux/atmel_tc.h>
 
+#ifdef CONFIG_HAVE_SCHED_CLOCK
+#include <asm/sched_clock.h>
+#endif
 
 /*
  * We're configured to use a specific TC block, one that's not hooked
@@ -22,7 +25,11 @@
  *
  *   - The third channel may be used to provide a 16-bit clockevent
  *     source, used in either periodic or oneshot mode.  This runs
- *     at 32 KiHZ, and can handle delays of up to two seconds.
+ *     at 32 KiHZ, and can handle delays of up to two seconds; or,
+ *     with ATMEL_TCB_CLKSRC_HRES, from a 1+ MHz divided master clock
+ *     for hrtimers with microsecond resolution.
+ *
+ *   - On ARM, the clocksource counter also backs sched_clock().
  *
  * A boot clocksource and clockevent source are also currently needed,
  * unless the relevant platforms (ARM/AT91, AVR32/AT32) are changed so
@@ -39,21 +46,29 @@
 
 static void __iomem *tcaddr;
 
-static cycle_t tc_get_cycles(struct clocksource *cs)
+/*
+ * The upper half only moves when the lower one wraps, so a stable upper
+ * half around the read of the lower one means the pair is consistent.
+ * Nothing is shared, so this needs no locking nor IRQ masking: if we're
+ * interrupted long enough for the lower half to wrap, we just go again.
+ */
+static inline u32 notrace tc_read_counter(void)
 {
-	unsigned long	flags;
 	u32		lower, upper;
 
-	raw_local_irq_save(flags);
 	do {
 		upper = __raw_readl(tcaddr + ATMEL_TC_REG(1, CV));
 		lower = __raw_readl(tcaddr + ATMEL_TC_REG(0, CV));
 	} while (upper != __raw_readl(tcaddr + ATMEL_TC_REG(1, CV)));
 
-	raw_local_irq_restore(flags);
 	return (upper << 16) | lower;
 }
 
+static cycle_t tc_get_cycles(struct clocksource *cs)
+{
+	return tc_read_counter();
+}
+
 static struct clocksource clksrc = {
 	.name           = "tcb_clksrc",
 	.rating         = 200,
@@ -75,14 +90,16 @@ static struct tc_clkevt_device *to_tc_clkevt(struct clock_event_device *clkevt)
 	return container_of(clkevt, struct tc_clkevt_device, clkevt);
 }
 
-/* For now, we always use the 32K clock ... this optimizes for NO_HZ,
+/* By default we use the 32K clock ... this optimizes for NO_HZ,
  * because using one of the divided clocks would usually mean the
  * tick rate can never be less than several dozen Hz (vs 0.5 Hz).
  *
- * A divided clock could be good for high resolution timers, since
- * 30.5 usec resolution can seem "low".
+ * A divided clock is better for high resolution timers, since
+ * 30.5 usec resolution can seem "low"; ATMEL_TCB_CLKSRC_HRES picks
+ * one of at least 1 MHz.
  */
 static u32 timer_clock;
+static u32 timer_rate;
 
 static void tc_mode(enum clock_event_mode m, struct clock_event_device *d)
 {
@@ -104,11 +121,12 @@ static void tc_mode(enum clock_event_mode m, struct clock_event_device *d)
 	case CLOCK_EVT_MODE_PERIODIC:
 		clk_enable(tcd->clk);
 
-		/* slow clock, count up to RC, then irq and restart */
+		/* count up to RC, then irq and restart */
 		__raw_writel(timer_clock
 				| ATMEL_TC_WAVE | ATMEL_TC_WAVESEL_UP_AUTO,
 				regs + ATMEL_TC_REG(2, CMR));
-		__raw_writel((32768 + HZ/2) / HZ, tcaddr + ATMEL_TC_REG(2, RC));
+		__raw_writel((timer_rate + HZ/2) / HZ,
+				tcaddr + ATMEL_TC_REG(2, RC));
 
 		/* Enable clock and interrupts on RC compare */
 		__raw_writel(ATMEL_TC_CPCS, regs + ATMEL_TC_REG(2, IER));
@@ -121,7 +139,7 @@ static void tc_mode(enum clock_event_mode m, struct clock_event_device *d)
 	case CLOCK_EVT_MODE_ONESHOT:
 		clk_enable(tcd->clk);
 
-		/* slow clock, count up to RC, then irq and stop */
+		/* count up to RC, then irq and stop */
 		__raw_writel(timer_clock | ATMEL_TC_CPCSTOP
 				| ATMEL_TC_WAVE | ATMEL_TC_WAVESEL_UP_AUTO,
 				regs + ATMEL_TC_REG(2, CMR));
@@ -178,7 +196,8 @@ static struct irqaction tc_irqaction = {
 	.handler	= ch2_irq,
 };
 
-static void __init setup_clkevents(struct atmel_tc *tc, int clk32k_divisor_idx)
+static void __init setup_clkevents(struct atmel_tc *tc, int divisor_idx,
+		u32 rate)
 {
 	struct clk *t2_clk = tc->clk[2];
 	int irq = tc->irq[2];
@@ -187,9 +206,10 @@ static void __init setup_clkevents(struct atmel_tc *tc, int clk32k_divisor_idx)
 	clkevt.clk = t2_clk;
 	tc_irqaction.dev_id = &clkevt;
 
-	timer_clock = clk32k_divisor_idx;
+	timer_clock = divisor_idx;
+	timer_rate = rate;
 
-	clkevt.clkevt.mult = div_sc(32768, NSEC_PER_SEC, clkevt.clkevt.shift);
+	clkevt.clkevt.mult = div_sc(rate, NSEC_PER_SEC, clkevt.clkevt.shift);
 	clkevt.clkevt.max_delta_ns
 		= clockevent_delta2ns(0xffff, &clkevt.clkevt);
 	clkevt.clkevt.min_delta_ns = clockevent_delta2ns(1, &clkevt.clkevt) + 1;
@@ -202,7 +222,33 @@ static void __init setup_clkevents(struct atmel_tc *tc, int clk32k_divisor_idx)
 
 #else /* !CONFIG_GENERIC_CLOCKEVENTS */
 
-static void __init setup_clkevents(struct atmel_tc *tc, int clk32k_divisor_idx)
+static void __init setup_clkevents(struct atmel_tc *tc, int divisor_idx,
+		u32 rate)
+{
+	/* NOTHING */
+}
+
+#endif
+
+#ifdef CONFIG_HAVE_SCHED_CLOCK
+
+static u32 notrace tc_sched_clock_read(void)
+{
+	return tc_read_counter();
+}
+
+static void __init setup_tc_sched_clock(u32 rate)
+{
+	unsigned long flags;
+
+	local_irq_save(flags);
+	setup_sched_clock(tc_sched_clock_read, 32, rate);
+	local_irq_restore(flags);
+}
+
+#else
+
+static void __init setup_tc_sched_clock(u32 rate)
 {
 	/* NOTHING */
 }
@@ -220,6 +266,8 @@ static int __init tcb_clksrc_init(void)
 	u32 rate, divided_rate = 0;
 	int best_divisor_idx = -1;
 	int clk32k_divisor_idx = -1;
+	u32 hres_rate = 0;
+	int hres_divisor_idx = -1;
 	int i;
 
 	tc = atmel_tc_alloc(CONFIG_ATMEL_TCB_CLKSRC_BLOCK, clksrc.name);
@@ -247,6 +295,15 @@ static int __init tcb_clksrc_init(void)
 
 		tmp = rate / divisor;
 		pr_debug("TC: %u / %-3u [%d] --> %u\n", rate, divisor, i, tmp);
+
+		/* slowest divided clock still good for 1 usec events,
+		 * whose periodic reload still fits in 16 bits
+		 */
+		if (tmp >= 1000 * 1000 && tmp / HZ <= 0xffff) {
+			hres_rate = tmp;
+			hres_divisor_idx = i;
+		}
+
 		if (best_divisor_idx > 0) {
 			if (tmp < 5 * 1000 * 1000)
 				continue;
@@ -291,9 +348,13 @@ static int __init tcb_clksrc_init(void)
 
 	/* and away we go! */
 	clocksource_register_hz(&clksrc, divided_rate);
+	setup_tc_sched_clock(divided_rate);
 
 	/* channel 2:  periodic and oneshot timer support */
-	setup_clkevents(tc, clk32k_divisor_idx);
+	if (IS_ENABLED(CONFIG_ATMEL_TCB_CLKSRC_HRES) && hres_divisor_idx >= 0)
+		setup_clkevents(tc, hres_divisor_idx, hres_rate);
+	else
+		setup_clkevents(tc, clk32k_divisor_idx, 32768);
 
 	return 0;
 }
@@ -101,32 +101,48 @@ static struct at_desc *atc_alloc_descriptor(struct dma_chan *chan,
 	return desc;
 }
 
+/**
+ * atc_desc_reclaim - move descriptors acked since completion to free_list
+ * @atchan: channel we work on
+ *
+ * Called with atchan->lock held, only when free_list ran dry.
+ */
+static void atc_desc_reclaim(struct at_dma_chan *atchan)
+{
+	struct at_desc *desc, *_desc;
+
+	list_for_each_entry_safe(desc, _desc, &atchan->unacked_list,
+				 desc_node) {
+		if (async_tx_test_ack(&desc->txd)) {
+			list_move(&desc->desc_node, &atchan->free_list);
+			atchan->descs_free++;
+		}
+	}
+}
+
 /**
  * atc_desc_get - get an unused descriptor from free_list
  * @atchan: channel we want a new descriptor for
+ *
+ * Everything on free_list is ready for reuse, so this is a constant
+ * time operation.  The pool grows by one descriptor whenever it is
+ * empty; atc_desc_trim() shrinks it back once the burst is over.
  */
 static struct at_desc *atc_desc_get(struct at_dma_chan *atchan)
 {
-	struct at_desc *desc, *_desc;
 	struct at_desc *ret = NULL;
 	unsigned long flags;
-	unsigned int i = 0;
-	LIST_HEAD(tmp_list);
 
 	spin_lock_irqsave(&atchan->lock, flags);
-	list_for_each_entry_safe(desc, _desc, &atchan->free_list, desc_node) {
-		i++;
-		if (async_tx_test_ack(&desc->txd)) {
-			list_del(&desc->desc_node);
-			ret = desc;
-			break;
-		}
-		dev_dbg(chan2dev(&atchan->chan_common),
-				"desc %p not ACKed\n", desc);
+	if (list_empty(&atchan->free_list))
+		atc_desc_reclaim(atchan);
+	if (!list_empty(&atchan->free_list)) {
+		ret = list_first_entry(&atchan->free_list,
+				       struct at_desc, desc_node);
+		list_del(&ret->desc_node);
+		atchan->descs_free--;
 	}
 	spin_unlock_irqrestore(&atchan->lock, flags);
-	dev_vdbg(chan2dev(&atchan->chan_common),
-		"scanned %u descriptors on freelist\n", i);
 
 	/* no more descriptor available in initial pool: create one more */
 	if (!ret) {
@@ -152,22 +168,50 @@ static struct at_desc *atc_desc_get(struct at_dma_chan *atchan)
 static void atc_desc_put(struct at_dma_chan *atchan, struct at_desc *desc)
 {
 	if (desc) {
-		struct at_desc *child;
 		unsigned long flags;
 
 		spin_lock_irqsave(&atchan->lock, flags);
-		list_for_each_entry(child, &desc->tx_list, desc_node)
-			dev_vdbg(chan2dev(&atchan->chan_common),
-					"moving child desc %p to freelist\n",
-					child);
 		list_splice_init(&desc->tx_list, &atchan->free_list);
 		dev_vdbg(chan2dev(&atchan->chan_common),
-			 "moving desc %p to freelist\n", desc);
+			 "moving desc %p and %u children to freelist\n",
+			 desc, desc->chain_len - 1);
 		list_add(&desc->desc_node, &atchan->free_list);
+		atchan->descs_free += desc->chain_len;
 		spin_unlock_irqrestore(&atchan->lock, flags);
 	}
 }
 
+/**
+ * atc_desc_trim - give surplus descriptors back to the dma pool
+ * @atchan: channel we work on
+ *
+ * Once a burst has grown the free list to more than twice the initial
+ * pool size, shrink it back to init_nr_desc_per_channel entries.  The
+ * least recently used descriptors sit at the tail of free_list.
+ */
+static void atc_desc_trim(struct at_dma_chan *atchan)
+{
+	struct at_dma	*atdma = to_at_dma(atchan->chan_common.device);
+	struct at_desc	*desc, *_desc;
+	unsigned long	flags;
+	LIST_HEAD(list);
+
+	spin_lock_irqsave(&atchan->lock, flags);
+	if (atchan->descs_free > 2 * init_nr_desc_per_channel) {
+		while (atchan->descs_free > init_nr_desc_per_channel) {
+			desc = list_entry(atchan->free_list.prev,
+					  struct at_desc, desc_node);
+			list_move(&desc->desc_node, &list);
+			atchan->descs_free--;
+			atchan->descs_allocated--;
+		}
+	}
+	spin_unlock_irqrestore(&atchan->lock, flags);
+
+	list_for_each_entry_safe(desc, _desc, &list, desc_node)
+		dma_pool_free(atdma->dma_desc_pool, desc, desc->txd.phys);
+}
+
 /**
  * atc_desc_chain - build chain adding a descripor
  * @first: address of first descripor of the chain
@@ -181,12 +225,14 @@ static void atc_desc_chain(struct at_desc **first, struct at_desc **prev,
 {
 	if (!(*first)) {
 		*first = desc;
+		desc->chain_len = 1;
 	} else {
 		/* inform the HW lli about chaining */
 		(*prev)->lli.dscr = desc->txd.phys;
 		/* insert the link descriptor to the LD ring */
 		list_add_tail(&desc->desc_node,
 				&(*first)->tx_list);
+		(*first)->chain_len++;
 	}
 	*prev = desc;
 }
@@ -273,8 +319,14 @@ atc_chain_complete(struct at_dma_chan *atchan, struct at_desc *desc)
 
 	/* move children to free_list */
 	list_splice_init(&desc->tx_list, &atchan->free_list);
-	/* move myself to free_list */
-	list_move(&desc->desc_node, &atchan->free_list);
+	atchan->descs_free += desc->chain_len - 1;
+	/* move myself to free_list, unless the client still owns me */
+	if (async_tx_test_ack(txd)) {
+		list_move(&desc->desc_node, &atchan->free_list);
+		atchan->descs_free++;
+	} else {
+		list_move(&desc->desc_node, &atchan->unacked_list);
+	}
 
 	/* unmap dma addresses (not on slave channels) */
 	if (!atchan->chan_common.private) {
@@ -486,6 +538,8 @@ static void atc_tasklet(unsigned long data)
 		atc_advance_work(atchan);
 
 	spin_unlock_irqrestore(&atchan->lock, flags);
+
+	atc_desc_trim(atchan);
 }
 
 static irqreturn_t at_dma_interrupt(int irq, void *dev_id)
@@ -566,36 +620,27 @@ static dma_cookie_t atc_tx_submit(struct dma_async_tx_descriptor *tx)
 }
 
 /**
- * atc_prep_dma_memcpy - prepare a memcpy operation
- * @chan: the channel to prepare operation on
- * @dest: operation virtual destination address
- * @src: operation virtual source address
- * @len: operation length
- * @flags: tx descriptor status flags
+ * atc_chain_memcpy - append descriptors copying one contiguous region
+ * @atchan: channel we work on
+ * @first: address of first descriptor of the chain
+ * @prev: address of previous descriptor of the chain
+ * @dest: destination bus address
+ * @src: source bus address
+ * @len: number of bytes to copy
+ *
+ * Called from prep_* functions
  */
-static struct dma_async_tx_descriptor *
-atc_prep_dma_memcpy(struct dma_chan *chan, dma_addr_t dest, dma_addr_t src,
-		size_t len, unsigned long flags)
+static int atc_chain_memcpy(struct at_dma_chan *atchan,
+		struct at_desc **first, struct at_desc **prev,
+		dma_addr_t dest, dma_addr_t src, size_t len)
 {
-	struct at_dma_chan	*atchan = to_at_dma_chan(chan);
-	struct at_desc		*desc = NULL;
-	struct at_desc		*first = NULL;
-	struct at_desc		*prev = NULL;
+	struct at_desc		*desc;
 	size_t			xfer_count;
 	size_t			offset;
 	unsigned int		src_width;
-	unsigned int		dst_width;
 	u32			ctrla;
 	u32			ctrlb;
 
-	dev_vdbg(chan2dev(chan), "prep_dma_memcpy: d0x%x s0x%x l0x%zx f0x%lx\n",
-			dest, src, len, flags);
-
-	if (unlikely(!len)) {
-		dev_dbg(chan2dev(chan), "prep_dma_memcpy: length is zero!\n");
-		return NULL;
-	}
-
 	ctrla =   ATC_DEFAULT_CTRLA;
 	ctrlb =   ATC_DEFAULT_CTRLB | ATC_IEN
 		| ATC_SRC_ADDR_MODE_INCR
@@ -608,13 +653,13 @@ atc_prep_dma_memcpy(struct dma_chan *chan, dma_addr_t dest, dma_addr_t src,
 	 */
 	if (!((src | dest  | len) & 3)) {
 		ctrla |= ATC_SRC_WIDTH_WORD | ATC_DST_WIDTH_WORD;
-		src_width = dst_width = 2;
+		src_width = 2;
 	} else if (!((src | dest | len) & 1)) {
 		ctrla |= ATC_SRC_WIDTH_HALFWORD | ATC_DST_WIDTH_HALFWORD;
-		src_width = dst_width = 1;
+		src_width = 1;
 	} else {
 		ctrla |= ATC_SRC_WIDTH_BYTE | ATC_DST_WIDTH_BYTE;
-		src_width = dst_width = 0;
+		src_width = 0;
 	}
 
 	for (offset = 0; offset < len; offset += xfer_count << src_width) {
@@ -623,7 +668,7 @@ atc_prep_dma_memcpy(struct dma_chan *chan, dma_addr_t dest, dma_addr_t src,
 
 		desc = atc_desc_get(atchan);
 		if (!desc)
-			goto err_desc_get;
+			return -ENOMEM;
 
 		desc->lli.saddr = src + offset;
 		desc->lli.daddr = dest + offset;
@@ -632,15 +677,45 @@ atc_prep_dma_memcpy(struct dma_chan *chan, dma_addr_t dest, dma_addr_t src,
 
 		desc->txd.cookie = 0;
 
-		atc_desc_chain(&first, &prev, desc);
+		atc_desc_chain(first, prev, desc);
+	}
+
+	return 0;
+}
+
+/**
+ * atc_prep_dma_memcpy - prepare a memcpy operation
+ * @chan: the channel to prepare operation on
+ * @dest: operation virtual destination address
+ * @src: operation virtual source address
+ * @len: operation length
+ * @flags: tx descriptor status flags
+ */
+static struct dma_async_tx_descriptor *
+atc_prep_dma_memcpy(struct dma_chan *chan, dma_addr_t dest, dma_addr_t src,
+		size_t len, unsigned long flags)
+{
+	struct at_dma_chan	*atchan = to_at_dma_chan(chan);
+	struct at_desc		*first = NULL;
+	struct at_desc		*prev = NULL;
+
+	dev_vdbg(chan2dev(chan), "prep_dma_memcpy: d0x%x s0x%x l0x%zx f0x%lx\n",
+			dest, src, len, flags);
+
+	if (unlikely(!len)) {
+		dev_dbg(chan2dev(chan), "prep_dma_memcpy: length is zero!\n");
+		return NULL;
 	}
 
+	if (atc_chain_memcpy(atchan, &first, &prev, dest, src, len))
+		goto err_desc_get;
+
 	/* First descriptor of the chain embedds additional information */
 	first->txd.cookie = -EBUSY;
 	first->len = len;
 
 	/* set end-of-link to the last link descriptor of list*/
-	set_desc_eol(desc);
+	set_desc_eol(prev);
 
 	first->txd.flags = flags; /* client is in control of this ack */
 
@@ -651,6 +726,182 @@ err_desc_get:
 	return NULL;
 }
 
+/**
+ * atc_prep_dma_sg - prepare a memory to memory scatter-gather operation
+ * @chan: the channel to prepare operation on
+ * @dst_sg: destination scatterlist
+ * @dst_nents: number of entries in @dst_sg
+ * @src_sg: source scatterlist
+ * @src_nents: number of entries in @src_sg
+ * @flags: tx descriptor status flags
+ *
+ * The two lists do not need to be segmented the same way.  The whole
+ * operation is a single chain, so it completes with one interrupt.
+ * Scatterlists stay mapped: the caller unmaps them on completion.
+ */
+static struct dma_async_tx_descriptor *
+atc_prep_dma_sg(struct dma_chan *chan,
+		struct scatterlist *dst_sg, unsigned int dst_nents,
+		struct scatterlist *src_sg, unsigned int src_nents,
+		unsigned long flags)
+{
+	struct at_dma_chan	*atchan = to_at_dma_chan(chan);
+	struct at_desc		*first = NULL;
+	struct at_desc		*prev = NULL;
+	size_t			dst_len, src_len, len;
+	size_t			total_len = 0;
+	dma_addr_t		dst, src;
+
+	dev_vdbg(chan2dev(chan), "prep_dma_sg: d%u s%u f0x%lx\n",
+			dst_nents, src_nents, flags);
+
+	if (unlikely(!dst_sg || !src_sg || !dst_nents || !src_nents))
+		return NULL;
+
+	dst = sg_dma_address(dst_sg);
+	dst_len = sg_dma_len(dst_sg);
+	src = sg_dma_address(src_sg);
+	src_len = sg_dma_len(src_sg);
+
+	for (;;) {
+		len = min_t(size_t, dst_len, src_len);
+		if (len) {
+			if (atc_chain_memcpy(atchan, &first, &prev,
+					     dst, src, len))
+				goto err_desc_get;
+			total_len += len;
+			dst += len;
+			dst_len -= len;
+			src += len;
+			src_len -= len;
+		}
+
+		if (!dst_len) {
+			if (!--dst_nents)
+				break;
+			dst_sg = sg_next(dst_sg);
+			dst = sg_dma_address(dst_sg);
+			dst_len = sg_dma_len(dst_sg);
+		}
+		if (!src_len) {
+			if (!--src_nents)
+				break;
+			src_sg = sg_next(src_sg);
+			src = sg_dma_address(src_sg);
+			src_len = sg_dma_len(src_sg);
+		}
+	}
+
+	if (unlikely(!first))
+		return NULL;
+
+	/* First descriptor of the chain embedds additional information */
+	first->txd.cookie = -EBUSY;
+	first->len = total_len;
+
+	/* set end-of-link to the last link descriptor of list*/
+	set_desc_eol(prev);
+
+	/* completion cannot unmap scatterlists, leave that to the client */
+	first->txd.flags = flags | DMA_COMPL_SKIP_SRC_UNMAP
+				 | DMA_COMPL_SKIP_DEST_UNMAP;
+
+	return &first->txd;
+
+err_desc_get:
+	atc_desc_put(atchan, first);
+	return NULL;
+}
+
+/**
+ * atc_prep_interleaved - prepare a strided memory to memory transfer
+ * @chan: the channel to prepare operation on
+ * @xt: interleaved transfer template
+ * @flags: tx descriptor status flags
+ *
+ * Each chunk becomes one link descriptor; chunks that turn out to be
+ * contiguous on both sides are merged.  Only incrementing memory to
+ * memory templates are supported.  Addresses are not unmapped on
+ * completion.
+ */
+static struct dma_async_tx_descriptor *
+atc_prep_interleaved(struct dma_chan *chan,
+		struct dma_interleaved_template *xt,
+		unsigned long flags)
+{
+	struct at_dma_chan	*atchan = to_at_dma_chan(chan);
+	struct at_desc		*first = NULL;
+	struct at_desc		*prev = NULL;
+	dma_addr_t		dst, src;
+	dma_addr_t		run_dst = 0, run_src = 0;
+	size_t			run_len = 0;
+	size_t			total_len = 0;
+	size_t			f, i;
+
+	if (unlikely(!xt || !xt->numf || !xt->frame_size))
+		return NULL;
+
+	dev_vdbg(chan2dev(chan), "prep_interleaved: d0x%x s0x%x %zux%zu f0x%lx\n",
+			xt->dst_start, xt->src_start, xt->numf,
+			xt->frame_size, flags);
+
+	if (xt->dir != DMA_MEM_TO_MEM || !xt->src_inc || !xt->dst_inc) {
+		dev_dbg(chan2dev(chan), "prep_interleaved: unsupported template\n");
+		return NULL;
+	}
+
+	dst = xt->dst_start;
+	src = xt->src_start;
+	for (f = 0; f < xt->numf; f++) {
+		for (i = 0; i < xt->frame_size; i++) {
+			struct data_chunk *chunk = &xt->sgl[i];
+
+			if (run_len && dst == run_dst + run_len
+			    && src == run_src + run_len) {
+				run_len += chunk->size;
+			} else {
+				if (run_len && atc_chain_memcpy(atchan,
+						&first, &prev,
+						run_dst, run_src, run_len))
+					goto err_desc_get;
+				run_dst = dst;
+				run_src = src;
+				run_len = chunk->size;
+			}
+
+			total_len += chunk->size;
+			dst += chunk->size;
+			src += chunk->size;
+			if (xt->dst_sgl)
+				dst += chunk->icg;
+			if (xt->src_sgl)
+				src += chunk->icg;
+		}
+	}
+	if (run_len && atc_chain_memcpy(atchan, &first, &prev,
+					run_dst, run_src, run_len))
+		goto err_desc_get;
+
+	if (unlikely(!first))
+		return NULL;
+
+	/* First descriptor of the chain embedds additional information */
+	first->txd.cookie = -EBUSY;
+	first->len = total_len;
+
+	/* set end-of-link to the last link descriptor of list*/
+	set_desc_eol(prev);
+
+	first->txd.flags = flags | DMA_COMPL_SKIP_SRC_UNMAP
+				 | DMA_COMPL_SKIP_DEST_UNMAP;
+
+	return &first->txd;
+
+err_desc_get:
+	atc_desc_put(atchan, first);
+	return NULL;
+}
+
 
 /**
  * atc_prep_slave_sg - prepare descriptors for a DMA_SLAVE transaction
@@ -993,6 +1244,65 @@ static int atc_control(struct dma_chan *chan, enum dma_ctrl_cmd cmd,
 	return 0;
 }
 
+/**
+ * atc_cyclic_residue - bytes left before a cyclic transfer wraps around
+ * @atchan: channel running a cyclic transfer
+ *
+ * Derived from the memory side address register, so that clients such
+ * as serial drivers can consume a partially filled period.
+ * Called with atchan->lock held.
+ */
+static u32 atc_cyclic_residue(struct at_dma_chan *atchan)
+{
+	struct at_desc	*first = atc_first_active(atchan);
+	dma_addr_t	start;
+	u32		addr;
+
+	if ((first->lli.ctrlb & ATC_FC_MASK) == ATC_FC_PER2MEM) {
+		start = first->lli.daddr;
+		addr = channel_readl(atchan, DADDR);
+	} else {
+		start = first->lli.saddr;
+		addr = channel_readl(atchan, SADDR);
+	}
+
+	if (addr < start || addr - start > first->len)
+		return first->len;
+
+	return first->len - (addr - start);
+}
+
+/**
+ * atc_desc_residue - bytes left to transfer for a descriptor
+ * @atchan: channel the descriptor was submitted to
+ * @cookie: transaction identifier of the descriptor
+ *
+ * Only a running cyclic transfer reports its progress; any other
+ * descriptor still on the active list or only queued reports its full
+ * length.  Called with atchan->lock held.
+ */
+static u32 atc_desc_residue(struct at_dma_chan *atchan, dma_cookie_t cookie)
+{
+	struct at_desc	*desc;
+
+	if (!list_empty(&atchan->active_list)) {
+		desc = atc_first_active(atchan);
+		if (desc->txd.cookie == cookie)
+			return atc_chan_is_cyclic(atchan) ?
+				atc_cyclic_residue(atchan) : desc->len;
+	}
+
+	list_for_each_entry(desc, &atchan->active_list, desc_node)
+		if (desc->txd.cookie == cookie)
+			return desc->len;
+
+	list_for_each_entry(desc, &atchan->queue, desc_node)
+		if (desc->txd.cookie == cookie)
+			return desc->len;
+
+	return 0;
+}
+
 /**
  * atc_tx_status - poll for transaction completion
  * @chan: DMA channel
@@ -1013,6 +1323,7 @@ atc_tx_status(struct dma_chan *chan,
 	dma_cookie_t		last_complete;
 	unsigned long		flags;
 	enum dma_status		ret;
+	u32			residue = 0;
 
 	spin_lock_irqsave(&atchan->lock, flags);
 
@@ -1029,13 +1340,12 @@ atc_tx_status(struct dma_chan *chan,
 		ret = dma_async_is_complete(cookie, last_complete, last_used);
 	}
 
+	if (ret != DMA_SUCCESS)
+		residue = atc_desc_residue(atchan, cookie);
+
 	spin_unlock_irqrestore(&atchan->lock, flags);
 
-	if (ret != DMA_SUCCESS)
-		dma_set_tx_state(txstate, last_complete, last_used,
-			atc_first_active(atchan)->len);
-	else
-		dma_set_tx_state(txstate, last_complete, last_used, 0);
+	dma_set_tx_state(txstate, last_complete, last_used, residue);
 
 	if (atc_chan_is_paused(atchan))
 		ret = DMA_PAUSED;
@@ -1128,6 +1438,7 @@ static int atc_alloc_chan_resources(struct dma_chan *chan)
 
 	spin_lock_irqsave(&atchan->lock, flags);
 	atchan->descs_allocated = i;
+	atchan->descs_free = i;
 	list_splice(&tmp_list, &atchan->free_list);
 	atchan->completed_cookie = chan->cookie = 1;
 	spin_unlock_irqrestore(&atchan->lock, flags);
@@ -1161,6 +1472,7 @@ static void atc_free_chan_resources(struct dma_chan *chan)
 	BUG_ON(!list_empty(&atchan->queue));
 	BUG_ON(atc_chan_is_enabled(atchan));
 
+	list_splice_init(&atchan->unacked_list, &atchan->free_list);
 	list_for_each_entry_safe(desc, _desc, &atchan->free_list, desc_node) {
 		dev_vdbg(chan2dev(chan), "  freeing descriptor %p\n", desc);
 		list_del(&desc->desc_node);
@@ -1169,6 +1481,7 @@ static void atc_free_chan_resources(struct dma_chan *chan)
 	}
 	list_splice_init(&atchan->free_list, &list);
 	atchan->descs_allocated = 0;
+	atchan->descs_free = 0;
 	atchan->status = 0;
 
 	dev_vdbg(chan2dev(chan), "free_chan_resources: done\n");
@@ -1255,7 +1568,11 @@ static int __init at_dma_probe(struct platform_device *pdev)
 
 	/* setup platform data for each SoC */
 	dma_cap_set(DMA_MEMCPY, at91sam9rl_config.cap_mask);
+	dma_cap_set(DMA_SG, at91sam9rl_config.cap_mask);
+	dma_cap_set(DMA_INTERLEAVE, at91sam9rl_config.cap_mask);
 	dma_cap_set(DMA_MEMCPY, at91sam9g45_config.cap_mask);
+	dma_cap_set(DMA_SG, at91sam9g45_config.cap_mask);
+	dma_cap_set(DMA_INTERLEAVE, at91sam9g45_config.cap_mask);
 	dma_cap_set(DMA_SLAVE, at91sam9g45_config.cap_mask);
 
 	/* get DMA parameters from controller type */
@@ -1340,6 +1657,7 @@ static int __init at_dma_probe(struct platform_device *pdev)
 		INIT_LIST_HEAD(&atchan->active_list);
 		INIT_LIST_HEAD(&atchan->queue);
 		INIT_LIST_HEAD(&atchan->free_list);
+		INIT_LIST_HEAD(&atchan->unacked_list);
 
 		tasklet_init(&atchan->tasklet, atc_tasklet,
 				(unsigned long)atchan);
@@ -1357,6 +1675,13 @@ static int __init at_dma_probe(struct platform_device *pdev)
 	if (dma_has_cap(DMA_MEMCPY, atdma->dma_common.cap_mask))
 		atdma->dma_common.device_prep_dma_memcpy = atc_prep_dma_memcpy;
 
+	if (dma_has_cap(DMA_SG, atdma->dma_common.cap_mask))
+		atdma->dma_common.device_prep_dma_sg = atc_prep_dma_sg;
+
+	if (dma_has_cap(DMA_INTERLEAVE, atdma->dma_common.cap_mask))
+		atdma->dma_common.device_prep_interleaved_dma =
+			atc_prep_interleaved;
+
 	if (dma_has_cap(DMA_SLAVE, atdma->dma_common.cap_mask)) {
 		atdma->dma_common.device_prep_slave_sg = atc_prep_slave_sg;
 		/* controller can do slave DMA: can trigger cyclic transfers */
@@ -1367,8 +1692,10 @@ static int __init at_dma_probe(struct platform_device *pdev)
 
 	dma_writel(atdma, EN, AT_DMA_ENABLE);
 
-	dev_info(&pdev->dev, "Atmel AHB DMA Controller ( %s%s), %d channels\n",
+	dev_info(&pdev->dev, "Atmel AHB DMA Controller ( %s%s%s%s), %d channels\n",
 	  dma_has_cap(DMA_MEMCPY, atdma->dma_common.cap_mask) ? "cpy " : "",
+	  dma_has_cap(DMA_SG, atdma->dma_common.cap_mask) ? "sg " : "",
+	  dma_has_cap(DMA_INTERLEAVE, atdma->dma_common.cap_mask) ? "interleave " : "",
 	  dma_has_cap(DMA_SLAVE, atdma->dma_common.cap_mask)  ? "slave " : "",
 	  plat_dat->nr_channels);
 
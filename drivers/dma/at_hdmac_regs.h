@@ -163,6 +163,7 @@ struct at_lli {
  * @txd: support for the async_tx api
  * @desc_node: node on the channed descriptors list
  * @len: total transaction bytecount
+ * @chain_len: number of descriptors in the chain (first descriptor only)
  */
 struct at_desc {
 	/* FIRST values the hardware uses */
@@ -173,6 +174,7 @@ struct at_desc {
 	struct dma_async_tx_descriptor	txd;
 	struct list_head		desc_node;
 	size_t				len;
+	unsigned int			chain_len;
 };
 
 static inline struct at_desc *
@@ -212,7 +214,9 @@ enum atc_status {
  * @active_list: list of descriptors dmaengine is being running on
  * @queue: list of descriptors ready to be submitted to engine
  * @free_list: list of descriptors usable by the channel
+ * @unacked_list: completed descriptors the client has not acked yet
  * @descs_allocated: records the actual size of the descriptor pool
+ * @descs_free: number of descriptors on @free_list
  */
 struct at_dma_chan {
 	struct dma_chan		chan_common;
@@ -231,7 +235,9 @@ struct at_dma_chan {
 	struct list_head	active_list;
 	struct list_head	queue;
 	struct list_head	free_list;
+	struct list_head	unacked_list;
 	unsigned int		descs_allocated;
+	unsigned int		descs_free;
 };
 
 #define	channel_readl(atchan, name) \
@@ -18,7 +18,8 @@
 #include <linux/err.h>
 #include <linux/slab.h>
 #include <linux/types.h>
-#include <linux/delay.h>
+#include <linux/completion.h>
+#include <linux/interrupt.h>
 #include <linux/i2c.h>
 #include <linux/init.h>
 #include <linux/clk.h>
@@ -31,27 +32,42 @@
 
 #define TWI_CLOCK		100000		/* Hz. max 400 Kbits/sec */
 
+#define AT91_TWI_INT_MASK \
+	(AT91_TWI_TXCOMP | AT91_TWI_RXRDY | AT91_TWI_TXRDY | AT91_TWI_NACK)
 
-static struct clk *twi_clk;
-static void __iomem *twi_base;
-
-#define at91_twi_read(reg)		__raw_readl(twi_base + (reg))
-#define at91_twi_write(reg, val)	__raw_writel((val), twi_base + (reg))
+/*
+ * One message, or a short write and the read following it, is done
+ * per hardware transfer.  The interrupt handler moves the data and
+ * completes cmd_complete on TXCOMP; transfer_status collects the
+ * error bits seen meanwhile.
+ */
+struct at91_twi_dev {
+	struct device		*dev;
+	struct at91_twi_io	io;
+	int			irq;
+	struct clk		*clk;
+	struct completion	cmd_complete;
+	struct i2c_msg		*msg;
+	u8			*buf;
+	size_t			buf_len;
+	unsigned		transfer_status;
+	struct i2c_adapter	adapter;
+};
 
 
 /*
  * Initialize the TWI hardware registers.
  */
-static void __devinit at91_twi_hwinit(void)
+static void at91_twi_hwinit(struct at91_twi_dev *dev)
 {
 	unsigned long cdiv, ckdiv;
 
-	at91_twi_write(AT91_TWI_IDR, 0xffffffff);	/* Disable all interrupts */
-	at91_twi_write(AT91_TWI_CR, AT91_TWI_SWRST);	/* Reset peripheral */
-	at91_twi_write(AT91_TWI_CR, AT91_TWI_MSEN);	/* Set Master mode */
+	at91_twi_write(&dev->io, AT91_TWI_IDR, 0xffffffff);	/* Disable all interrupts */
+	at91_twi_write(&dev->io, AT91_TWI_CR, AT91_TWI_SWRST);	/* Reset peripheral */
+	at91_twi_write(&dev->io, AT91_TWI_CR, AT91_TWI_MSEN);	/* Set Master mode */
 
 	/* Calcuate clock dividers */
-	cdiv = (clk_get_rate(twi_clk) / (2 * TWI_CLOCK)) - 3;
+	cdiv = (clk_get_rate(dev->clk) / (2 * TWI_CLOCK)) - 3;
 	cdiv = cdiv + 1;	/* round up */
 	ckdiv = 0;
 	while (cdiv > 255) {
@@ -61,116 +77,183 @@ static void __devinit at91_twi_hwinit(void)
 
 	if (cpu_is_at91rm9200()) {			/* AT91RM9200 Errata #22 */
 		if (ckdiv > 5) {
-			printk(KERN_ERR "AT91 I2C: Invalid TWI_CLOCK value!\n");
+			dev_err(dev->dev, "Invalid TWI_CLOCK value!\n");
 			ckdiv = 5;
 		}
 	}
 
-	at91_twi_write(AT91_TWI_CWGR, (ckdiv << 16) | (cdiv << 8) | cdiv);
+	at91_twi_write(&dev->io, AT91_TWI_CWGR, (ckdiv << 16) | (cdiv << 8) | cdiv);
 }
 
-/*
- * Poll the i2c status register until the specified bit is set.
- * Returns 0 if timed out (100 msec).
- */
-static short at91_poll_status(unsigned long bit)
+static void at91_twi_write_next_byte(struct at91_twi_dev *dev)
 {
-	int loop_cntr = 10000;
+	if (!dev->buf_len)
+		return;
 
-	do {
-		udelay(10);
-	} while (!(at91_twi_read(AT91_TWI_SR) & bit) && (--loop_cntr > 0));
+	at91_twi_write(&dev->io, AT91_TWI_THR, *dev->buf++);
 
-	return (loop_cntr > 0);
+	/* nothing left to load: stop, and don't take TXRDY until TXCOMP */
+	if (--dev->buf_len == 0) {
+		at91_twi_write(&dev->io, AT91_TWI_CR, AT91_TWI_STOP);
+		at91_twi_write(&dev->io, AT91_TWI_IDR, AT91_TWI_TXRDY);
+	}
 }
 
-static int xfer_read(struct i2c_adapter *adap, unsigned char *buf, int length)
+static void at91_twi_read_next_byte(struct at91_twi_dev *dev)
 {
-	/* Send Start */
-	at91_twi_write(AT91_TWI_CR, AT91_TWI_START);
-
-	/* Read data */
-	while (length--) {
-		if (!length)	/* need to send Stop before reading last byte */
-			at91_twi_write(AT91_TWI_CR, AT91_TWI_STOP);
-		if (!at91_poll_status(AT91_TWI_RXRDY)) {
-			dev_dbg(&adap->dev, "RXRDY timeout\n");
-			return -ETIMEDOUT;
-		}
-		*buf++ = (at91_twi_read(AT91_TWI_RHR) & 0xff);
-	}
+	if (!dev->buf_len)
+		return;
 
-	return 0;
+	*dev->buf++ = at91_twi_read(&dev->io, AT91_TWI_RHR) & 0xff;
+
+	/* need to send Stop before the last byte is received */
+	if (--dev->buf_len == 1)
+		at91_twi_write(&dev->io, AT91_TWI_CR, AT91_TWI_STOP);
 }
 
-static int xfer_write(struct i2c_adapter *adap, unsigned char *buf, int length)
+static irqreturn_t at91_twi_interrupt(int irq, void *dev_id)
 {
-	/* Load first byte into transmitter */
-	at91_twi_write(AT91_TWI_THR, *buf++);
+	struct at91_twi_dev	*dev = dev_id;
+	unsigned		status = at91_twi_read(&dev->io, AT91_TWI_SR);
+	unsigned		pending = status & at91_twi_read(&dev->io, AT91_TWI_IMR);
 
-	/* Send Start */
-	at91_twi_write(AT91_TWI_CR, AT91_TWI_START);
+	if (!pending)
+		return IRQ_NONE;
 
-	do {
-		if (!at91_poll_status(AT91_TWI_TXRDY)) {
-			dev_dbg(&adap->dev, "TXRDY timeout\n");
-			return -ETIMEDOUT;
-		}
+	if (pending & AT91_TWI_RXRDY)
+		at91_twi_read_next_byte(dev);
+	else if (pending & AT91_TWI_TXRDY)
+		at91_twi_write_next_byte(dev);
 
-		length--;	/* byte was transmitted */
+	/* keep the error flags for at91_twi_do_transfer() */
+	dev->transfer_status |= status;
 
-		if (length > 0)		/* more data to send? */
-			at91_twi_write(AT91_TWI_THR, *buf++);
-	} while (length);
+	if (pending & AT91_TWI_TXCOMP) {
+		at91_twi_write(&dev->io, AT91_TWI_IDR, AT91_TWI_INT_MASK);
+		complete(&dev->cmd_complete);
+	}
 
-	/* Send Stop */
-	at91_twi_write(AT91_TWI_CR, AT91_TWI_STOP);
+	return IRQ_HANDLED;
+}
+
+static int at91_twi_do_transfer(struct at91_twi_dev *dev)
+{
+	unsigned long	timeout;
+
+	INIT_COMPLETION(dev->cmd_complete);
+	dev->transfer_status = 0;
+
+	if (dev->msg->flags & I2C_M_RD) {
+		unsigned start = AT91_TWI_START;
+
+		/* drop a byte left over from an aborted transfer */
+		if (at91_twi_read(&dev->io, AT91_TWI_SR) & AT91_TWI_RXRDY)
+			at91_twi_read(&dev->io, AT91_TWI_RHR);
+
+		/* a single byte needs Stop along with Start */
+		if (dev->buf_len <= 1)
+			start |= AT91_TWI_STOP;
+		at91_twi_write(&dev->io, AT91_TWI_CR, start);
+		at91_twi_write(&dev->io, AT91_TWI_IER,
+			       AT91_TWI_TXCOMP | AT91_TWI_RXRDY | AT91_TWI_NACK);
+	} else {
+		/* loading the first byte starts the transfer */
+		at91_twi_write_next_byte(dev);
+		at91_twi_write(&dev->io, AT91_TWI_IER,
+			       AT91_TWI_TXCOMP | AT91_TWI_NACK
+			       | (dev->buf_len ? AT91_TWI_TXRDY : 0));
+	}
+
+	timeout = wait_for_completion_timeout(&dev->cmd_complete,
+					      dev->adapter.timeout);
+	if (!timeout) {
+		dev_err(dev->dev, "controller timed out\n");
+		at91_twi_hwinit(dev);
+		return -ETIMEDOUT;
+	}
+	if (dev->transfer_status & AT91_TWI_NACK) {
+		dev_dbg(dev->dev, "received nack\n");
+		return -EREMOTEIO;
+	}
+	if (dev->transfer_status & AT91_TWI_OVRE) {
+		dev_err(dev->dev, "overrun while reading\n");
+		return -EIO;
+	}
+	if (cpu_is_at91rm9200() && (dev->transfer_status & AT91_TWI_UNRE)) {
+		dev_err(dev->dev, "underrun while writing\n");
+		return -EIO;
+	}
 
 	return 0;
 }
 
+/*
+ * A write of up to three bytes followed by a read from the same device
+ * is the usual register access; do it as one transfer, with the written
+ * bytes as "internal device address".  The controller then issues a
+ * repeated Start between both messages.
+ */
+static bool at91_twi_can_combine(struct i2c_msg *msg, int remaining)
+{
+	return remaining >= 2
+		&& !(msg[0].flags & I2C_M_RD) && msg[0].len <= 3
+		&& (msg[1].flags & I2C_M_RD) && msg[1].len
+		&& msg[0].addr == msg[1].addr;
+}
+
 /*
  * Generic i2c master transfer entrypoint.
- *
- * Note: We do not use Atmel's feature of storing the "internal device address".
- * Instead the "internal device address" has to be written using a separate
- * i2c message.
- * http://lists.arm.linux.org.uk/pipermail/linux-arm-kernel/2004-September/024411.html
  */
 static int at91_xfer(struct i2c_adapter *adap, struct i2c_msg *pmsg, int num)
 {
+	struct at91_twi_dev *dev = i2c_get_adapdata(adap);
 	int i, ret;
 
 	dev_dbg(&adap->dev, "at91_xfer: processing %d messages:\n", num);
 
-	for (i = 0; i < num; i++) {
+	for (i = 0; i < num; i++, pmsg++) {
+		unsigned mmr = pmsg->addr << 16;
+
+		if (at91_twi_can_combine(pmsg, num - i)) {
+			unsigned iadr = 0;
+			int j;
+
+			for (j = 0; j < pmsg->len; j++) {
+				iadr = (iadr << 8) | pmsg->buf[j];
+				mmr += AT91_TWI_IADRSZ_1;
+			}
+			at91_twi_write(&dev->io, AT91_TWI_IADR, iadr);
+
+			dev_dbg(&adap->dev, " #%d: %d byte%s to 0x%02x, "
+				"then #%d\n", i, pmsg->len,
+				pmsg->len != 1 ? "s" : "", pmsg->addr, i + 1);
+			i++;
+			pmsg++;
+		}
+
 		dev_dbg(&adap->dev, " #%d: %sing %d byte%s %s 0x%02x\n", i,
 			pmsg->flags & I2C_M_RD ? "read" : "writ",
 			pmsg->len, pmsg->len > 1 ? "s" : "",
 			pmsg->flags & I2C_M_RD ? "from" : "to",	pmsg->addr);
 
-		at91_twi_write(AT91_TWI_MMR, (pmsg->addr << 16)
-			| ((pmsg->flags & I2C_M_RD) ? AT91_TWI_MREAD : 0));
+		if (!pmsg->len || !pmsg->buf)	/* sanity check */
+			continue;
 
-		if (pmsg->len && pmsg->buf) {	/* sanity check */
-			if (pmsg->flags & I2C_M_RD)
-				ret = xfer_read(adap, pmsg->buf, pmsg->len);
-			else
-				ret = xfer_write(adap, pmsg->buf, pmsg->len);
+		if (pmsg->flags & I2C_M_RD)
+			mmr |= AT91_TWI_MREAD;
+		at91_twi_write(&dev->io, AT91_TWI_MMR, mmr);
 
-			if (ret)
-				return ret;
+		dev->msg = pmsg;
+		dev->buf = pmsg->buf;
+		dev->buf_len = pmsg->len;
+
+		ret = at91_twi_do_transfer(dev);
+		if (ret)
+			return ret;
 
-			/* Wait until transfer is finished */
-			if (!at91_poll_status(AT91_TWI_TXCOMP)) {
-				dev_dbg(&adap->dev, "TXCOMP timeout\n");
-				return -ETIMEDOUT;
-			}
-		}
 		dev_dbg(&adap->dev, "transfer complete\n");
-		pmsg++;		/* next message */
 	}
-	return i;
+	return num;
 }
 
 /*
@@ -191,65 +274,84 @@ static struct i2c_algorithm at91_algorithm = {
  */
 static int __devinit at91_i2c_probe(struct platform_device *pdev)
 {
-	struct i2c_adapter *adapter;
+	struct at91_twi_dev *dev;
 	struct resource *res;
+	int irq;
 	int rc;
 
 	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
 	if (!res)
 		return -ENXIO;
 
+	irq = platform_get_irq(pdev, 0);
+	if (irq < 0)
+		return irq;
+
 	if (!request_mem_region(res->start, resource_size(res), "at91_i2c"))
 		return -EBUSY;
 
-	twi_base = ioremap(res->start, resource_size(res));
-	if (!twi_base) {
+	dev = kzalloc(sizeof(struct at91_twi_dev), GFP_KERNEL);
+	if (dev == NULL) {
+		dev_err(&pdev->dev, "can't allocate inteface!\n");
 		rc = -ENOMEM;
 		goto fail0;
 	}
+	dev->dev = &pdev->dev;
+	dev->irq = irq;
+	init_completion(&dev->cmd_complete);
 
-	twi_clk = clk_get(NULL, "twi_clk");
-	if (IS_ERR(twi_clk)) {
-		dev_err(&pdev->dev, "no clock defined\n");
-		rc = -ENODEV;
+	dev->io.base = ioremap(res->start, resource_size(res));
+	if (!dev->io.base) {
+		rc = -ENOMEM;
 		goto fail1;
 	}
 
-	adapter = kzalloc(sizeof(struct i2c_adapter), GFP_KERNEL);
-	if (adapter == NULL) {
-		dev_err(&pdev->dev, "can't allocate inteface!\n");
-		rc = -ENOMEM;
+	dev->clk = clk_get(&pdev->dev, "twi_clk");
+	if (IS_ERR(dev->clk)) {
+		dev_err(&pdev->dev, "no clock defined\n");
+		rc = -ENODEV;
 		goto fail2;
 	}
-	snprintf(adapter->name, sizeof(adapter->name), "AT91");
-	adapter->algo = &at91_algorithm;
-	adapter->class = I2C_CLASS_HWMON;
-	adapter->dev.parent = &pdev->dev;
-	/* adapter->id == 0 ... only one TWI controller for now */
 
-	platform_set_drvdata(pdev, adapter);
+	snprintf(dev->adapter.name, sizeof(dev->adapter.name), "AT91");
+	dev->adapter.algo = &at91_algorithm;
+	dev->adapter.class = I2C_CLASS_HWMON;
+	dev->adapter.dev.parent = &pdev->dev;
+	dev->adapter.nr = pdev->id < 0 ? 0 : pdev->id;
+	dev->adapter.timeout = HZ;
+	i2c_set_adapdata(&dev->adapter, dev);
 
-	clk_enable(twi_clk);		/* enable peripheral clock */
-	at91_twi_hwinit();		/* initialize TWI controller */
+	platform_set_drvdata(pdev, dev);
 
-	rc = i2c_add_numbered_adapter(adapter);
+	clk_enable(dev->clk);		/* enable peripheral clock */
+	at91_twi_hwinit(dev);		/* initialize TWI controller */
+
+	rc = request_irq(irq, at91_twi_interrupt, 0, dev_name(&pdev->dev), dev);
 	if (rc) {
-		dev_err(&pdev->dev, "Adapter %s registration failed\n",
-				adapter->name);
+		dev_err(&pdev->dev, "Cannot get irq %d: %d\n", irq, rc);
 		goto fail3;
 	}
 
+	rc = i2c_add_numbered_adapter(&dev->adapter);
+	if (rc) {
+		dev_err(&pdev->dev, "Adapter %s registration failed\n",
+				dev->adapter.name);
+		goto fail4;
+	}
+
 	dev_info(&pdev->dev, "AT91 i2c bus driver.\n");
 	return 0;
 
+fail4:
+	free_irq(irq, dev);
 fail3:
 	platform_set_drvdata(pdev, NULL);
-	kfree(adapter);
-	clk_disable(twi_clk);
+	clk_disable(dev->clk);
+	clk_put(dev->clk);
 fail2:
-	clk_put(twi_clk);
+	iounmap(dev->io.base);
 fail1:
-	iounmap(twi_base);
+	kfree(dev);
 fail0:
 	release_mem_region(res->start, resource_size(res));
 
@@ -258,19 +360,23 @@ fail0:
 
 static int __devexit at91_i2c_remove(struct platform_device *pdev)
 {
-	struct i2c_adapter *adapter = platform_get_drvdata(pdev);
+	struct at91_twi_dev *dev = platform_get_drvdata(pdev);
 	struct resource *res;
 	int rc;
 
-	rc = i2c_del_adapter(adapter);
+	rc = i2c_del_adapter(&dev->adapter);
 	platform_set_drvdata(pdev, NULL);
 
+	at91_twi_write(&dev->io, AT91_TWI_IDR, 0xffffffff);
+	free_irq(dev->irq, dev);
+
 	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
-	iounmap(twi_base);
+	iounmap(dev->io.base);
 	release_mem_region(res->start, resource_size(res));
 
-	clk_disable(twi_clk);		/* disable peripheral clock */
-	clk_put(twi_clk);
+	clk_disable(dev->clk);		/* disable peripheral clock */
+	clk_put(dev->clk);
+	kfree(dev);
 
 	return rc;
 }
@@ -281,13 +387,17 @@ static int __devexit at91_i2c_remove(struct platform_device *pdev)
 
 static int at91_i2c_suspend(struct platform_device *pdev, pm_message_t mesg)
 {
-	clk_disable(twi_clk);
+	struct at91_twi_dev *dev = platform_get_drvdata(pdev);
+
+	clk_disable(dev->clk);
 	return 0;
 }
 
 static int at91_i2c_resume(struct platform_device *pdev)
 {
-	return clk_enable(twi_clk);
+	struct at91_twi_dev *dev = platform_get_drvdata(pdev);
+
+	return clk_enable(dev->clk);
 }
 
 #else
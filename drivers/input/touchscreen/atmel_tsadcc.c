@@ -22,6 +22,14 @@
 #include <linux/clk.h>
 #include <linux/platform_device.h>
 #include <linux/io.h>
+#include <linux/delay.h>
+#include <linux/dma-mapping.h>
+#include <linux/miscdevice.h>
+#include <linux/kfifo.h>
+#include <linux/poll.h>
+#include <linux/fs.h>
+#include <linux/uaccess.h>
+#include <linux/atmel_pdc.h>
 #include <mach/board.h>
 #include <mach/cpu.h>
 
@@ -95,7 +103,27 @@
 #define PRESCALER_VAL(x)	((x) >> 8)
 
 #define ADC_DEFAULT_CLOCK	100000
+#define ADC_DEFAULT_BATCH	8
+#define ADC_DEFAULT_RATE	1000
 
+/* Touch screen only mode converts channels 0-3 on each trigger */
+#define TS_CHANNELS		4
+/* Touch report period, in ADC clocks, split over the sequences of a batch */
+#define TS_PERIOD		0x1000
+
+/* Upper bound of one conversion in ADC clocks, sample and hold included */
+#define CONV_CLOCKS		32
+
+/* ADC stream mode: buffers worth of samples the read fifo can hold */
+#define ADC_FIFO_BUFFERS	16
+
+/*
+ * Conversions are triggered by the controller's own timer and the PDC
+ * moves the converted data into one of two buffers of 'batch' sequences
+ * each, so we only take an interrupt once per buffer instead of once
+ * per conversion.  In touch mode the buffer is filtered into a single
+ * report; in ADC mode it's queued for readers of the misc device.
+ */
 struct atmel_tsadcc {
 	struct input_dev	*input;
 	char			phys[32];
@@ -104,6 +132,21 @@ struct atmel_tsadcc {
 	unsigned int		prev_absx;
 	unsigned int		prev_absy;
 	unsigned char		bufferedmeasure;
+
+	u16			*buf;
+	dma_addr_t		buf_phys;
+	unsigned int		nchannels;	/* samples per sequence */
+	unsigned int		nsamples;	/* samples per buffer */
+	unsigned int		cur;		/* buffer the PDC is filling */
+	unsigned int		trgper;
+	unsigned int		seq_usecs;	/* upper bound of one sequence */
+
+	/* ADC stream mode */
+	struct miscdevice	miscdev;
+	DECLARE_KFIFO_PTR(fifo, u16);
+	wait_queue_head_t	wait;
+	unsigned long		in_use;
+	unsigned long		overruns;
 };
 
 static void __iomem		*tsc_base;
@@ -111,6 +154,170 @@ static void __iomem		*tsc_base;
 #define atmel_tsadcc_read(reg)		__raw_readl(tsc_base + (reg))
 #define atmel_tsadcc_write(reg, val)	__raw_writel((val), tsc_base + (reg))
 
+static inline dma_addr_t atmel_tsadcc_buf_phys(struct atmel_tsadcc *ts_dev,
+					       unsigned int idx)
+{
+	return ts_dev->buf_phys + idx * ts_dev->nsamples * sizeof(u16);
+}
+
+static void atmel_tsadcc_pdc_start(struct atmel_tsadcc *ts_dev)
+{
+	ts_dev->cur = 0;
+	atmel_tsadcc_write(ATMEL_PDC_PTCR, ATMEL_PDC_RXTDIS);
+	atmel_tsadcc_write(ATMEL_PDC_RPR, atmel_tsadcc_buf_phys(ts_dev, 0));
+	atmel_tsadcc_write(ATMEL_PDC_RCR, ts_dev->nsamples);
+	atmel_tsadcc_write(ATMEL_PDC_RNPR, atmel_tsadcc_buf_phys(ts_dev, 1));
+	atmel_tsadcc_write(ATMEL_PDC_RNCR, ts_dev->nsamples);
+	atmel_tsadcc_write(ATMEL_PDC_PTCR, ATMEL_PDC_RXTEN);
+}
+
+static void atmel_tsadcc_pdc_stop(void)
+{
+	atmel_tsadcc_write(ATMEL_PDC_PTCR, ATMEL_PDC_RXTDIS);
+}
+
+/*
+ * Restart the PDC after both buffers overflowed.  The samples carry no
+ * channel number, so the new buffers have to begin with a sequence:
+ * hold the trigger, let a sequence in flight finish, drop its data and
+ * only then restart the PDC and the trigger.  Overruns are rare, so
+ * busy-waiting one sequence here is fine.
+ */
+static void atmel_tsadcc_pdc_resync(struct atmel_tsadcc *ts_dev)
+{
+	atmel_tsadcc_write(ATMEL_TSADCC_TRGR, ATMEL_TSADCC_TRGMOD_NONE);
+	atmel_tsadcc_pdc_stop();
+	udelay(ts_dev->seq_usecs);
+	atmel_tsadcc_read(ATMEL_TSADCC_LCDR);
+
+	atmel_tsadcc_pdc_start(ts_dev);
+	atmel_tsadcc_write(ATMEL_TSADCC_TRGR,
+			   ATMEL_TSADCC_TRGMOD_PERIOD | (ts_dev->trgper << 16));
+}
+
+/*
+ * The PDC has filled the current buffer and moved on to the other one.
+ * Return the filled one, and hand it back to the PDC as the next buffer
+ * once the caller is done with it.
+ */
+static u16 *atmel_tsadcc_pdc_filled(struct atmel_tsadcc *ts_dev)
+{
+	return ts_dev->buf + ts_dev->cur * ts_dev->nsamples;
+}
+
+static void atmel_tsadcc_pdc_requeue(struct atmel_tsadcc *ts_dev)
+{
+	atmel_tsadcc_write(ATMEL_PDC_RNPR,
+			   atmel_tsadcc_buf_phys(ts_dev, ts_dev->cur));
+	atmel_tsadcc_write(ATMEL_PDC_RNCR, ts_dev->nsamples);
+	ts_dev->cur ^= 1;
+}
+
+/*
+ * Average the positions of a batch of touch sequences, dropping the
+ * smallest and largest of each coordinate to get rid of the spikes a
+ * resistive panel produces while the pen settles or lifts.
+ */
+static int atmel_tsadcc_filter(struct atmel_tsadcc *ts_dev, const u16 *data,
+			       unsigned int *absx, unsigned int *absy)
+{
+	unsigned int x, y, sumx = 0, sumy = 0;
+	unsigned int minx = ~0, miny = ~0, maxx = 0, maxy = 0;
+	unsigned int i, n = 0;
+
+	for (i = 0; i < ts_dev->nsamples; i += TS_CHANNELS) {
+		const u16 *seq = data + i;
+		unsigned int xpos = seq[3] & ATMEL_TSADCC_DATA;
+		unsigned int xscale = seq[2] & ATMEL_TSADCC_DATA;
+		unsigned int ypos = seq[1] & ATMEL_TSADCC_DATA;
+		unsigned int yscale = seq[0] & ATMEL_TSADCC_DATA;
+
+		if (!xscale || !yscale)
+			continue;
+
+		x = (xpos << 10) / xscale;
+		y = (ypos << 10) / yscale;
+
+		sumx += x;
+		sumy += y;
+		minx = min(minx, x);
+		maxx = max(maxx, x);
+		miny = min(miny, y);
+		maxy = max(maxy, y);
+		n++;
+	}
+
+	if (!n)
+		return -EINVAL;
+
+	if (n > 2) {
+		sumx -= minx + maxx;
+		sumy -= miny + maxy;
+		n -= 2;
+	}
+
+	*absx = sumx / n;
+	*absy = sumy / n;
+	return 0;
+}
+
+static void atmel_tsadcc_ts_batch(struct atmel_tsadcc *ts_dev)
+{
+	struct input_dev	*input_dev = ts_dev->input;
+	unsigned int		absx, absy;
+	int			err;
+
+	err = atmel_tsadcc_filter(ts_dev, atmel_tsadcc_pdc_filled(ts_dev),
+				  &absx, &absy);
+	atmel_tsadcc_pdc_requeue(ts_dev);
+	if (err)
+		return;
+
+	if (ts_dev->bufferedmeasure) {
+		/* Last batch is always discarded, since it can
+		 * be erroneous.
+		 * Always report previous batch */
+		input_report_abs(input_dev, ABS_X, ts_dev->prev_absx);
+		input_report_abs(input_dev, ABS_Y, ts_dev->prev_absy);
+		input_report_key(input_dev, BTN_TOUCH, 1);
+		input_sync(input_dev);
+	} else
+		ts_dev->bufferedmeasure = 1;
+
+	ts_dev->prev_absx = absx;
+	ts_dev->prev_absy = absy;
+}
+
+static void atmel_tsadcc_adc_batch(struct atmel_tsadcc *ts_dev)
+{
+	if (kfifo_avail(&ts_dev->fifo) >= ts_dev->nsamples)
+		kfifo_in(&ts_dev->fifo, atmel_tsadcc_pdc_filled(ts_dev),
+			 ts_dev->nsamples);
+	else
+		ts_dev->overruns++;
+	atmel_tsadcc_pdc_requeue(ts_dev);
+
+	wake_up_interruptible(&ts_dev->wait);
+}
+
+static irqreturn_t atmel_tsadcc_adc_interrupt(int irq, void *dev)
+{
+	struct atmel_tsadcc	*ts_dev = (struct atmel_tsadcc *)dev;
+	unsigned int status;
+
+	status = atmel_tsadcc_read(ATMEL_TSADCC_SR);
+	status &= atmel_tsadcc_read(ATMEL_TSADCC_IMR);
+
+	if (status & ATMEL_TSADCC_RXBUFF) {
+		/* Both buffers filled before we got here; start over */
+		ts_dev->overruns++;
+		atmel_tsadcc_pdc_resync(ts_dev);
+	} else if (status & ATMEL_TSADCC_ENDRX)
+		atmel_tsadcc_adc_batch(ts_dev);
+
+	return IRQ_HANDLED;
+}
+
 static irqreturn_t atmel_tsadcc_interrupt(int irq, void *dev)
 {
 	struct atmel_tsadcc	*ts_dev = (struct atmel_tsadcc *)dev;
@@ -128,8 +335,10 @@ static irqreturn_t atmel_tsadcc_interrupt(int irq, void *dev)
 
 		atmel_tsadcc_write(ATMEL_TSADCC_MR, reg);
 		atmel_tsadcc_write(ATMEL_TSADCC_TRGR, ATMEL_TSADCC_TRGMOD_NONE);
+		atmel_tsadcc_pdc_stop();
 		atmel_tsadcc_write(ATMEL_TSADCC_IDR,
-				   ATMEL_TSADCC_EOC(3) | ATMEL_TSADCC_NOCNT);
+				   ATMEL_TSADCC_ENDRX | ATMEL_TSADCC_RXBUFF |
+				   ATMEL_TSADCC_NOCNT);
 		atmel_tsadcc_write(ATMEL_TSADCC_IER, ATMEL_TSADCC_PENCNT);
 
 		input_report_key(input_dev, BTN_TOUCH, 0);
@@ -143,36 +352,247 @@ static irqreturn_t atmel_tsadcc_interrupt(int irq, void *dev)
 
 		atmel_tsadcc_write(ATMEL_TSADCC_IDR, ATMEL_TSADCC_PENCNT);
 		atmel_tsadcc_write(ATMEL_TSADCC_MR, reg);
+		atmel_tsadcc_pdc_start(ts_dev);
 		atmel_tsadcc_write(ATMEL_TSADCC_IER,
-				   ATMEL_TSADCC_EOC(3) | ATMEL_TSADCC_NOCNT);
+				   ATMEL_TSADCC_ENDRX | ATMEL_TSADCC_RXBUFF |
+				   ATMEL_TSADCC_NOCNT);
 		atmel_tsadcc_write(ATMEL_TSADCC_TRGR,
-				   ATMEL_TSADCC_TRGMOD_PERIOD | (0x0FFF << 16));
-
-	} else if (status & ATMEL_TSADCC_EOC(3)) {
-		/* Conversion finished */
-
-		if (ts_dev->bufferedmeasure) {
-			/* Last measurement is always discarded, since it can
-			 * be erroneous.
-			 * Always report previous measurement */
-			input_report_abs(input_dev, ABS_X, ts_dev->prev_absx);
-			input_report_abs(input_dev, ABS_Y, ts_dev->prev_absy);
-			input_report_key(input_dev, BTN_TOUCH, 1);
-			input_sync(input_dev);
-		} else
-			ts_dev->bufferedmeasure = 1;
-
-		/* Now make new measurement */
-		ts_dev->prev_absx = atmel_tsadcc_read(ATMEL_TSADCC_CDR3) << 10;
-		ts_dev->prev_absx /= atmel_tsadcc_read(ATMEL_TSADCC_CDR2);
-
-		ts_dev->prev_absy = atmel_tsadcc_read(ATMEL_TSADCC_CDR1) << 10;
-		ts_dev->prev_absy /= atmel_tsadcc_read(ATMEL_TSADCC_CDR0);
+				   ATMEL_TSADCC_TRGMOD_PERIOD |
+				   (ts_dev->trgper << 16));
+
+	} else if (status & ATMEL_TSADCC_RXBUFF) {
+		/* Both buffers filled before we got here; start over */
+		atmel_tsadcc_pdc_resync(ts_dev);
+
+	} else if (status & ATMEL_TSADCC_ENDRX) {
+		/* Batch of conversions finished */
+		atmel_tsadcc_ts_batch(ts_dev);
 	}
 
 	return IRQ_HANDLED;
 }
 
+/*
+ * ADC stream mode: the enabled channels are converted at adc_rate and
+ * read() returns the samples as native-endian u16 values, one sequence
+ * after the other, each in increasing channel order.
+ */
+
+static int atmel_tsadcc_adc_open(struct inode *inode, struct file *file)
+{
+	struct atmel_tsadcc *ts_dev = container_of(file->private_data,
+					struct atmel_tsadcc, miscdev);
+
+	if (test_and_set_bit(0, &ts_dev->in_use))
+		return -EBUSY;
+
+	kfifo_reset(&ts_dev->fifo);
+	ts_dev->overruns = 0;
+
+	atmel_tsadcc_pdc_start(ts_dev);
+	atmel_tsadcc_write(ATMEL_TSADCC_IER,
+			   ATMEL_TSADCC_ENDRX | ATMEL_TSADCC_RXBUFF);
+	atmel_tsadcc_write(ATMEL_TSADCC_TRGR,
+			   ATMEL_TSADCC_TRGMOD_PERIOD | (ts_dev->trgper << 16));
+
+	return nonseekable_open(inode, file);
+}
+
+static int atmel_tsadcc_adc_release(struct inode *inode, struct file *file)
+{
+	struct atmel_tsadcc *ts_dev = container_of(file->private_data,
+					struct atmel_tsadcc, miscdev);
+
+	atmel_tsadcc_write(ATMEL_TSADCC_TRGR, ATMEL_TSADCC_TRGMOD_NONE);
+	atmel_tsadcc_write(ATMEL_TSADCC_IDR,
+			   ATMEL_TSADCC_ENDRX | ATMEL_TSADCC_RXBUFF);
+	atmel_tsadcc_pdc_stop();
+
+	if (ts_dev->overruns)
+		dev_dbg(ts_dev->miscdev.parent, "%lu batches lost\n",
+			ts_dev->overruns);
+
+	clear_bit(0, &ts_dev->in_use);
+	return 0;
+}
+
+static ssize_t atmel_tsadcc_adc_read(struct file *file, char __user *buf,
+				     size_t count, loff_t *ppos)
+{
+	struct atmel_tsadcc *ts_dev = container_of(file->private_data,
+					struct atmel_tsadcc, miscdev);
+	unsigned int copied;
+	int ret;
+
+	if (count < sizeof(u16))
+		return -EINVAL;
+
+	while (kfifo_is_empty(&ts_dev->fifo)) {
+		if (file->f_flags & O_NONBLOCK)
+			return -EAGAIN;
+
+		ret = wait_event_interruptible(ts_dev->wait,
+					!kfifo_is_empty(&ts_dev->fifo));
+		if (ret)
+			return ret;
+	}
+
+	ret = kfifo_to_user(&ts_dev->fifo, buf, count, &copied);
+
+	return ret ? ret : copied;
+}
+
+static unsigned int atmel_tsadcc_adc_poll(struct file *file, poll_table *wait)
+{
+	struct atmel_tsadcc *ts_dev = container_of(file->private_data,
+					struct atmel_tsadcc, miscdev);
+
+	poll_wait(file, &ts_dev->wait, wait);
+
+	if (!kfifo_is_empty(&ts_dev->fifo))
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+static const struct file_operations atmel_tsadcc_adc_fops = {
+	.owner		= THIS_MODULE,
+	.open		= atmel_tsadcc_adc_open,
+	.release	= atmel_tsadcc_adc_release,
+	.read		= atmel_tsadcc_adc_read,
+	.poll		= atmel_tsadcc_adc_poll,
+	.llseek		= no_llseek,
+};
+
+static int __devinit atmel_tsadcc_adc_probe(struct platform_device *pdev,
+		struct atmel_tsadcc *ts_dev, struct at91_tsadcc_data *pdata,
+		unsigned int prsc, unsigned int adc_clock)
+{
+	unsigned int	rate = pdata->adc_rate ? : ADC_DEFAULT_RATE;
+	unsigned int	trgper;
+	unsigned int	reg;
+	int		err;
+
+	err = kfifo_alloc(&ts_dev->fifo, ts_dev->nsamples * ADC_FIFO_BUFFERS,
+			  GFP_KERNEL);
+	if (err) {
+		dev_err(&pdev->dev, "failed to allocate fifo.\n");
+		return err;
+	}
+	init_waitqueue_head(&ts_dev->wait);
+
+	/* Trigger period = (TRGPER + 1) ADC clocks */
+	trgper = adc_clock / rate;
+	trgper = clamp(trgper, 1U, 0x10000U) - 1;
+	ts_dev->trgper = trgper;
+	dev_info(&pdev->dev, "Streaming channels 0x%02x at %u Hz\n",
+		 pdata->adc_channels, adc_clock / (trgper + 1));
+
+	reg = ATMEL_TSADCC_TSAMOD_ADC_ONLY_MODE		|
+		(prsc << 8)				|
+		((0x26 << 16) & ATMEL_TSADCC_STARTUP)	|
+		((pdata->ts_sample_hold_time << 24) & ATMEL_TSADCC_SHTIM);
+
+	atmel_tsadcc_write(ATMEL_TSADCC_MR, reg);
+	atmel_tsadcc_write(ATMEL_TSADCC_TRGR, ATMEL_TSADCC_TRGMOD_NONE);
+	atmel_tsadcc_write(ATMEL_TSADCC_CHER, pdata->adc_channels);
+	atmel_tsadcc_read(ATMEL_TSADCC_SR);
+
+	err = request_irq(ts_dev->irq, atmel_tsadcc_adc_interrupt, 0,
+			pdev->dev.driver->name, ts_dev);
+	if (err) {
+		dev_err(&pdev->dev, "failed to allocate irq.\n");
+		goto err_free_fifo;
+	}
+
+	ts_dev->miscdev.minor = MISC_DYNAMIC_MINOR;
+	ts_dev->miscdev.name = "tsadcc_adc";
+	ts_dev->miscdev.fops = &atmel_tsadcc_adc_fops;
+	ts_dev->miscdev.parent = &pdev->dev;
+
+	err = misc_register(&ts_dev->miscdev);
+	if (err)
+		goto err_free_irq;
+
+	return 0;
+
+err_free_irq:
+	free_irq(ts_dev->irq, ts_dev);
+err_free_fifo:
+	kfifo_free(&ts_dev->fifo);
+	return err;
+}
+
+static int __devinit atmel_tsadcc_ts_probe(struct platform_device *pdev,
+		struct atmel_tsadcc *ts_dev, struct at91_tsadcc_data *pdata,
+		unsigned int prsc, unsigned int batch)
+{
+	struct input_dev	*input_dev;
+	unsigned int		reg;
+	int			err;
+
+	input_dev = input_allocate_device();
+	if (!input_dev) {
+		dev_err(&pdev->dev, "failed to allocate input device.\n");
+		return -EBUSY;
+	}
+
+	ts_dev->input = input_dev;
+	ts_dev->bufferedmeasure = 0;
+
+	/* Keep the report rate of one sequence every TS_PERIOD clocks */
+	ts_dev->trgper = max(TS_PERIOD / batch, 2U) - 1;
+
+	snprintf(ts_dev->phys, sizeof(ts_dev->phys),
+		 "%s/input0", dev_name(&pdev->dev));
+
+	input_dev->name = "atmel touch screen controller";
+	input_dev->phys = ts_dev->phys;
+	input_dev->dev.parent = &pdev->dev;
+
+	__set_bit(EV_ABS, input_dev->evbit);
+	input_set_abs_params(input_dev, ABS_X, 0, 0x3FF, 0, 0);
+	input_set_abs_params(input_dev, ABS_Y, 0, 0x3FF, 0, 0);
+
+	input_set_capability(input_dev, EV_KEY, BTN_TOUCH);
+
+	reg = ATMEL_TSADCC_TSAMOD_TS_ONLY_MODE		|
+		((0x00 << 5) & ATMEL_TSADCC_SLEEP)	|	/* Normal Mode */
+		((0x01 << 6) & ATMEL_TSADCC_PENDET)	|	/* Enable Pen Detect */
+		(prsc << 8)				|
+		((0x26 << 16) & ATMEL_TSADCC_STARTUP)	|
+		((pdata->pendet_debounce << 28) & ATMEL_TSADCC_PENDBC);
+
+	atmel_tsadcc_write(ATMEL_TSADCC_MR, reg);
+	atmel_tsadcc_write(ATMEL_TSADCC_TRGR, ATMEL_TSADCC_TRGMOD_NONE);
+	atmel_tsadcc_write(ATMEL_TSADCC_TSR,
+		(pdata->ts_sample_hold_time << 24) & ATMEL_TSADCC_TSSHTIM);
+
+	err = request_irq(ts_dev->irq, atmel_tsadcc_interrupt, 0,
+			pdev->dev.driver->name, ts_dev);
+	if (err) {
+		dev_err(&pdev->dev, "failed to allocate irq.\n");
+		goto err_free_dev;
+	}
+
+	atmel_tsadcc_read(ATMEL_TSADCC_SR);
+	atmel_tsadcc_write(ATMEL_TSADCC_IER, ATMEL_TSADCC_PENCNT);
+
+	/* All went ok, so register to the input system */
+	err = input_register_device(input_dev);
+	if (err)
+		goto err_free_irq;
+
+	return 0;
+
+err_free_irq:
+	atmel_tsadcc_write(ATMEL_TSADCC_IDR, ATMEL_TSADCC_PENCNT);
+	free_irq(ts_dev->irq, ts_dev);
+err_free_dev:
+	input_free_device(input_dev);
+	ts_dev->input = NULL;
+	return err;
+}
+
 /*
  * The functions for inserting/removing us as a module.
  */
@@ -180,12 +600,12 @@ static irqreturn_t atmel_tsadcc_interrupt(int irq, void *dev)
 static int __devinit atmel_tsadcc_probe(struct platform_device *pdev)
 {
 	struct atmel_tsadcc	*ts_dev;
-	struct input_dev	*input_dev;
 	struct resource		*res;
 	struct at91_tsadcc_data *pdata = pdev->dev.platform_data;
 	int		err = 0;
 	unsigned int	prsc;
-	unsigned int	reg;
+	unsigned int	adc_clock;
+	unsigned int	batch;
 
 	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
 	if (!res) {
@@ -193,6 +613,11 @@ static int __devinit atmel_tsadcc_probe(struct platform_device *pdev)
 		return -ENXIO;
 	}
 
+	if (!pdata) {
+		dev_err(&pdev->dev, "no platform data.\n");
+		return -EINVAL;
+	}
+
 	/* Allocate memory for device */
 	ts_dev = kzalloc(sizeof(struct atmel_tsadcc), GFP_KERNEL);
 	if (!ts_dev) {
@@ -201,25 +626,18 @@ static int __devinit atmel_tsadcc_probe(struct platform_device *pdev)
 	}
 	platform_set_drvdata(pdev, ts_dev);
 
-	input_dev = input_allocate_device();
-	if (!input_dev) {
-		dev_err(&pdev->dev, "failed to allocate input device.\n");
-		err = -EBUSY;
-		goto err_free_mem;
-	}
-
 	ts_dev->irq = platform_get_irq(pdev, 0);
 	if (ts_dev->irq < 0) {
 		dev_err(&pdev->dev, "no irq ID is designated.\n");
 		err = -ENODEV;
-		goto err_free_dev;
+		goto err_free_mem;
 	}
 
 	if (!request_mem_region(res->start, resource_size(res),
 				"atmel tsadcc regs")) {
 		dev_err(&pdev->dev, "resources is unavailable.\n");
 		err = -EBUSY;
-		goto err_free_dev;
+		goto err_free_mem;
 	}
 
 	tsc_base = ioremap(res->start, resource_size(res));
@@ -229,35 +647,29 @@ static int __devinit atmel_tsadcc_probe(struct platform_device *pdev)
 		goto err_release_mem;
 	}
 
-	err = request_irq(ts_dev->irq, atmel_tsadcc_interrupt, 0,
-			pdev->dev.driver->name, ts_dev);
-	if (err) {
-		dev_err(&pdev->dev, "failed to allocate irq.\n");
-		goto err_unmap_regs;
-	}
-
 	ts_dev->clk = clk_get(&pdev->dev, "tsc_clk");
 	if (IS_ERR(ts_dev->clk)) {
 		dev_err(&pdev->dev, "failed to get ts_clk\n");
 		err = PTR_ERR(ts_dev->clk);
-		goto err_free_irq;
+		goto err_unmap_regs;
 	}
 
-	ts_dev->input = input_dev;
-	ts_dev->bufferedmeasure = 0;
-
-	snprintf(ts_dev->phys, sizeof(ts_dev->phys),
-		 "%s/input0", dev_name(&pdev->dev));
-
-	input_dev->name = "atmel touch screen controller";
-	input_dev->phys = ts_dev->phys;
-	input_dev->dev.parent = &pdev->dev;
-
-	__set_bit(EV_ABS, input_dev->evbit);
-	input_set_abs_params(input_dev, ABS_X, 0, 0x3FF, 0, 0);
-	input_set_abs_params(input_dev, ABS_Y, 0, 0x3FF, 0, 0);
-
-	input_set_capability(input_dev, EV_KEY, BTN_TOUCH);
+	batch = pdata->batch ? : ADC_DEFAULT_BATCH;
+	if (pdata->adc_channels)
+		ts_dev->nchannels = hweight8(pdata->adc_channels);
+	else
+		ts_dev->nchannels = TS_CHANNELS;
+	ts_dev->nsamples = batch * ts_dev->nchannels;
+
+	/* Two buffers for the PDC to alternate between */
+	ts_dev->buf = dma_alloc_coherent(&pdev->dev,
+			2 * ts_dev->nsamples * sizeof(u16),
+			&ts_dev->buf_phys, GFP_KERNEL);
+	if (!ts_dev->buf) {
+		dev_err(&pdev->dev, "failed to allocate sample buffers.\n");
+		err = -ENOMEM;
+		goto err_put_clk;
+	}
 
 	/* clk_enable() always returns 0, no need to check it */
 	clk_enable(ts_dev->clk);
@@ -265,9 +677,6 @@ static int __devinit atmel_tsadcc_probe(struct platform_device *pdev)
 	prsc = clk_get_rate(ts_dev->clk);
 	dev_info(&pdev->dev, "Master clock is set at: %d Hz\n", prsc);
 
-	if (!pdata)
-		goto err_fail;
-
 	if (!pdata->adc_clock)
 		pdata->adc_clock = ADC_DEFAULT_CLOCK;
 
@@ -284,24 +693,17 @@ static int __devinit atmel_tsadcc_probe(struct platform_device *pdev)
 
 	dev_info(&pdev->dev, "Prescaler is set at: %d\n", prsc);
 
-	reg = ATMEL_TSADCC_TSAMOD_TS_ONLY_MODE		|
-		((0x00 << 5) & ATMEL_TSADCC_SLEEP)	|	/* Normal Mode */
-		((0x01 << 6) & ATMEL_TSADCC_PENDET)	|	/* Enable Pen Detect */
-		(prsc << 8)				|
-		((0x26 << 16) & ATMEL_TSADCC_STARTUP)	|
-		((pdata->pendet_debounce << 28) & ATMEL_TSADCC_PENDBC);
-
 	atmel_tsadcc_write(ATMEL_TSADCC_CR, ATMEL_TSADCC_SWRST);
-	atmel_tsadcc_write(ATMEL_TSADCC_MR, reg);
-	atmel_tsadcc_write(ATMEL_TSADCC_TRGR, ATMEL_TSADCC_TRGMOD_NONE);
-	atmel_tsadcc_write(ATMEL_TSADCC_TSR,
-		(pdata->ts_sample_hold_time << 24) & ATMEL_TSADCC_TSSHTIM);
 
-	atmel_tsadcc_read(ATMEL_TSADCC_SR);
-	atmel_tsadcc_write(ATMEL_TSADCC_IER, ATMEL_TSADCC_PENCNT);
+	adc_clock = clk_get_rate(ts_dev->clk) / ((prsc + 1) * 2);
+	ts_dev->seq_usecs = DIV_ROUND_UP(ts_dev->nchannels * CONV_CLOCKS *
+					 USEC_PER_SEC, adc_clock);
 
-	/* All went ok, so register to the input system */
-	err = input_register_device(input_dev);
+	if (pdata->adc_channels)
+		err = atmel_tsadcc_adc_probe(pdev, ts_dev, pdata, prsc,
+					     adc_clock);
+	else
+		err = atmel_tsadcc_ts_probe(pdev, ts_dev, pdata, prsc, batch);
 	if (err)
 		goto err_fail;
 
@@ -309,15 +711,14 @@ static int __devinit atmel_tsadcc_probe(struct platform_device *pdev)
 
 err_fail:
 	clk_disable(ts_dev->clk);
+	dma_free_coherent(&pdev->dev, 2 * ts_dev->nsamples * sizeof(u16),
+			  ts_dev->buf, ts_dev->buf_phys);
+err_put_clk:
 	clk_put(ts_dev->clk);
-err_free_irq:
-	free_irq(ts_dev->irq, ts_dev);
 err_unmap_regs:
 	iounmap(tsc_base);
 err_release_mem:
 	release_mem_region(res->start, resource_size(res));
-err_free_dev:
-	input_free_device(input_dev);
 err_free_mem:
 	kfree(ts_dev);
 	return err;
@@ -328,9 +729,19 @@ static int __devexit atmel_tsadcc_remove(struct platform_device *pdev)
 	struct atmel_tsadcc *ts_dev = dev_get_drvdata(&pdev->dev);
 	struct resource *res;
 
-	free_irq(ts_dev->irq, ts_dev);
+	if (ts_dev->input) {
+		free_irq(ts_dev->irq, ts_dev);
+		input_unregister_device(ts_dev->input);
+	} else {
+		misc_deregister(&ts_dev->miscdev);
+		free_irq(ts_dev->irq, ts_dev);
+		kfifo_free(&ts_dev->fifo);
+	}
 
-	input_unregister_device(ts_dev->input);
+	atmel_tsadcc_write(ATMEL_TSADCC_TRGR, ATMEL_TSADCC_TRGMOD_NONE);
+	atmel_tsadcc_pdc_stop();
+	dma_free_coherent(&pdev->dev, 2 * ts_dev->nsamples * sizeof(u16),
+			  ts_dev->buf, ts_dev->buf_phys);
 
 	res = platform_get_resource(pdev, IORESOURCE_MEM, 0);
 	iounmap(tsc_base);
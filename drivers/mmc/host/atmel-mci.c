@@ -83,6 +83,21 @@ struct atmel_mci_dma {
 	struct dma_async_tx_descriptor	*data_desc;
 };
 
+/**
+ * struct atmel_mci_next_data - data prepared ahead of its request
+ * @sg_len: Number of entries dma_map_sg() returned for the data.
+ * @cookie: Matched against mmc_data.host_cookie to find out whether
+ *	the data of a starting request is the one prepared here.
+ *
+ * Only the mapping, i.e. the cache maintenance, is done ahead of time.
+ * The DMA descriptor is cheap to prepare and cannot be given back to
+ * the DMA engine unused, so it is prepared when the request starts.
+ */
+struct atmel_mci_next_data {
+	int				sg_len;
+	s32				cookie;
+};
+
 /**
  * struct atmel_mci - MMC controller state shared between all slots
  * @lock: Spinlock protecting the queue and associated data.
@@ -220,6 +235,8 @@ struct atmel_mci {
  *	if not available.
  * @detect_is_active_high: The state of the detect pin when it is active.
  * @detect_timer: Timer used for debouncing @detect_pin interrupts.
+ * @next_data: Mapping set up by pre_req() for the next request on
+ *	this slot.
  */
 struct atmel_mci_slot {
 	struct mmc_host		*mmc;
@@ -243,6 +260,8 @@ struct atmel_mci_slot {
 	bool			detect_is_active_high;
 
 	struct timer_list	detect_timer;
+
+	struct atmel_mci_next_data next_data;
 };
 
 #define atmci_test_and_clear_pending(host, event)		\
@@ -646,7 +665,8 @@ static void atmci_pdc_cleanup(struct atmel_mci *host)
 {
 	struct mmc_data         *data = host->data;
 
-	if (data)
+	/* buffers mapped by pre_req() are unmapped by post_req() */
+	if (data && !data->host_cookie)
 		dma_unmap_sg(&host->pdev->dev,
 				data->sg, data->sg_len,
 				((data->flags & MMC_DATA_WRITE)
@@ -678,7 +698,7 @@ static void atmci_dma_cleanup(struct atmel_mci *host)
 {
 	struct mmc_data                 *data = host->data;
 
-	if (data)
+	if (data && !data->host_cookie)
 		dma_unmap_sg(host->dma.chan->device->dev,
 				data->sg, data->sg_len,
 				((data->flags & MMC_DATA_WRITE)
@@ -769,6 +789,107 @@ static u32 atmci_prepare_data(struct atmel_mci *host, struct mmc_data *data)
 	return iflags;
 }
 
+/*
+ * We don't do DMA on "complex" transfers, i.e. with
+ * non-word-aligned buffers or lengths. Also, we don't bother
+ * with all the DMA setup overhead for short transfers.
+ */
+static bool atmci_dma_is_possible(struct mmc_data *data)
+{
+	struct scatterlist	*sg;
+	unsigned int		i;
+
+	if (data->blocks * data->blksz < ATMCI_DMA_THRESHOLD)
+		return false;
+	if (data->blksz & 3)
+		return false;
+
+	for_each_sg(data->sg, sg, data->sg_len, i) {
+		if (sg->offset & 3 || sg->length & 3)
+			return false;
+	}
+
+	return true;
+}
+
+static struct device *atmci_dma_dev(struct atmel_mci *host)
+{
+	return host->dma.chan ? host->dma.chan->device->dev : &host->pdev->dev;
+}
+
+/*
+ * Map the data buffers and, when using the DMA engine, prepare the
+ * descriptor.  pre_req() calls this with @next to get the next request
+ * ready while the current one is still running; the request itself
+ * then only picks up the result.
+ */
+static int atmci_pre_dma_transfer(struct atmel_mci *host,
+		struct mmc_data *data, struct atmel_mci_next_data *next)
+{
+	struct dma_chan			*chan = host->dma.chan;
+	struct dma_async_tx_descriptor	*desc;
+	enum dma_data_direction		direction;
+	enum dma_transfer_direction	slave_dirn;
+	int				sglen;
+
+	if (data->flags & MMC_DATA_READ) {
+		direction = DMA_FROM_DEVICE;
+		slave_dirn = DMA_DEV_TO_MEM;
+	} else {
+		direction = DMA_TO_DEVICE;
+		slave_dirn = DMA_MEM_TO_DEV;
+	}
+
+	sglen = 0;
+	if (!next && data->host_cookie) {
+		struct atmel_mci_next_data *nd = &host->cur_slot->next_data;
+
+		if (data->host_cookie == nd->cookie) {
+			sglen = nd->sg_len;
+		} else {
+			dev_warn(&host->pdev->dev,
+					"invalid cookie %d, expected %d\n",
+					data->host_cookie, nd->cookie);
+			/* drop the mapping of pre_req() and start over */
+			dma_unmap_sg(atmci_dma_dev(host), data->sg,
+					data->sg_len, direction);
+			data->host_cookie = 0;
+		}
+	}
+
+	if (!sglen) {
+		sglen = dma_map_sg(atmci_dma_dev(host), data->sg,
+				data->sg_len, direction);
+		if (!sglen)
+			return -ENOMEM;
+	}
+
+	if (next) {
+		next->sg_len = sglen;
+		return 0;
+	}
+
+	host->dma.data_desc = NULL;
+	if (!chan)
+		return 0;
+
+	desc = chan->device->device_prep_slave_sg(chan, data->sg, sglen,
+			slave_dirn, DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+	if (!desc) {
+		/* a mapping made by pre_req() is undone by post_req() */
+		if (!data->host_cookie)
+			dma_unmap_sg(chan->device->dev, data->sg,
+					data->sg_len, direction);
+		return -ENOMEM;
+	}
+
+	desc->callback = atmci_dma_complete;
+	desc->callback_param = host;
+	host->dma.data_desc = desc;
+
+	return 0;
+}
+
 /*
  * Set interrupt flags and set block length into the MCI mode register even
  * if this value is also accessible in the MCI block register. It seems to be
@@ -779,9 +900,14 @@ static u32
 atmci_prepare_data_pdc(struct atmel_mci *host, struct mmc_data *data)
 {
 	u32 iflags, tmp;
-	unsigned int sg_len;
 	enum dma_data_direction dir;
 
+	/* Map the buffers first: without them, fall back to PIO */
+	if (atmci_pre_dma_transfer(host, data, NULL)) {
+		atmci_writel(host, ATMCI_MR, host->mode_reg);
+		return atmci_prepare_data(host, data);
+	}
+
 	data->error = -EINPROGRESS;
 
 	host->data = data;
@@ -807,7 +933,6 @@ atmci_prepare_data_pdc(struct atmel_mci *host, struct mmc_data *data)
 
 	/* Configure PDC */
 	host->data_size = data->blocks * data->blksz;
-	sg_len = dma_map_sg(&host->pdev->dev, data->sg, data->sg_len, dir);
 	if (host->data_size)
 		atmci_pdc_set_both_buf(host,
 			((dir == DMA_FROM_DEVICE) ? XFER_RECEIVE : XFER_TRANSMIT));
@@ -819,12 +944,6 @@ static u32
 atmci_prepare_data_dma(struct atmel_mci *host, struct mmc_data *data)
 {
 	struct dma_chan			*chan;
-	struct dma_async_tx_descriptor	*desc;
-	struct scatterlist		*sg;
-	unsigned int			i;
-	enum dma_data_direction		direction;
-	enum dma_transfer_direction	slave_dirn;
-	unsigned int			sglen;
 	u32 iflags;
 
 	data->error = -EINPROGRESS;
@@ -835,21 +954,9 @@ atmci_prepare_data_dma(struct atmel_mci *host, struct mmc_data *data)
 
 	iflags = ATMCI_DATA_ERROR_FLAGS;
 
-	/*
-	 * We don't do DMA on "complex" transfers, i.e. with
-	 * non-word-aligned buffers or lengths. Also, we don't bother
-	 * with all the DMA setup overhead for short transfers.
-	 */
-	if (data->blocks * data->blksz < ATMCI_DMA_THRESHOLD)
-		return atmci_prepare_data(host, data);
-	if (data->blksz & 3)
+	if (!atmci_dma_is_possible(data))
 		return atmci_prepare_data(host, data);
 
-	for_each_sg(data->sg, sg, data->sg_len, i) {
-		if (sg->offset & 3 || sg->length & 3)
-			return atmci_prepare_data(host, data);
-	}
-
 	/* If we don't have a channel, we can't do DMA */
 	chan = host->dma.chan;
 	if (chan)
@@ -861,31 +968,10 @@ atmci_prepare_data_dma(struct atmel_mci *host, struct mmc_data *data)
 	if (host->caps.has_dma)
 		atmci_writel(host, ATMCI_DMA, ATMCI_DMA_CHKSIZE(3) | ATMCI_DMAEN);
 
-	if (data->flags & MMC_DATA_READ) {
-		direction = DMA_FROM_DEVICE;
-		slave_dirn = DMA_DEV_TO_MEM;
-	} else {
-		direction = DMA_TO_DEVICE;
-		slave_dirn = DMA_MEM_TO_DEV;
-	}
-
-	sglen = dma_map_sg(chan->device->dev, data->sg,
-			data->sg_len, direction);
-
-	desc = chan->device->device_prep_slave_sg(chan,
-			data->sg, sglen, slave_dirn,
-			DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
-	if (!desc)
-		goto unmap_exit;
-
-	host->dma.data_desc = desc;
-	desc->callback = atmci_dma_complete;
-	desc->callback_param = host;
+	if (atmci_pre_dma_transfer(host, data, NULL))
+		return -ENOMEM;
 
 	return iflags;
-unmap_exit:
-	dma_unmap_sg(chan->device->dev, data->sg, data->sg_len, direction);
-	return -ENOMEM;
 }
 
 static void
@@ -900,6 +986,10 @@ atmci_submit_data(struct atmel_mci *host, struct mmc_data *data)
 static void
 atmci_submit_data_pdc(struct atmel_mci *host, struct mmc_data *data)
 {
+	/* atmci_prepare_data_pdc() fell back to PIO */
+	if (!(atmci_readl(host, ATMCI_MR) & ATMCI_MR_PDCMODE))
+		return;
+
 	if (data->flags & MMC_DATA_READ)
 		atmci_writel(host, ATMEL_PDC_PTCR, ATMEL_PDC_RXTEN);
 	else
@@ -1242,8 +1332,59 @@ static void atmci_enable_sdio_irq(struct mmc_host *mmc, int enable)
 		atmci_writel(host, ATMCI_IDR, slot->sdio_irq);
 }
 
+static void atmci_pre_req(struct mmc_host *mmc, struct mmc_request *mrq,
+		bool is_first_req)
+{
+	struct atmel_mci_slot		*slot = mmc_priv(mmc);
+	struct atmel_mci		*host = slot->host;
+	struct atmel_mci_next_data	*nd = &slot->next_data;
+	struct mmc_data			*data = mrq->data;
+
+	if (!data)
+		return;
+
+	if (data->host_cookie) {
+		data->host_cookie = 0;
+		return;
+	}
+
+	if (host->prepare_data == &atmci_prepare_data)
+		return;
+	if (host->dma.chan && !atmci_dma_is_possible(data))
+		return;
+
+	if (atmci_pre_dma_transfer(host, data, nd)) {
+		data->host_cookie = 0;
+		return;
+	}
+
+	/* host_cookie 0 means "not prepared": skip it when wrapping */
+	if (++nd->cookie < 0)
+		nd->cookie = 1;
+	data->host_cookie = nd->cookie;
+}
+
+static void atmci_post_req(struct mmc_host *mmc, struct mmc_request *mrq,
+		int err)
+{
+	struct atmel_mci_slot	*slot = mmc_priv(mmc);
+	struct atmel_mci	*host = slot->host;
+	struct mmc_data		*data = mrq->data;
+
+	if (!data || !data->host_cookie)
+		return;
+
+	/* Only the mapping was prepared, whether the request ran or not */
+	dma_unmap_sg(atmci_dma_dev(host), data->sg, data->sg_len,
+			(data->flags & MMC_DATA_WRITE)
+			? DMA_TO_DEVICE : DMA_FROM_DEVICE);
+	data->host_cookie = 0;
+}
+
 static const struct mmc_host_ops atmci_ops = {
 	.request	= atmci_request,
+	.pre_req	= atmci_pre_req,
+	.post_req	= atmci_post_req,
 	.set_ios	= atmci_set_ios,
 	.get_ro		= atmci_get_ro,
 	.get_cd		= atmci_get_cd,
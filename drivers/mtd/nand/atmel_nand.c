@@ -56,6 +56,9 @@ module_param(use_dma, int, 0);
 static int on_flash_bbt = 0;
 module_param(on_flash_bbt, int, 0);
 
+static int use_cache_read = 1;
+module_param(use_cache_read, int, 0);
+
 /* Register access macros */
 #define ecc_readl(add, reg)				\
 	__raw_readl(add + ATMEL_ECC_##reg)
@@ -101,6 +104,11 @@ struct atmel_nand_host {
 
 	struct completion	comp;
 	struct dma_chan		*dma_chan;
+
+	/* streaming reads with the read cache commands */
+	int			(*nand_read)(struct mtd_info *mtd, loff_t from,
+					size_t len, size_t *retlen, u_char *buf);
+	u8			*stream_buf;
 };
 
 static int cpu_has_dma(void)
@@ -197,14 +205,47 @@ static void dma_complete_func(void *completion)
 	complete(completion);
 }
 
+/*
+ * Start a DMA transfer between the NAND data port and memory.
+ * host->comp is completed when it is done.
+ */
+static int atmel_nand_dma_submit(struct atmel_nand_host *host,
+		dma_addr_t dma_dst_addr, dma_addr_t dma_src_addr, int len)
+{
+	struct dma_device *dma_dev = host->dma_chan->device;
+	struct dma_async_tx_descriptor *tx;
+	enum dma_ctrl_flags flags;
+	dma_cookie_t cookie;
+
+	flags = DMA_CTRL_ACK | DMA_PREP_INTERRUPT | DMA_COMPL_SKIP_SRC_UNMAP |
+		DMA_COMPL_SKIP_DEST_UNMAP;
+
+	tx = dma_dev->device_prep_dma_memcpy(host->dma_chan, dma_dst_addr,
+					     dma_src_addr, len, flags);
+	if (!tx) {
+		dev_err(host->dev, "Failed to prepare DMA memcpy\n");
+		return -EIO;
+	}
+
+	init_completion(&host->comp);
+	tx->callback = dma_complete_func;
+	tx->callback_param = &host->comp;
+
+	cookie = tx->tx_submit(tx);
+	if (dma_submit_error(cookie)) {
+		dev_err(host->dev, "Failed to do DMA tx_submit\n");
+		return -EIO;
+	}
+
+	dma_async_issue_pending(host->dma_chan);
+	return 0;
+}
+
 static int atmel_nand_dma_op(struct mtd_info *mtd, void *buf, int len,
 			       int is_read)
 {
 	struct dma_device *dma_dev;
-	enum dma_ctrl_flags flags;
 	dma_addr_t dma_src_addr, dma_dst_addr, phys_addr;
-	struct dma_async_tx_descriptor *tx = NULL;
-	dma_cookie_t cookie;
 	struct nand_chip *chip = mtd->priv;
 	struct atmel_nand_host *host = chip->priv;
 	void *p = buf;
@@ -216,9 +257,6 @@ static int atmel_nand_dma_op(struct mtd_info *mtd, void *buf, int len,
 
 	dma_dev = host->dma_chan->device;
 
-	flags = DMA_CTRL_ACK | DMA_PREP_INTERRUPT | DMA_COMPL_SKIP_SRC_UNMAP |
-		DMA_COMPL_SKIP_DEST_UNMAP;
-
 	phys_addr = dma_map_single(dma_dev->dev, p, len, dir);
 	if (dma_mapping_error(dma_dev->dev, phys_addr)) {
 		dev_err(host->dev, "Failed to dma_map_single\n");
@@ -233,28 +271,12 @@ static int atmel_nand_dma_op(struct mtd_info *mtd, void *buf, int len,
 		dma_dst_addr = host->io_phys;
 	}
 
-	tx = dma_dev->device_prep_dma_memcpy(host->dma_chan, dma_dst_addr,
-					     dma_src_addr, len, flags);
-	if (!tx) {
-		dev_err(host->dev, "Failed to prepare DMA memcpy\n");
-		goto err_dma;
-	}
-
-	init_completion(&host->comp);
-	tx->callback = dma_complete_func;
-	tx->callback_param = &host->comp;
-
-	cookie = tx->tx_submit(tx);
-	if (dma_submit_error(cookie)) {
-		dev_err(host->dev, "Failed to do DMA tx_submit\n");
+	err = atmel_nand_dma_submit(host, dma_dst_addr, dma_src_addr, len);
+	if (err)
 		goto err_dma;
-	}
 
-	dma_async_issue_pending(host->dma_chan);
 	wait_for_completion(&host->comp);
 
-	err = 0;
-
 err_dma:
 	dma_unmap_single(dma_dev->dev, phys_addr, len, dir);
 err_buf:
@@ -394,36 +416,24 @@ static int atmel_nand_read_page(struct mtd_info *mtd,
 }
 
 /*
- * HW ECC Correction
- *
- * function called after a read
- *
- * mtd:        MTD block structure
- * dat:        raw data read from the chip
- * read_ecc:   ECC from the chip (unused)
- * isnull:     unused
- *
- * Detect and correct a 1 bit error for a page
+ * Apply a correction from a snapshot of the ECC status and parity
+ * registers.  The streaming read path takes the snapshot before the
+ * next page overwrites the registers, and fixes the data later.
  */
-static int atmel_nand_correct(struct mtd_info *mtd, u_char *dat,
-		u_char *read_ecc, u_char *isnull)
+static int atmel_nand_ecc_fix(struct atmel_nand_host *host, u_char *dat,
+		unsigned int ecc_status, unsigned int ecc_parity)
 {
-	struct nand_chip *nand_chip = mtd->priv;
-	struct atmel_nand_host *host = nand_chip->priv;
-	unsigned int ecc_status;
+	struct nand_chip *nand_chip = &host->nand_chip;
 	unsigned int ecc_word, ecc_bit;
 
-	/* get the status from the Status Register */
-	ecc_status = ecc_readl(host->ecc, SR);
-
 	/* if there's no error */
 	if (likely(!(ecc_status & ATMEL_ECC_RECERR)))
 		return 0;
 
 	/* get error bit offset (4 bits) */
-	ecc_bit = ecc_readl(host->ecc, PR) & ATMEL_ECC_BITADDR;
+	ecc_bit = ecc_parity & ATMEL_ECC_BITADDR;
 	/* get word address (12 bits) */
-	ecc_word = ecc_readl(host->ecc, PR) & ATMEL_ECC_WORDADDR;
+	ecc_word = ecc_parity & ATMEL_ECC_WORDADDR;
 	ecc_word >>= 4;
 
 	/* if there are multiple errors */
@@ -469,6 +479,36 @@ static int atmel_nand_correct(struct mtd_info *mtd, u_char *dat,
 	return 1;
 }
 
+/*
+ * HW ECC Correction
+ *
+ * function called after a read
+ *
+ * mtd:        MTD block structure
+ * dat:        raw data read from the chip
+ * read_ecc:   ECC from the chip (unused)
+ * isnull:     unused
+ *
+ * Detect and correct a 1 bit error for a page
+ */
+static int atmel_nand_correct(struct mtd_info *mtd, u_char *dat,
+		u_char *read_ecc, u_char *isnull)
+{
+	struct nand_chip *nand_chip = mtd->priv;
+	struct atmel_nand_host *host = nand_chip->priv;
+	unsigned int ecc_status;
+
+	/* get the status from the Status Register */
+	ecc_status = ecc_readl(host->ecc, SR);
+
+	/* if there's no error */
+	if (likely(!(ecc_status & ATMEL_ECC_RECERR)))
+		return 0;
+
+	return atmel_nand_ecc_fix(host, dat, ecc_status,
+				  ecc_readl(host->ecc, PR));
+}
+
 /*
  * Enable HW ECC : unused on most chips
  */
@@ -481,6 +521,178 @@ static void atmel_nand_hwctl(struct mtd_info *mtd, int mode)
 	}
 }
 
+/*
+ * One page in flight in the streaming read pipeline
+ */
+struct atmel_nand_stream_page {
+	u8		*dat;		/* where the DMA landed */
+	u8		*dst;		/* caller's buffer */
+	unsigned int	ecc_status;
+	unsigned int	ecc_parity;
+};
+
+static void atmel_nand_stream_finish(struct mtd_info *mtd,
+		struct atmel_nand_stream_page *sp)
+{
+	struct nand_chip *chip = mtd->priv;
+	struct atmel_nand_host *host = chip->priv;
+	int stat;
+
+	stat = atmel_nand_ecc_fix(host, sp->dat, sp->ecc_status,
+				  sp->ecc_parity);
+	if (stat < 0)
+		mtd->ecc_stats.failed++;
+	else
+		mtd->ecc_stats.corrected += stat;
+
+	if (sp->dat != sp->dst)
+		memcpy(sp->dst, sp->dat, mtd->writesize);
+}
+
+/*
+ * Read npages consecutive pages of one erase block with the read cache
+ * commands.  While page N is moved out of the cache register by DMA,
+ * the chip loads page N+1 into its page register and the CPU applies
+ * the ECC correction of page N-1.
+ */
+static void atmel_nand_read_pages(struct mtd_info *mtd, int page,
+		int npages, u8 *buf, int direct)
+{
+	struct nand_chip *chip = mtd->priv;
+	struct atmel_nand_host *host = chip->priv;
+	struct dma_device *dma_dev = host->dma_chan->device;
+	struct atmel_nand_stream_page sp[2];
+	uint32_t *eccpos = chip->ecc.layout->eccpos;
+	u8 ecc[4];
+	dma_addr_t phys_addr;
+	int i, mapped, err;
+
+	chip->cmdfunc(mtd, NAND_CMD_READ0, 0x00, page);
+
+	for (i = 0; i < npages; i++) {
+		struct atmel_nand_stream_page *cur = &sp[i & 1];
+
+		if (npages > 1)
+			chip->cmdfunc(mtd, i < npages - 1 ?
+				      NAND_CMD_READCACHESEQ :
+				      NAND_CMD_READCACHEEND, -1, -1);
+
+		cur->dst = buf + i * mtd->writesize;
+		cur->dat = direct ? cur->dst :
+			host->stream_buf + (i & 1) * mtd->writesize;
+
+		ecc_writel(host->ecc, CR, ATMEL_ECC_RST);
+
+		phys_addr = dma_map_single(dma_dev->dev, cur->dat,
+					   mtd->writesize, DMA_FROM_DEVICE);
+		mapped = !dma_mapping_error(dma_dev->dev, phys_addr);
+		err = mapped ? atmel_nand_dma_submit(host, phys_addr,
+						     host->io_phys,
+						     mtd->writesize) : -EIO;
+
+		/* finish the previous page while this one is in flight */
+		if (i)
+			atmel_nand_stream_finish(mtd, &sp[(i - 1) & 1]);
+
+		if (!err)
+			wait_for_completion(&host->comp);
+		if (mapped)
+			dma_unmap_single(dma_dev->dev, phys_addr,
+					 mtd->writesize, DMA_FROM_DEVICE);
+		if (err) {
+			if (host->board->bus_width_16)
+				atmel_read_buf16(mtd, cur->dat, mtd->writesize);
+			else
+				atmel_read_buf8(mtd, cur->dat, mtd->writesize);
+		}
+
+		/* the ECC controller needs to read the ECC just after the data */
+		chip->cmdfunc(mtd, NAND_CMD_RNDOUT,
+			      mtd->writesize + eccpos[0], -1);
+		chip->read_buf(mtd, ecc, chip->ecc.bytes);
+
+		cur->ecc_status = ecc_readl(host->ecc, SR);
+		cur->ecc_parity = ecc_readl(host->ecc, PR);
+	}
+
+	atmel_nand_stream_finish(mtd, &sp[(npages - 1) & 1]);
+}
+
+/*
+ * MTD read method: stream whole-page runs with the read cache commands
+ * and leave anything else to the generic NAND code.
+ */
+static int atmel_nand_read(struct mtd_info *mtd, loff_t from, size_t len,
+		size_t *retlen, u_char *buf)
+{
+	struct nand_chip *chip = mtd->priv;
+	struct atmel_nand_host *host = chip->priv;
+	int pages_per_block = 1 << (chip->phys_erase_shift - chip->page_shift);
+	struct mtd_ecc_stats stats;
+	int realpage, chipnr, npages, direct;
+	size_t done = 0, tail_len = 0;
+	int ret = 0;
+
+	if ((from & (mtd->writesize - 1)) || len < 2 * mtd->writesize
+	    || from + len > mtd->size)
+		return host->nand_read(mtd, from, len, retlen, buf);
+
+	/* vmalloc()ed buffers are bounced through stream_buf */
+	direct = (void *)(buf + len - 1) < high_memory;
+
+	nand_get_device(chip, mtd, FL_READING);
+	stats = mtd->ecc_stats;
+
+	realpage = (int)(from >> chip->page_shift);
+	chipnr = (int)(from >> chip->chip_shift);
+	chip->select_chip(mtd, chipnr);
+
+	while (len - done >= mtd->writesize) {
+		int page = realpage & chip->pagemask;
+
+		/* the cache read sequence stops at block boundaries */
+		npages = pages_per_block - (page & (pages_per_block - 1));
+		npages = min_t(size_t, npages, (len - done) >> chip->page_shift);
+
+		if (!page && done) {
+			chipnr++;
+			chip->select_chip(mtd, -1);
+			chip->select_chip(mtd, chipnr);
+		}
+
+		atmel_nand_read_pages(mtd, page, npages, buf + done, direct);
+
+		done += npages << chip->page_shift;
+		realpage += npages;
+	}
+
+	if (mtd->ecc_stats.failed - stats.failed)
+		ret = -EBADMSG;
+	else if (mtd->ecc_stats.corrected - stats.corrected)
+		ret = -EUCLEAN;
+
+	nand_release_device(mtd);
+
+	if (done < len) {
+		int tail_ret;
+
+		tail_ret = host->nand_read(mtd, from + done, len - done,
+					   &tail_len, buf + done);
+		if (tail_ret == -EBADMSG || (tail_ret && !ret))
+			ret = tail_ret;
+	}
+
+	*retlen = done + tail_len;
+	return ret;
+}
+
+static int atmel_nand_has_cache_read(struct nand_chip *chip)
+{
+	return chip->onfi_version &&
+		(le16_to_cpu(chip->onfi_params.opt_cmd) &
+		 ONFI_OPT_CMD_READ_CACHE);
+}
+
 /*
  * Probe for the NAND device.
  */
@@ -649,12 +861,23 @@ static int __init atmel_nand_probe(struct platform_device *pdev)
 		goto err_scan_tail;
 	}
 
+	if (use_dma && use_cache_read && nand_chip->ecc.mode == NAND_ECC_HW
+	    && mtd->writesize > 512 && atmel_nand_has_cache_read(nand_chip)) {
+		host->stream_buf = kmalloc(2 * mtd->writesize, GFP_KERNEL);
+		if (host->stream_buf) {
+			host->nand_read = mtd->read;
+			mtd->read = atmel_nand_read;
+			dev_info(host->dev, "Using cache reads for sequential access.\n");
+		}
+	}
+
 	mtd->name = "atmel_nand";
 	res = mtd_device_parse_register(mtd, NULL, 0,
 			host->board->parts, host->board->num_parts);
 	if (!res)
 		return res;
 
+	kfree(host->stream_buf);
 err_scan_tail:
 err_scan_ident:
 err_no_card:
@@ -689,6 +912,7 @@ static int __exit atmel_nand_remove(struct platform_device *pdev)
 	if (host->dma_chan)
 		dma_release_channel(host->dma_chan);
 
+	kfree(host->stream_buf);
 	iounmap(host->io_base);
 	kfree(host);
 
@@ -46,27 +46,19 @@
 
 #define LINK_POLL_INTERVAL	(HZ)
 
-/* ..................................................................... */
-
-/*
- * Read from a EMAC register.
- */
-static inline unsigned long at91_emac_read(unsigned int reg)
-{
-	void __iomem *emac_base = (void __iomem *)AT91_VA_BASE_EMAC;
+static int rx_ring_size = DEF_RX_DESCR;
+module_param(rx_ring_size, int, 0444);
+MODULE_PARM_DESC(rx_ring_size, "Number of receive buffers ("
+		 __stringify(MIN_RX_DESCR) "-" __stringify(MAX_RX_DESCR) ")");
 
-	return __raw_readl(emac_base + reg);
-}
+/* ..................................................................... */
 
 /*
- * Write to a EMAC register.
+ * The EMAC is statically mapped, so register addresses are constants.
  */
-static inline void at91_emac_write(unsigned int reg, unsigned long value)
-{
-	void __iomem *emac_base = (void __iomem *)AT91_VA_BASE_EMAC;
-
-	__raw_writel(value, emac_base + reg);
-}
+static const struct at91_emac_io emac = {
+	.base	= (void __iomem *)AT91_VA_BASE_EMAC,
+};
 
 /* ........................... PHY INTERFACE ........................... */
 
@@ -79,8 +71,8 @@ static void enable_mdi(void)
 {
 	unsigned long ctl;
 
-	ctl = at91_emac_read(AT91_EMAC_CTL);
-	at91_emac_write(AT91_EMAC_CTL, ctl | AT91_EMAC_MPE);	/* enable management port */
+	ctl = at91_emac_read(&emac, AT91_EMAC_CTL);
+	at91_emac_write(&emac, AT91_EMAC_CTL, ctl | AT91_EMAC_MPE);	/* enable management port */
 }
 
 /*
@@ -90,8 +82,8 @@ static void disable_mdi(void)
 {
 	unsigned long ctl;
 
-	ctl = at91_emac_read(AT91_EMAC_CTL);
-	at91_emac_write(AT91_EMAC_CTL, ctl & ~AT91_EMAC_MPE);	/* disable management port */
+	ctl = at91_emac_read(&emac, AT91_EMAC_CTL);
+	at91_emac_write(&emac, AT91_EMAC_CTL, ctl & ~AT91_EMAC_MPE);	/* disable management port */
 }
 
 /*
@@ -100,7 +92,7 @@ static void disable_mdi(void)
 static inline void at91_phy_wait(void) {
 	unsigned long timeout = jiffies + 2;
 
-	while (!(at91_emac_read(AT91_EMAC_SR) & AT91_EMAC_SR_IDLE)) {
+	while (!(at91_emac_read(&emac, AT91_EMAC_SR) & AT91_EMAC_SR_IDLE)) {
 		if (time_after(jiffies, timeout)) {
 			printk("at91_ether: MIO timeout\n");
 			break;
@@ -115,7 +107,7 @@ static inline void at91_phy_wait(void) {
  */
 static void write_phy(unsigned char phy_addr, unsigned char address, unsigned int value)
 {
-	at91_emac_write(AT91_EMAC_MAN, AT91_EMAC_MAN_802_3 | AT91_EMAC_RW_W
+	at91_emac_write(&emac, AT91_EMAC_MAN, AT91_EMAC_MAN_802_3 | AT91_EMAC_RW_W
 		| ((phy_addr & 0x1f) << 23) | (address << 18) | (value & AT91_EMAC_DATA));
 
 	/* Wait until IDLE bit in Network Status register is cleared */
@@ -128,13 +120,13 @@ static void write_phy(unsigned char phy_addr, unsigned char address, unsigned in
  */
 static void read_phy(unsigned char phy_addr, unsigned char address, unsigned int *value)
 {
-	at91_emac_write(AT91_EMAC_MAN, AT91_EMAC_MAN_802_3 | AT91_EMAC_RW_R
+	at91_emac_write(&emac, AT91_EMAC_MAN, AT91_EMAC_MAN_802_3 | AT91_EMAC_RW_R
 		| ((phy_addr & 0x1f) << 23) | (address << 18));
 
 	/* Wait until IDLE bit in Network Status register is cleared */
 	at91_phy_wait();
 
-	*value = at91_emac_read(AT91_EMAC_MAN) & AT91_EMAC_DATA;
+	*value = at91_emac_read(&emac, AT91_EMAC_MAN) & AT91_EMAC_DATA;
 }
 
 /* ........................... PHY MANAGEMENT .......................... */
@@ -175,7 +167,7 @@ static void update_linkspeed(struct net_device *dev, int silent)
 	}
 
 	/* Update the MAC */
-	mac_cfg = at91_emac_read(AT91_EMAC_CFG) & ~(AT91_EMAC_SPD | AT91_EMAC_FD);
+	mac_cfg = at91_emac_read(&emac, AT91_EMAC_CFG) & ~(AT91_EMAC_SPD | AT91_EMAC_FD);
 	if (speed == SPEED_100) {
 		if (duplex == DUPLEX_FULL)		/* 100 Full Duplex */
 			mac_cfg |= AT91_EMAC_SPD | AT91_EMAC_FD;
@@ -186,7 +178,7 @@ static void update_linkspeed(struct net_device *dev, int silent)
 			mac_cfg |= AT91_EMAC_FD;
 		else {}					/* 10 Half Duplex */
 	}
-	at91_emac_write(AT91_EMAC_CFG, mac_cfg);
+	at91_emac_write(&emac, AT91_EMAC_CFG, mac_cfg);
 
 	if (!silent)
 		printk(KERN_INFO "%s: Link now %i-%s\n", dev->name, speed, (duplex == DUPLEX_FULL) ? "FullDuplex" : "HalfDuplex");
@@ -455,16 +447,16 @@ static short __init unpack_mac_address(struct net_device *dev, unsigned int hi,
 static void __init get_mac_address(struct net_device *dev)
 {
 	/* Check Specific-Address 1 */
-	if (unpack_mac_address(dev, at91_emac_read(AT91_EMAC_SA1H), at91_emac_read(AT91_EMAC_SA1L)))
+	if (unpack_mac_address(dev, at91_emac_read(&emac, AT91_EMAC_SA1H), at91_emac_read(&emac, AT91_EMAC_SA1L)))
 		return;
 	/* Check Specific-Address 2 */
-	if (unpack_mac_address(dev, at91_emac_read(AT91_EMAC_SA2H), at91_emac_read(AT91_EMAC_SA2L)))
+	if (unpack_mac_address(dev, at91_emac_read(&emac, AT91_EMAC_SA2H), at91_emac_read(&emac, AT91_EMAC_SA2L)))
 		return;
 	/* Check Specific-Address 3 */
-	if (unpack_mac_address(dev, at91_emac_read(AT91_EMAC_SA3H), at91_emac_read(AT91_EMAC_SA3L)))
+	if (unpack_mac_address(dev, at91_emac_read(&emac, AT91_EMAC_SA3H), at91_emac_read(&emac, AT91_EMAC_SA3L)))
 		return;
 	/* Check Specific-Address 4 */
-	if (unpack_mac_address(dev, at91_emac_read(AT91_EMAC_SA4H), at91_emac_read(AT91_EMAC_SA4L)))
+	if (unpack_mac_address(dev, at91_emac_read(&emac, AT91_EMAC_SA4H), at91_emac_read(&emac, AT91_EMAC_SA4L)))
 		return;
 
 	printk(KERN_ERR "at91_ether: Your bootloader did not configure a MAC address.\n");
@@ -475,11 +467,11 @@ static void __init get_mac_address(struct net_device *dev)
  */
 static void update_mac_address(struct net_device *dev)
 {
-	at91_emac_write(AT91_EMAC_SA1L, (dev->dev_addr[3] << 24) | (dev->dev_addr[2] << 16) | (dev->dev_addr[1] << 8) | (dev->dev_addr[0]));
-	at91_emac_write(AT91_EMAC_SA1H, (dev->dev_addr[5] << 8) | (dev->dev_addr[4]));
+	at91_emac_write(&emac, AT91_EMAC_SA1L, (dev->dev_addr[3] << 24) | (dev->dev_addr[2] << 16) | (dev->dev_addr[1] << 8) | (dev->dev_addr[0]));
+	at91_emac_write(&emac, AT91_EMAC_SA1H, (dev->dev_addr[5] << 8) | (dev->dev_addr[4]));
 
-	at91_emac_write(AT91_EMAC_SA2L, 0);
-	at91_emac_write(AT91_EMAC_SA2H, 0);
+	at91_emac_write(&emac, AT91_EMAC_SA2L, 0);
+	at91_emac_write(&emac, AT91_EMAC_SA2H, 0);
 }
 
 /*
@@ -560,7 +552,7 @@ static int hash_get_index(__u8 *addr)
 static void at91ether_sethashtable(struct net_device *dev)
 {
 	struct netdev_hw_addr *ha;
-	unsigned long mc_filter[2];
+	u32 mc_filter[2];
 	unsigned int bitnr;
 
 	mc_filter[0] = mc_filter[1] = 0;
@@ -570,8 +562,8 @@ static void at91ether_sethashtable(struct net_device *dev)
 		mc_filter[bitnr >> 5] |= 1 << (bitnr & 31);
 	}
 
-	at91_emac_write(AT91_EMAC_HSL, mc_filter[0]);
-	at91_emac_write(AT91_EMAC_HSH, mc_filter[1]);
+	/* HSL, HSH */
+	at91_emac_write_block(&emac, AT91_EMAC_HSL, mc_filter, 2);
 }
 
 /*
@@ -581,7 +573,7 @@ static void at91ether_set_multicast_list(struct net_device *dev)
 {
 	unsigned long cfg;
 
-	cfg = at91_emac_read(AT91_EMAC_CFG);
+	cfg = at91_emac_read(&emac, AT91_EMAC_CFG);
 
 	if (dev->flags & IFF_PROMISC)			/* Enable promiscuous mode */
 		cfg |= AT91_EMAC_CAF;
@@ -589,19 +581,19 @@ static void at91ether_set_multicast_list(struct net_device *dev)
 		cfg &= ~AT91_EMAC_CAF;
 
 	if (dev->flags & IFF_ALLMULTI) {		/* Enable all multicast mode */
-		at91_emac_write(AT91_EMAC_HSH, -1);
-		at91_emac_write(AT91_EMAC_HSL, -1);
+		at91_emac_write(&emac, AT91_EMAC_HSH, -1);
+		at91_emac_write(&emac, AT91_EMAC_HSL, -1);
 		cfg |= AT91_EMAC_MTI;
 	} else if (!netdev_mc_empty(dev)) { /* Enable specific multicasts */
 		at91ether_sethashtable(dev);
 		cfg |= AT91_EMAC_MTI;
 	} else if (dev->flags & (~IFF_ALLMULTI)) {	/* Disable all multicast mode */
-		at91_emac_write(AT91_EMAC_HSH, 0);
-		at91_emac_write(AT91_EMAC_HSL, 0);
+		at91_emac_write(&emac, AT91_EMAC_HSH, 0);
+		at91_emac_write(&emac, AT91_EMAC_HSL, 0);
 		cfg &= ~AT91_EMAC_MTI;
 	}
 
-	at91_emac_write(AT91_EMAC_CFG, cfg);
+	at91_emac_write(&emac, AT91_EMAC_CFG, cfg);
 }
 
 /* ......................... ETHTOOL SUPPORT ........................... */
@@ -712,30 +704,26 @@ static int at91ether_ioctl(struct net_device *dev, struct ifreq *rq, int cmd)
 static void at91ether_start(struct net_device *dev)
 {
 	struct at91_private *lp = netdev_priv(dev);
-	struct recv_desc_bufs *dlist, *dlist_phys;
 	int i;
 	unsigned long ctl;
 
-	dlist = lp->dlist;
-	dlist_phys = lp->dlist_phys;
-
-	for (i = 0; i < MAX_RX_DESCR; i++) {
-		dlist->descriptors[i].addr = (unsigned int) &dlist_phys->recv_buf[i][0];
-		dlist->descriptors[i].size = 0;
+	for (i = 0; i < lp->rx_ring_size; i++) {
+		lp->rx_ring[i].addr = lp->rx_buffers_dma + i * MAX_RBUFF_SZ;
+		lp->rx_ring[i].size = 0;
 	}
 
 	/* Set the Wrap bit on the last descriptor */
-	dlist->descriptors[i-1].addr |= EMAC_DESC_WRAP;
+	lp->rx_ring[i-1].addr |= EMAC_DESC_WRAP;
 
 	/* Reset buffer index */
 	lp->rxBuffIndex = 0;
 
 	/* Program address of descriptor list in Rx Buffer Queue register */
-	at91_emac_write(AT91_EMAC_RBQP, (unsigned long) dlist_phys);
+	at91_emac_write(&emac, AT91_EMAC_RBQP, lp->rx_ring_dma);
 
 	/* Enable Receive and Transmit */
-	ctl = at91_emac_read(AT91_EMAC_CTL);
-	at91_emac_write(AT91_EMAC_CTL, ctl | AT91_EMAC_RE | AT91_EMAC_TE);
+	ctl = at91_emac_read(&emac, AT91_EMAC_CTL);
+	at91_emac_write(&emac, AT91_EMAC_CTL, ctl | AT91_EMAC_RE | AT91_EMAC_TE);
 }
 
 /*
@@ -752,8 +740,8 @@ static int at91ether_open(struct net_device *dev)
 	clk_enable(lp->ether_clk);		/* Re-enable Peripheral clock */
 
 	/* Clear internal statistics */
-	ctl = at91_emac_read(AT91_EMAC_CTL);
-	at91_emac_write(AT91_EMAC_CTL, ctl | AT91_EMAC_CSR);
+	ctl = at91_emac_read(&emac, AT91_EMAC_CTL);
+	at91_emac_write(&emac, AT91_EMAC_CTL, ctl | AT91_EMAC_CSR);
 
 	/* Update the MAC address (incase user has changed it) */
 	update_mac_address(dev);
@@ -762,7 +750,7 @@ static int at91ether_open(struct net_device *dev)
 	enable_phyirq(dev);
 
 	/* Enable MAC interrupts */
-	at91_emac_write(AT91_EMAC_IER, AT91_EMAC_RCOM | AT91_EMAC_RBNA
+	at91_emac_write(&emac, AT91_EMAC_IER, AT91_EMAC_RCOM | AT91_EMAC_RBNA
 				| AT91_EMAC_TUND | AT91_EMAC_RTRY | AT91_EMAC_TCOM
 				| AT91_EMAC_ROVR | AT91_EMAC_ABT);
 
@@ -773,6 +761,7 @@ static int at91ether_open(struct net_device *dev)
 	disable_mdi();
 	spin_unlock_irq(&lp->lock);
 
+	napi_enable(&lp->napi);
 	at91ether_start(dev);
 	netif_start_queue(dev);
 	return 0;
@@ -787,18 +776,19 @@ static int at91ether_close(struct net_device *dev)
 	unsigned long ctl;
 
 	/* Disable Receiver and Transmitter */
-	ctl = at91_emac_read(AT91_EMAC_CTL);
-	at91_emac_write(AT91_EMAC_CTL, ctl & ~(AT91_EMAC_TE | AT91_EMAC_RE));
+	ctl = at91_emac_read(&emac, AT91_EMAC_CTL);
+	at91_emac_write(&emac, AT91_EMAC_CTL, ctl & ~(AT91_EMAC_TE | AT91_EMAC_RE));
 
 	/* Disable PHY interrupt */
 	disable_phyirq(dev);
 
 	/* Disable MAC interrupts */
-	at91_emac_write(AT91_EMAC_IDR, AT91_EMAC_RCOM | AT91_EMAC_RBNA
+	at91_emac_write(&emac, AT91_EMAC_IDR, AT91_EMAC_RCOM | AT91_EMAC_RBNA
 				| AT91_EMAC_TUND | AT91_EMAC_RTRY | AT91_EMAC_TCOM
 				| AT91_EMAC_ROVR | AT91_EMAC_ABT);
 
 	netif_stop_queue(dev);
+	napi_disable(&lp->napi);
 
 	clk_disable(lp->ether_clk);		/* Disable Peripheral clock */
 
@@ -812,7 +802,7 @@ static int at91ether_start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct at91_private *lp = netdev_priv(dev);
 
-	if (at91_emac_read(AT91_EMAC_TSR) & AT91_EMAC_TSR_BNQ) {
+	if (at91_emac_read(&emac, AT91_EMAC_TSR) & AT91_EMAC_TSR_BNQ) {
 		netif_stop_queue(dev);
 
 		/* Store packet information (to free when Tx completed) */
@@ -822,9 +812,9 @@ static int at91ether_start_xmit(struct sk_buff *skb, struct net_device *dev)
 		dev->stats.tx_bytes += skb->len;
 
 		/* Set address of the data in the Transmit Address register */
-		at91_emac_write(AT91_EMAC_TAR, lp->skb_physaddr);
+		at91_emac_write(&emac, AT91_EMAC_TAR, lp->skb_physaddr);
 		/* Set length of the packet in the Transmit Control register */
-		at91_emac_write(AT91_EMAC_TCR, skb->len);
+		at91_emac_write_sync(&emac, AT91_EMAC_TCR, skb->len);
 
 	} else {
 		printk(KERN_ERR "at91_ether.c: at91ether_start_xmit() called, but device is busy!\n");
@@ -844,71 +834,105 @@ static struct net_device_stats *at91ether_stats(struct net_device *dev)
 	int ale, lenerr, seqe, lcol, ecol;
 
 	if (netif_running(dev)) {
-		dev->stats.rx_packets += at91_emac_read(AT91_EMAC_OK);		/* Good frames received */
-		ale = at91_emac_read(AT91_EMAC_ALE);
+		dev->stats.rx_packets += at91_emac_read(&emac, AT91_EMAC_OK);		/* Good frames received */
+		ale = at91_emac_read(&emac, AT91_EMAC_ALE);
 		dev->stats.rx_frame_errors += ale;				/* Alignment errors */
-		lenerr = at91_emac_read(AT91_EMAC_ELR) + at91_emac_read(AT91_EMAC_USF);
+		lenerr = at91_emac_read(&emac, AT91_EMAC_ELR) + at91_emac_read(&emac, AT91_EMAC_USF);
 		dev->stats.rx_length_errors += lenerr;				/* Excessive Length or Undersize Frame error */
-		seqe = at91_emac_read(AT91_EMAC_SEQE);
+		seqe = at91_emac_read(&emac, AT91_EMAC_SEQE);
 		dev->stats.rx_crc_errors += seqe;				/* CRC error */
-		dev->stats.rx_fifo_errors += at91_emac_read(AT91_EMAC_DRFC);	/* Receive buffer not available */
+		dev->stats.rx_fifo_errors += at91_emac_read(&emac, AT91_EMAC_DRFC);	/* Receive buffer not available */
 		dev->stats.rx_errors += (ale + lenerr + seqe
-			+ at91_emac_read(AT91_EMAC_CDE) + at91_emac_read(AT91_EMAC_RJB));
+			+ at91_emac_read(&emac, AT91_EMAC_CDE) + at91_emac_read(&emac, AT91_EMAC_RJB));
 
-		dev->stats.tx_packets += at91_emac_read(AT91_EMAC_FRA);		/* Frames successfully transmitted */
-		dev->stats.tx_fifo_errors += at91_emac_read(AT91_EMAC_TUE);	/* Transmit FIFO underruns */
-		dev->stats.tx_carrier_errors += at91_emac_read(AT91_EMAC_CSE);	/* Carrier Sense errors */
-		dev->stats.tx_heartbeat_errors += at91_emac_read(AT91_EMAC_SQEE);/* Heartbeat error */
+		dev->stats.tx_packets += at91_emac_read(&emac, AT91_EMAC_FRA);		/* Frames successfully transmitted */
+		dev->stats.tx_fifo_errors += at91_emac_read(&emac, AT91_EMAC_TUE);	/* Transmit FIFO underruns */
+		dev->stats.tx_carrier_errors += at91_emac_read(&emac, AT91_EMAC_CSE);	/* Carrier Sense errors */
+		dev->stats.tx_heartbeat_errors += at91_emac_read(&emac, AT91_EMAC_SQEE);/* Heartbeat error */
 
-		lcol = at91_emac_read(AT91_EMAC_LCOL);
-		ecol = at91_emac_read(AT91_EMAC_ECOL);
+		lcol = at91_emac_read(&emac, AT91_EMAC_LCOL);
+		ecol = at91_emac_read(&emac, AT91_EMAC_ECOL);
 		dev->stats.tx_window_errors += lcol;			/* Late collisions */
 		dev->stats.tx_aborted_errors += ecol;			/* 16 collisions */
 
-		dev->stats.collisions += (at91_emac_read(AT91_EMAC_SCOL) + at91_emac_read(AT91_EMAC_MCOL) + lcol + ecol);
+		dev->stats.collisions += (at91_emac_read(&emac, AT91_EMAC_SCOL) + at91_emac_read(&emac, AT91_EMAC_MCOL) + lcol + ecol);
 	}
 	return &dev->stats;
 }
 
 /*
- * Extract received frame from buffer descriptors and sent to upper layers.
- * (Called from interrupt context)
+ * Extract received frames from buffer descriptors and send them to upper
+ * layers, processing at most @budget frames.
+ * (Called from NAPI softirq context)
  */
-static void at91ether_rx(struct net_device *dev)
+static int at91ether_rx(struct net_device *dev, int budget)
 {
 	struct at91_private *lp = netdev_priv(dev);
-	struct recv_desc_bufs *dlist;
+	struct rbf_t *desc;
 	unsigned char *p_recv;
 	struct sk_buff *skb;
 	unsigned int pktlen;
-
-	dlist = lp->dlist;
-	while (dlist->descriptors[lp->rxBuffIndex].addr & EMAC_DESC_DONE) {
-		p_recv = dlist->recv_buf[lp->rxBuffIndex];
-		pktlen = dlist->descriptors[lp->rxBuffIndex].size & 0x7ff;	/* Length of frame including FCS */
-		skb = dev_alloc_skb(pktlen + 2);
+	int received = 0;
+
+	desc = &lp->rx_ring[lp->rxBuffIndex];
+	while (received < budget && (desc->addr & EMAC_DESC_DONE)) {
+		rmb();
+		p_recv = lp->rx_buffers + lp->rxBuffIndex * MAX_RBUFF_SZ;
+		pktlen = desc->size & 0x7ff;	/* Length of frame including FCS */
+		skb = netdev_alloc_skb_ip_align(dev, pktlen);
 		if (skb != NULL) {
-			skb_reserve(skb, 2);
 			memcpy(skb_put(skb, pktlen), p_recv, pktlen);
 
 			skb->protocol = eth_type_trans(skb, dev);
 			dev->stats.rx_bytes += pktlen;
-			netif_rx(skb);
+			netif_receive_skb(skb);
 		}
 		else {
 			dev->stats.rx_dropped += 1;
-			printk(KERN_NOTICE "%s: Memory squeeze, dropping packet.\n", dev->name);
+			if (net_ratelimit())
+				printk(KERN_NOTICE "%s: Memory squeeze, dropping packet.\n", dev->name);
 		}
 
-		if (dlist->descriptors[lp->rxBuffIndex].size & EMAC_MULTICAST)
+		if (desc->size & EMAC_MULTICAST)
 			dev->stats.multicast++;
 
-		dlist->descriptors[lp->rxBuffIndex].addr &= ~EMAC_DESC_DONE;	/* reset ownership bit */
-		if (lp->rxBuffIndex == MAX_RX_DESCR-1)				/* wrap after last buffer */
+		desc->addr &= ~EMAC_DESC_DONE;		/* reset ownership bit */
+		if (lp->rxBuffIndex == lp->rx_ring_size-1)	/* wrap after last buffer */
 			lp->rxBuffIndex = 0;
 		else
 			lp->rxBuffIndex++;
+		desc = &lp->rx_ring[lp->rxBuffIndex];
+		received++;
 	}
+
+	return received;
+}
+
+/*
+ * NAPI poll routine.  Receive interrupts stay disabled until the ring
+ * has been drained.
+ */
+static int at91ether_poll(struct napi_struct *napi, int budget)
+{
+	struct at91_private *lp = container_of(napi, struct at91_private, napi);
+	struct net_device *dev = lp->mii.dev;
+	int work_done;
+
+	work_done = at91ether_rx(dev, budget);
+	if (work_done < budget) {
+		napi_complete(napi);
+		at91_emac_write(&emac, AT91_EMAC_IER, AT91_EMAC_RCOM);
+
+		/*
+		 * A frame that completed before RCOM was re-enabled would not
+		 * raise an interrupt, so look at the ring once more.
+		 */
+		if ((lp->rx_ring[lp->rxBuffIndex].addr & EMAC_DESC_DONE) &&
+		    napi_reschedule(napi))
+			at91_emac_write(&emac, AT91_EMAC_IDR, AT91_EMAC_RCOM);
+	}
+
+	return work_done;
 }
 
 /*
@@ -922,10 +946,15 @@ static irqreturn_t at91ether_interrupt(int irq, void *dev_id)
 
 	/* MAC Interrupt Status register indicates what interrupts are pending.
 	   It is automatically cleared once read. */
-	intstatus = at91_emac_read(AT91_EMAC_ISR);
+	intstatus = at91_emac_read(&emac, AT91_EMAC_ISR);
 
-	if (intstatus & AT91_EMAC_RCOM)		/* Receive complete */
-		at91ether_rx(dev);
+	if (intstatus & AT91_EMAC_RCOM) {	/* Receive complete */
+		/* Defer the work to at91ether_poll() */
+		if (napi_schedule_prep(&lp->napi)) {
+			at91_emac_write(&emac, AT91_EMAC_IDR, AT91_EMAC_RCOM);
+			__napi_schedule(&lp->napi);
+		}
+	}
 
 	if (intstatus & AT91_EMAC_TCOM) {	/* Transmit complete */
 		/* The TCOM bit is set even if the transmission failed. */
@@ -942,9 +971,9 @@ static irqreturn_t at91ether_interrupt(int irq, void *dev_id)
 
 	/* Work-around for Errata #11 */
 	if (intstatus & AT91_EMAC_RBNA) {
-		ctl = at91_emac_read(AT91_EMAC_CTL);
-		at91_emac_write(AT91_EMAC_CTL, ctl & ~AT91_EMAC_RE);
-		at91_emac_write(AT91_EMAC_CTL, ctl | AT91_EMAC_RE);
+		ctl = at91_emac_read(&emac, AT91_EMAC_CTL);
+		at91_emac_write(&emac, AT91_EMAC_CTL, ctl & ~AT91_EMAC_RE);
+		at91_emac_write(&emac, AT91_EMAC_CTL, ctl | AT91_EMAC_RE);
 	}
 
 	if (intstatus & AT91_EMAC_ROVR)
@@ -1004,10 +1033,18 @@ static int __init at91ether_setup(unsigned long phy_type, unsigned short phy_add
 		return -EBUSY;
 	}
 
-	/* Allocate memory for DMA Receive descriptors */
+	/* Allocate memory for DMA Receive descriptors and buffers */
 	lp = netdev_priv(dev);
-	lp->dlist = (struct recv_desc_bufs *) dma_alloc_coherent(NULL, sizeof(struct recv_desc_bufs), (dma_addr_t *) &lp->dlist_phys, GFP_KERNEL);
-	if (lp->dlist == NULL) {
+	lp->rx_ring_size = clamp(rx_ring_size, MIN_RX_DESCR, MAX_RX_DESCR);
+	lp->rx_ring = dma_alloc_coherent(NULL, lp->rx_ring_size * sizeof(struct rbf_t), &lp->rx_ring_dma, GFP_KERNEL);
+	if (lp->rx_ring == NULL) {
+		free_irq(dev->irq, dev);
+		free_netdev(dev);
+		return -ENOMEM;
+	}
+	lp->rx_buffers = dma_alloc_coherent(NULL, lp->rx_ring_size * MAX_RBUFF_SZ, &lp->rx_buffers_dma, GFP_KERNEL);
+	if (lp->rx_buffers == NULL) {
+		dma_free_coherent(NULL, lp->rx_ring_size * sizeof(struct rbf_t), lp->rx_ring, lp->rx_ring_dma);
 		free_irq(dev->irq, dev);
 		free_netdev(dev);
 		return -ENOMEM;
@@ -1021,18 +1058,19 @@ static int __init at91ether_setup(unsigned long phy_type, unsigned short phy_add
 	ether_setup(dev);
 	dev->netdev_ops = &at91ether_netdev_ops;
 	dev->ethtool_ops = &at91ether_ethtool_ops;
+	netif_napi_add(dev, &lp->napi, at91ether_poll, AT91ETHER_NAPI_WEIGHT);
 
 	SET_NETDEV_DEV(dev, &pdev->dev);
 
 	get_mac_address(dev);		/* Get ethernet address and store it in dev->dev_addr */
 	update_mac_address(dev);	/* Program ethernet address into MAC */
 
-	at91_emac_write(AT91_EMAC_CTL, 0);
+	at91_emac_write(&emac, AT91_EMAC_CTL, 0);
 
 	if (lp->board_data.is_rmii)
-		at91_emac_write(AT91_EMAC_CFG, AT91_EMAC_CLK_DIV32 | AT91_EMAC_BIG | AT91_EMAC_RMII);
+		at91_emac_write(&emac, AT91_EMAC_CFG, AT91_EMAC_CLK_DIV32 | AT91_EMAC_BIG | AT91_EMAC_RMII);
 	else
-		at91_emac_write(AT91_EMAC_CFG, AT91_EMAC_CLK_DIV32 | AT91_EMAC_BIG);
+		at91_emac_write(&emac, AT91_EMAC_CFG, AT91_EMAC_CLK_DIV32 | AT91_EMAC_BIG);
 
 	/* Perform PHY-specific initialization */
 	spin_lock_irq(&lp->lock);
@@ -1064,8 +1102,9 @@ static int __init at91ether_setup(unsigned long phy_type, unsigned short phy_add
 	res = register_netdev(dev);
 	if (res) {
 		free_irq(dev->irq, dev);
+		dma_free_coherent(NULL, lp->rx_ring_size * MAX_RBUFF_SZ, lp->rx_buffers, lp->rx_buffers_dma);
+		dma_free_coherent(NULL, lp->rx_ring_size * sizeof(struct rbf_t), lp->rx_ring, lp->rx_ring_dma);
 		free_netdev(dev);
-		dma_free_coherent(NULL, sizeof(struct recv_desc_bufs), lp->dlist, (dma_addr_t)lp->dlist_phys);
 		return res;
 	}
 
@@ -1088,8 +1127,8 @@ static int __init at91ether_setup(unsigned long phy_type, unsigned short phy_add
 	/* Display ethernet banner */
 	printk(KERN_INFO "%s: AT91 ethernet at 0x%08x int=%d %s%s (%pM)\n",
 	       dev->name, (uint) dev->base_addr, dev->irq,
-	       at91_emac_read(AT91_EMAC_CFG) & AT91_EMAC_SPD ? "100-" : "10-",
-	       at91_emac_read(AT91_EMAC_CFG) & AT91_EMAC_FD ? "FullDuplex" : "HalfDuplex",
+	       at91_emac_read(&emac, AT91_EMAC_CFG) & AT91_EMAC_SPD ? "100-" : "10-",
+	       at91_emac_read(&emac, AT91_EMAC_CFG) & AT91_EMAC_FD ? "FullDuplex" : "HalfDuplex",
 	       dev->dev_addr);
 	if ((phy_type == MII_DM9161_ID) || (lp->phy_type == MII_DM9161A_ID))
 		printk(KERN_INFO "%s: Davicom 9161 PHY %s\n", dev->name, (lp->phy_media == PORT_FIBRE) ? "(Fiber)" : "(Copper)");
@@ -1176,7 +1215,8 @@ static int __devexit at91ether_remove(struct platform_device *pdev)
 
 	unregister_netdev(dev);
 	free_irq(dev->irq, dev);
-	dma_free_coherent(NULL, sizeof(struct recv_desc_bufs), lp->dlist, (dma_addr_t)lp->dlist_phys);
+	dma_free_coherent(NULL, lp->rx_ring_size * MAX_RBUFF_SZ, lp->rx_buffers, lp->rx_buffers_dma);
+	dma_free_coherent(NULL, lp->rx_ring_size * sizeof(struct rbf_t), lp->rx_ring, lp->rx_ring_dma);
 	clk_put(lp->ether_clk);
 
 	platform_set_drvdata(pdev, NULL);
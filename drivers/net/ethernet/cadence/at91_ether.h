@@ -61,7 +61,11 @@
 /* ........................................................................ */
 
 #define MAX_RBUFF_SZ	0x600		/* 1518 rounded up */
-#define MAX_RX_DESCR	9		/* max number of receive buffers */
+#define DEF_RX_DESCR	64		/* default number of receive buffers */
+#define MIN_RX_DESCR	4
+#define MAX_RX_DESCR	256		/* 384KB of coherent memory */
+
+#define AT91ETHER_NAPI_WEIGHT	64
 
 #define EMAC_DESC_DONE	0x00000001	/* bit for if DMA is done */
 #define EMAC_DESC_WRAP	0x00000002	/* bit for wrap */
@@ -76,12 +80,6 @@ struct rbf_t
 	unsigned long size;
 };
 
-struct recv_desc_bufs
-{
-	struct rbf_t descriptors[MAX_RX_DESCR];		/* must be on sizeof (rbf_t) boundary */
-	char recv_buf[MAX_RX_DESCR][MAX_RBUFF_SZ];	/* must be on long boundary */
-};
-
 struct at91_private
 {
 	struct mii_if_info mii;			/* ethtool support */
@@ -103,9 +101,13 @@ struct at91_private
 	int skb_length;				/* saved skb length for pci_unmap_single */
 
 	/* Receive */
+	struct napi_struct napi;
 	int rxBuffIndex;			/* index into receive descriptor list */
-	struct recv_desc_bufs *dlist;		/* descriptor list address */
-	struct recv_desc_bufs *dlist_phys;	/* descriptor list physical address */
+	int rx_ring_size;			/* number of receive descriptors */
+	struct rbf_t *rx_ring;			/* descriptor list address */
+	dma_addr_t rx_ring_dma;			/* descriptor list physical address */
+	unsigned char *rx_buffers;		/* receive buffers, MAX_RBUFF_SZ each */
+	dma_addr_t rx_buffers_dma;		/* receive buffers physical address */
 };
 
 #endif
@@ -17,6 +17,7 @@
 #include <linux/slab.h>
 #include <linux/init.h>
 #include <linux/interrupt.h>
+#include <linux/hrtimer.h>
 #include <linux/netdevice.h>
 #include <linux/etherdevice.h>
 #include <linux/dma-mapping.h>
@@ -32,6 +33,8 @@
 #define RX_BUFFER_SIZE		128
 #define RX_RING_SIZE		512
 #define RX_RING_BYTES		(sizeof(struct dma_desc) * RX_RING_SIZE)
+/* Retired RX pages kept for reuse, about twice what the RX ring spans */
+#define RX_PAGE_POOL_SIZE	(2 * RX_RING_SIZE * RX_BUFFER_SIZE / PAGE_SIZE)
 
 /* Make the IP header word-aligned (the ethernet header is 14 bytes) */
 #define RX_OFFSET		2
@@ -56,6 +59,26 @@
 #define MACB_RX_INT_FLAGS	(MACB_BIT(RCOMP) | MACB_BIT(RXUBR)	\
 				 | MACB_BIT(ISR_ROVR))
 
+/*
+ * Upper bound for the RX interrupt holdoff.  The ring holds about 40
+ * full-sized frames, i.e. ~5ms worth of traffic at 100 Mbit/s.
+ */
+#define MACB_MAX_COALESCE_USECS	1000
+
+/*
+ * In zero-copy mode, the RX ring is populated with 128-byte slices of
+ * pages which are attached to the received skb as page fragments.
+ * Frames no longer than rx_copybreak are still copied, and their
+ * buffers are given straight back to the hardware.
+ */
+static bool rx_zerocopy = true;
+module_param(rx_zerocopy, bool, 0444);
+MODULE_PARM_DESC(rx_zerocopy, "Hand page-backed RX buffers up the stack");
+
+static unsigned int rx_copybreak = 256;
+module_param(rx_copybreak, uint, 0644);
+MODULE_PARM_DESC(rx_copybreak, "Copy frames up to this size in zero-copy mode");
+
 static void __macb_set_hwaddr(struct macb *bp)
 {
 	u32 bottom;
@@ -294,10 +317,58 @@ static void macb_update_stats(struct macb *bp)
 		*p += __raw_readl(reg);
 }
 
+static void macb_tx_unmap(struct macb *bp, struct ring_info *rp)
+{
+	if (rp->mapped_as_page)
+		dma_unmap_page(&bp->pdev->dev, rp->mapping, rp->size,
+			       DMA_TO_DEVICE);
+	else
+		dma_unmap_single(&bp->pdev->dev, rp->mapping, rp->size,
+				 DMA_TO_DEVICE);
+	rp->skb = NULL;
+}
+
+static void macb_tx_kick(struct macb *bp)
+{
+	bp->tx_kicked = true;
+	macb_writel(bp, NCR, macb_readl(bp, NCR) | MACB_BIT(TSTART));
+}
+
+/*
+ * macb_start_xmit() only writes TSTART when the transmitter is idle, so
+ * frames queued while it is busy are picked up by the running DMA.  If
+ * the MAC stopped on a used descriptor before it saw them, or TSTART was
+ * ignored because the last frame was still going out, restart it here.
+ * Called with bp->lock held.
+ */
+static void macb_tx_restart(struct macb *bp)
+{
+	unsigned int entry;
+
+	if (!bp->tx_kicked)
+		return;
+
+	if (macb_readl(bp, TSR) & MACB_BIT(TGO))
+		return;
+
+	entry = (macb_readl(bp, TBQP) - bp->tx_ring_dma)
+		/ sizeof(struct dma_desc);
+	if (entry == bp->tx_head) {
+		/* Stopped at the end of the queue */
+		bp->tx_kicked = false;
+		return;
+	}
+
+	netdev_dbg(bp->dev, "restarting TX at entry %u (head %u)\n",
+		   entry, bp->tx_head);
+	macb_tx_kick(bp);
+}
+
 static void macb_tx(struct macb *bp)
 {
 	unsigned int tail;
 	unsigned int head;
+	unsigned int pkts_compl = 0, bytes_compl = 0;
 	u32 status;
 
 	status = macb_readl(bp, TSR);
@@ -329,17 +400,16 @@ static void macb_tx(struct macb *bp)
 			struct ring_info *rp = &bp->tx_skb[tail];
 			struct sk_buff *skb = rp->skb;
 
-			BUG_ON(skb == NULL);
-
 			rmb();
 
-			dma_unmap_single(&bp->pdev->dev, rp->mapping, skb->len,
-							 DMA_TO_DEVICE);
-			rp->skb = NULL;
-			dev_kfree_skb_irq(skb);
+			macb_tx_unmap(bp, rp);
+			if (skb)
+				dev_kfree_skb_irq(skb);
 		}
 
 		bp->tx_head = bp->tx_tail = 0;
+		bp->tx_kicked = false;
+		netdev_reset_queue(bp->dev);
 
 		/* Enable the transmitter again */
 		if (status & MACB_BIT(TGO))
@@ -356,28 +426,42 @@ static void macb_tx(struct macb *bp)
 
 	head = bp->tx_head;
 	for (tail = bp->tx_tail; tail != head; tail = NEXT_TX(tail)) {
-		struct ring_info *rp = &bp->tx_skb[tail];
-		struct sk_buff *skb = rp->skb;
+		struct ring_info *rp;
+		struct sk_buff *skb;
 		u32 bufstat;
 
-		BUG_ON(skb == NULL);
-
 		rmb();
 		bufstat = bp->tx_ring[tail].ctrl;
 
 		if (!(bufstat & MACB_BIT(TX_USED)))
 			break;
 
+		/*
+		 * The MAC only sets TX_USED in the first descriptor of a
+		 * frame; release all of its buffers up to the one holding
+		 * the skb.
+		 */
+		for (;; tail = NEXT_TX(tail)) {
+			BUG_ON(tail == head);
+
+			rp = &bp->tx_skb[tail];
+			skb = rp->skb;
+			macb_tx_unmap(bp, rp);
+			if (skb)
+				break;
+		}
+
 		netdev_dbg(bp->dev, "skb %u (data %p) TX complete\n",
 			   tail, skb->data);
-		dma_unmap_single(&bp->pdev->dev, rp->mapping, skb->len,
-				 DMA_TO_DEVICE);
 		bp->stats.tx_packets++;
 		bp->stats.tx_bytes += skb->len;
-		rp->skb = NULL;
+		pkts_compl++;
+		bytes_compl += skb->len;
 		dev_kfree_skb_irq(skb);
 	}
 
+	netdev_completed_queue(bp->dev, pkts_compl, bytes_compl);
+
 	bp->tx_tail = tail;
 	if (netif_queue_stopped(bp->dev) &&
 	    TX_BUFFS_AVAIL(bp) > MACB_TX_WAKEUP_THRESH)
@@ -443,6 +527,195 @@ static int macb_rx_frame(struct macb *bp, unsigned int first_frag,
 	return 0;
 }
 
+/*
+ * Retire the RX page that has been carved up and return the next one.
+ * Retired pages wait in bp->rx_page_pool; by the time one comes round
+ * again its slices have normally been replaced in the RX ring and
+ * released by the stack, and a page only the driver still holds is
+ * carved up again instead of allocating a new one.
+ */
+static struct page *macb_rx_page_next(struct macb *bp, gfp_t gfp)
+{
+	struct page **slot = &bp->rx_page_pool[bp->rx_page_pool_next];
+	struct page *page = *slot;
+
+	*slot = bp->rx_page;
+	bp->rx_page_pool_next = (bp->rx_page_pool_next + 1) % RX_PAGE_POOL_SIZE;
+
+	if (page && page_count(page) == 1)
+		return page;
+	if (page)
+		put_page(page);
+
+	return alloc_page(gfp);
+}
+
+/*
+ * Attach the next free RX_BUFFER_SIZE slice of the current RX page to
+ * @rp and map it for the device.
+ */
+static int macb_rx_page_alloc(struct macb *bp, struct macb_rx_page *rp,
+			      gfp_t gfp)
+{
+	struct page *page = bp->rx_page;
+	dma_addr_t mapping;
+
+	if (!page || bp->rx_page_offset >= PAGE_SIZE) {
+		page = macb_rx_page_next(bp, gfp);
+		bp->rx_page = page;
+		bp->rx_page_offset = 0;
+		if (!page)
+			return -ENOMEM;
+	}
+
+	mapping = dma_map_page(&bp->pdev->dev, page, bp->rx_page_offset,
+			       RX_BUFFER_SIZE, DMA_FROM_DEVICE);
+	if (dma_mapping_error(&bp->pdev->dev, mapping))
+		return -ENOMEM;
+
+	get_page(page);
+	rp->page = page;
+	rp->offset = bp->rx_page_offset;
+	rp->mapping = mapping;
+	bp->rx_page_offset += RX_BUFFER_SIZE;
+
+	return 0;
+}
+
+/* Give a page-backed RX buffer that has been looked at back to the MAC */
+static void macb_rx_page_recycle(struct macb *bp, unsigned int entry)
+{
+	dma_sync_single_for_device(&bp->pdev->dev, bp->rx_pages[entry].mapping,
+				   RX_BUFFER_SIZE, DMA_FROM_DEVICE);
+	bp->rx_ring[entry].addr &= ~MACB_BIT(RX_USED);
+}
+
+static void macb_rx_page_set_desc(struct macb *bp, unsigned int entry)
+{
+	u32 addr = bp->rx_pages[entry].mapping;
+
+	if (entry == RX_RING_SIZE - 1)
+		addr |= MACB_BIT(RX_WRAP);
+	bp->rx_ring[entry].addr = addr;
+}
+
+/*
+ * Zero-copy version of macb_rx_frame().  The first fragment, which
+ * holds the headers, is copied into the linear part of the skb; the
+ * remaining fragments are unmapped and attached as page fragments, and
+ * their descriptors are refilled with fresh slices.
+ */
+static int macb_rx_frame_pages(struct macb *bp, unsigned int first_frag,
+			       unsigned int last_frag)
+{
+	struct device *dmadev = &bp->pdev->dev;
+	struct macb_rx_page *rp;
+	struct macb_rx_page new;
+	unsigned int len;
+	unsigned int frag;
+	unsigned int offset = 0;
+	unsigned int copy_len;
+	struct sk_buff *skb;
+
+	len = MACB_BFEXT(RX_FRMLEN, bp->rx_ring[last_frag].ctrl);
+
+	netdev_dbg(bp->dev, "macb_rx_frame_pages frags %u - %u (len %u)\n",
+		   first_frag, last_frag, len);
+
+	copy_len = len <= rx_copybreak ? len : min_t(unsigned int, len, RX_BUFFER_SIZE);
+	skb = netdev_alloc_skb(bp->dev, copy_len + RX_OFFSET);
+	if (!skb)
+		goto drop;
+
+	skb_reserve(skb, RX_OFFSET);
+	skb_checksum_none_assert(skb);
+
+	for (frag = first_frag; ; frag = NEXT_RX(frag)) {
+		unsigned int frag_len = RX_BUFFER_SIZE;
+		int nr_frags;
+
+		if (offset + frag_len > len) {
+			BUG_ON(frag != last_frag);
+			frag_len = len - offset;
+		}
+		rp = &bp->rx_pages[frag];
+
+		if (offset < copy_len) {
+			dma_sync_single_for_cpu(dmadev, rp->mapping,
+						RX_BUFFER_SIZE,
+						DMA_FROM_DEVICE);
+			memcpy(skb_put(skb, frag_len),
+			       page_address(rp->page) + rp->offset, frag_len);
+			macb_rx_page_recycle(bp, frag);
+			goto next;
+		}
+
+		/* Replace the buffer before handing this one to the stack */
+		if (macb_rx_page_alloc(bp, &new, GFP_ATOMIC)) {
+			kfree_skb(skb);
+			goto drop_from;
+		}
+
+		dma_unmap_page(dmadev, rp->mapping, RX_BUFFER_SIZE,
+			       DMA_FROM_DEVICE);
+
+		nr_frags = skb_shinfo(skb)->nr_frags;
+		if (nr_frags) {
+			skb_frag_t *last = &skb_shinfo(skb)->frags[nr_frags - 1];
+
+			if (skb_frag_page(last) == rp->page &&
+			    last->page_offset + skb_frag_size(last) ==
+			    rp->offset) {
+				/* Contiguous with the previous slice */
+				skb_frag_size_add(last, frag_len);
+				skb->len += frag_len;
+				skb->data_len += frag_len;
+				skb->truesize += RX_BUFFER_SIZE;
+				put_page(rp->page);
+				nr_frags = -1;
+			}
+		}
+		if (nr_frags >= 0) {
+			/* skb_add_rx_frag() only accounts frag_len */
+			skb_add_rx_frag(skb, nr_frags, rp->page, rp->offset,
+					frag_len);
+			skb->truesize += RX_BUFFER_SIZE - frag_len;
+		}
+
+		*rp = new;
+		macb_rx_page_set_desc(bp, frag);
+
+next:
+		offset += RX_BUFFER_SIZE;
+		wmb();
+
+		if (frag == last_frag)
+			break;
+	}
+
+	skb->protocol = eth_type_trans(skb, bp->dev);
+
+	bp->stats.rx_packets++;
+	bp->stats.rx_bytes += len;
+	netdev_dbg(bp->dev, "received skb of length %u, %u frags\n",
+		   skb->len, skb_shinfo(skb)->nr_frags);
+	netif_receive_skb(skb);
+
+	return 0;
+
+drop:
+	frag = first_frag;
+drop_from:
+	bp->stats.rx_dropped++;
+	for (; ; frag = NEXT_RX(frag)) {
+		bp->rx_ring[frag].addr &= ~MACB_BIT(RX_USED);
+		if (frag == last_frag)
+			break;
+	}
+	wmb();
+	return 1;
+}
+
 /* Mark DMA descriptors from begin up to and not including end as unused */
 static void discard_partial_frame(struct macb *bp, unsigned int begin,
 				  unsigned int end)
@@ -486,7 +759,11 @@ static int macb_rx(struct macb *bp, int budget)
 			int dropped;
 			BUG_ON(first_frag == -1);
 
-			dropped = macb_rx_frame(bp, first_frag, tail);
+			if (bp->rx_zerocopy)
+				dropped = macb_rx_frame_pages(bp, first_frag,
+							      tail);
+			else
+				dropped = macb_rx_frame(bp, first_frag, tail);
 			first_frag = -1;
 			if (!dropped) {
 				received++;
@@ -503,9 +780,60 @@ static int macb_rx(struct macb *bp, int budget)
 	return received;
 }
 
+/*
+ * Pick the RX interrupt holdoff for the next round.  In adaptive mode
+ * the received packet rate is sampled every rate_sample_interval
+ * seconds and the holdoff is interpolated between the low and high
+ * settings.
+ */
+static void macb_rx_coalesce_update(struct macb *bp, int work_done)
+{
+	struct ethtool_coalesce *ec = &bp->coalesce;
+	unsigned long elapsed;
+	unsigned int rate;
+
+	if (!ec->use_adaptive_rx_coalesce) {
+		bp->rx_coalesce_usecs = ec->rx_coalesce_usecs;
+		return;
+	}
+
+	bp->rx_rate_pkts += work_done;
+	elapsed = jiffies - bp->rx_rate_stamp;
+	if (elapsed < ec->rate_sample_interval * HZ)
+		return;
+
+	rate = bp->rx_rate_pkts * HZ / elapsed;
+	if (rate <= ec->pkt_rate_low)
+		bp->rx_coalesce_usecs = ec->rx_coalesce_usecs_low;
+	else if (rate >= ec->pkt_rate_high)
+		bp->rx_coalesce_usecs = ec->rx_coalesce_usecs_high;
+	else
+		bp->rx_coalesce_usecs = ec->rx_coalesce_usecs_low +
+			(ec->rx_coalesce_usecs_high -
+			 ec->rx_coalesce_usecs_low) *
+			(rate - ec->pkt_rate_low) /
+			(ec->pkt_rate_high - ec->pkt_rate_low);
+
+	netdev_dbg(bp->dev, "RX rate %u pkt/s, holdoff %u us\n",
+		   rate, bp->rx_coalesce_usecs);
+
+	bp->rx_rate_stamp = jiffies;
+	bp->rx_rate_pkts = 0;
+}
+
+static enum hrtimer_restart macb_rx_coalesce_timer(struct hrtimer *timer)
+{
+	struct macb *bp = container_of(timer, struct macb, rx_coalesce_timer);
+
+	napi_schedule(&bp->napi);
+
+	return HRTIMER_NORESTART;
+}
+
 static int macb_poll(struct napi_struct *napi, int budget)
 {
 	struct macb *bp = container_of(napi, struct macb, napi);
+	unsigned int usecs;
 	int work_done;
 	u32 status;
 
@@ -521,11 +849,30 @@ static int macb_poll(struct napi_struct *napi, int budget)
 	if (work_done < budget) {
 		napi_complete(napi);
 
-		/*
-		 * We've done what we can to clean the buffers. Make sure we
-		 * get notified when new packets arrive.
-		 */
-		macb_writel(bp, IER, MACB_RX_INT_FLAGS);
+		macb_rx_coalesce_update(bp, work_done);
+		usecs = bp->rx_coalesce_usecs;
+		if (work_done && usecs) {
+			/*
+			 * Traffic is flowing: leave RX interrupts masked and
+			 * come back after the holdoff, or earlier if we
+			 * expect rx_max_coalesced_frames to have arrived by
+			 * then.
+			 */
+			if (bp->coalesce.rx_max_coalesced_frames &&
+			    work_done > bp->coalesce.rx_max_coalesced_frames)
+				usecs = usecs *
+					bp->coalesce.rx_max_coalesced_frames /
+					work_done;
+			hrtimer_start(&bp->rx_coalesce_timer,
+				      ns_to_ktime(usecs * NSEC_PER_USEC),
+				      HRTIMER_MODE_REL);
+		} else {
+			/*
+			 * We've done what we can to clean the buffers. Make
+			 * sure we get notified when new packets arrive.
+			 */
+			macb_writel(bp, IER, MACB_RX_INT_FLAGS);
+		}
 	}
 
 	/* TODO: Handle errors */
@@ -573,6 +920,9 @@ static irqreturn_t macb_interrupt(int irq, void *dev_id)
 			    MACB_BIT(ISR_RLE)))
 			macb_tx(bp);
 
+		if (status & (MACB_BIT(TCOMP) | MACB_BIT(TXUBR)))
+			macb_tx_restart(bp);
+
 		/*
 		 * Link change detection isn't possible with RMII, so we'll
 		 * add that if/when we get our hands on a full-blown MII PHY.
@@ -621,8 +971,9 @@ static void macb_poll_controller(struct net_device *dev)
 static int macb_start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct macb *bp = netdev_priv(dev);
+	struct ring_info *rp;
 	dma_addr_t mapping;
-	unsigned int len, entry;
+	unsigned int len, entry, first, last, count, f;
 	u32 ctrl;
 	unsigned long flags;
 
@@ -635,11 +986,21 @@ static int macb_start_xmit(struct sk_buff *skb, struct net_device *dev)
 		       skb->data, 16, true);
 #endif
 
-	len = skb->len;
+	/*
+	 * No checksum offload, see macb_probe().  This walks the fragments
+	 * in place, so the skb is not linearized.
+	 */
+	if (skb->ip_summed == CHECKSUM_PARTIAL && skb_checksum_help(skb)) {
+		dev_kfree_skb(skb);
+		bp->stats.tx_dropped++;
+		return NETDEV_TX_OK;
+	}
+
+	count = skb_shinfo(skb)->nr_frags + 1;
 	spin_lock_irqsave(&bp->lock, flags);
 
 	/* This is a hard error, log it. */
-	if (TX_BUFFS_AVAIL(bp) < 1) {
+	if (TX_BUFFS_AVAIL(bp) < count) {
 		netif_stop_queue(dev);
 		spin_unlock_irqrestore(&bp->lock, flags);
 		netdev_err(bp->dev, "BUG! Tx Ring full when queue awake!\n");
@@ -648,32 +1009,76 @@ static int macb_start_xmit(struct sk_buff *skb, struct net_device *dev)
 		return NETDEV_TX_BUSY;
 	}
 
-	entry = bp->tx_head;
-	netdev_dbg(bp->dev, "Allocated ring entry %u\n", entry);
+	/* Map the linear part and every fragment, one descriptor each */
+	first = entry = bp->tx_head;
+	netdev_dbg(bp->dev, "Allocated ring entries %u+%u\n", entry, count);
+
+	len = skb_headlen(skb);
 	mapping = dma_map_single(&bp->pdev->dev, skb->data,
 				 len, DMA_TO_DEVICE);
-	bp->tx_skb[entry].skb = skb;
-	bp->tx_skb[entry].mapping = mapping;
+	rp = &bp->tx_skb[entry];
+	rp->skb = NULL;
+	rp->mapping = mapping;
+	rp->size = len;
+	rp->mapped_as_page = false;
 	netdev_dbg(bp->dev, "Mapped skb data %p to DMA addr %08lx\n",
 		   skb->data, (unsigned long)mapping);
 
-	ctrl = MACB_BF(TX_FRMLEN, len);
-	ctrl |= MACB_BIT(TX_LAST);
+	for (f = 0; f < skb_shinfo(skb)->nr_frags; f++) {
+		const skb_frag_t *frag = &skb_shinfo(skb)->frags[f];
+
+		entry = NEXT_TX(entry);
+		len = skb_frag_size(frag);
+		rp = &bp->tx_skb[entry];
+		rp->skb = NULL;
+		rp->mapping = skb_frag_dma_map(&bp->pdev->dev, frag, 0, len,
+					       DMA_TO_DEVICE);
+		rp->size = len;
+		rp->mapped_as_page = true;
+	}
+	last = entry;
+	bp->tx_skb[last].skb = skb;
+
+	/* Terminate the queue after this frame */
+	entry = NEXT_TX(last);
+	ctrl = MACB_BIT(TX_USED);
 	if (entry == (TX_RING_SIZE - 1))
 		ctrl |= MACB_BIT(TX_WRAP);
-
-	bp->tx_ring[entry].addr = mapping;
 	bp->tx_ring[entry].ctrl = ctrl;
+
+	/*
+	 * Fill in the descriptors back to front so that the MAC cannot
+	 * start on the frame before all of its buffers are in place.
+	 */
+	for (entry = last; ; entry = (entry - 1) & (TX_RING_SIZE - 1)) {
+		rp = &bp->tx_skb[entry];
+
+		ctrl = MACB_BF(TX_FRMLEN, rp->size);
+		if (entry == last)
+			ctrl |= MACB_BIT(TX_LAST);
+		if (entry == (TX_RING_SIZE - 1))
+			ctrl |= MACB_BIT(TX_WRAP);
+
+		bp->tx_ring[entry].addr = rp->mapping;
+		if (entry == first)
+			wmb();
+		bp->tx_ring[entry].ctrl = ctrl;
+
+		if (entry == first)
+			break;
+	}
 	wmb();
 
-	entry = NEXT_TX(entry);
-	bp->tx_head = entry;
+	bp->tx_head = NEXT_TX(last);
 
+	netdev_sent_queue(dev, skb->len);
 	skb_tx_timestamp(skb);
 
-	macb_writel(bp, NCR, macb_readl(bp, NCR) | MACB_BIT(TSTART));
+	/* A running transmitter will pick the frame up by itself */
+	if (!bp->tx_kicked)
+		macb_tx_kick(bp);
 
-	if (TX_BUFFS_AVAIL(bp) < 1)
+	if (TX_BUFFS_AVAIL(bp) < MAX_SKB_FRAGS + 1)
 		netif_stop_queue(dev);
 
 	spin_unlock_irqrestore(&bp->lock, flags);
@@ -681,8 +1086,64 @@ static int macb_start_xmit(struct sk_buff *skb, struct net_device *dev)
 	return NETDEV_TX_OK;
 }
 
+static void macb_free_rx_pages(struct macb *bp)
+{
+	struct macb_rx_page *rp;
+	int i;
+
+	for (i = 0; i < RX_RING_SIZE; i++) {
+		rp = &bp->rx_pages[i];
+		if (!rp->page)
+			continue;
+		dma_unmap_page(&bp->pdev->dev, rp->mapping, RX_BUFFER_SIZE,
+			       DMA_FROM_DEVICE);
+		put_page(rp->page);
+		rp->page = NULL;
+	}
+
+	if (bp->rx_page) {
+		put_page(bp->rx_page);
+		bp->rx_page = NULL;
+	}
+	if (bp->rx_page_pool) {
+		for (i = 0; i < RX_PAGE_POOL_SIZE; i++)
+			if (bp->rx_page_pool[i])
+				put_page(bp->rx_page_pool[i]);
+		kfree(bp->rx_page_pool);
+		bp->rx_page_pool = NULL;
+	}
+	kfree(bp->rx_pages);
+	bp->rx_pages = NULL;
+}
+
+static int macb_alloc_rx_pages(struct macb *bp)
+{
+	int i;
+
+	bp->rx_pages = kcalloc(RX_RING_SIZE, sizeof(struct macb_rx_page),
+			       GFP_KERNEL);
+	if (!bp->rx_pages)
+		return -ENOMEM;
+	bp->rx_page_pool = kcalloc(RX_PAGE_POOL_SIZE, sizeof(struct page *),
+				   GFP_KERNEL);
+	if (!bp->rx_page_pool)
+		return -ENOMEM;
+	bp->rx_page_pool_next = 0;
+
+	for (i = 0; i < RX_RING_SIZE; i++)
+		if (macb_rx_page_alloc(bp, &bp->rx_pages[i], GFP_KERNEL))
+			return -ENOMEM;
+
+	netdev_dbg(bp->dev, "Allocated %d page-backed RX buffers\n",
+		   RX_RING_SIZE);
+
+	return 0;
+}
+
 static void macb_free_consistent(struct macb *bp)
 {
+	if (bp->rx_pages)
+		macb_free_rx_pages(bp);
 	if (bp->tx_skb) {
 		kfree(bp->tx_skb);
 		bp->tx_skb = NULL;
@@ -732,6 +1193,12 @@ static int macb_alloc_consistent(struct macb *bp)
 		   "Allocated TX ring of %d bytes at %08lx (mapped %p)\n",
 		   size, (unsigned long)bp->tx_ring_dma, bp->tx_ring);
 
+	if (bp->rx_zerocopy) {
+		if (macb_alloc_rx_pages(bp))
+			goto out_err;
+		return 0;
+	}
+
 	size = RX_RING_SIZE * RX_BUFFER_SIZE;
 	bp->rx_buffers = dma_alloc_coherent(&bp->pdev->dev, size,
 					    &bp->rx_buffers_dma, GFP_KERNEL);
@@ -753,13 +1220,20 @@ static void macb_init_rings(struct macb *bp)
 	int i;
 	dma_addr_t addr;
 
-	addr = bp->rx_buffers_dma;
-	for (i = 0; i < RX_RING_SIZE; i++) {
-		bp->rx_ring[i].addr = addr;
-		bp->rx_ring[i].ctrl = 0;
-		addr += RX_BUFFER_SIZE;
+	if (bp->rx_zerocopy) {
+		for (i = 0; i < RX_RING_SIZE; i++) {
+			macb_rx_page_set_desc(bp, i);
+			bp->rx_ring[i].ctrl = 0;
+		}
+	} else {
+		addr = bp->rx_buffers_dma;
+		for (i = 0; i < RX_RING_SIZE; i++) {
+			bp->rx_ring[i].addr = addr;
+			bp->rx_ring[i].ctrl = 0;
+			addr += RX_BUFFER_SIZE;
+		}
+		bp->rx_ring[RX_RING_SIZE - 1].addr |= MACB_BIT(RX_WRAP);
 	}
-	bp->rx_ring[RX_RING_SIZE - 1].addr |= MACB_BIT(RX_WRAP);
 
 	for (i = 0; i < TX_RING_SIZE; i++) {
 		bp->tx_ring[i].addr = 0;
@@ -768,6 +1242,7 @@ static void macb_init_rings(struct macb *bp)
 	bp->tx_ring[TX_RING_SIZE - 1].ctrl |= MACB_BIT(TX_WRAP);
 
 	bp->rx_tail = bp->tx_head = bp->tx_tail = 0;
+	bp->tx_kicked = false;
 }
 
 static void macb_reset_hw(struct macb *bp)
@@ -901,6 +1376,7 @@ static void macb_init_hw(struct macb *bp)
 	/* Enable interrupts */
 	macb_writel(bp, IER, (MACB_BIT(RCOMP)
 			      | MACB_BIT(RXUBR)
+			      | MACB_BIT(TXUBR)
 			      | MACB_BIT(ISR_TUND)
 			      | MACB_BIT(ISR_RLE)
 			      | MACB_BIT(TXERR)
@@ -1051,6 +1527,7 @@ static int macb_open(struct net_device *dev)
 
 	macb_init_rings(bp);
 	macb_init_hw(bp);
+	netdev_reset_queue(dev);
 
 	/* schedule a link state check */
 	phy_start(bp->phy_dev);
@@ -1066,7 +1543,13 @@ static int macb_close(struct net_device *dev)
 	unsigned long flags;
 
 	netif_stop_queue(dev);
+	/*
+	 * Keep a pending holdoff from scheduling NAPI while it is being
+	 * disabled, then catch one armed by a poll still running.
+	 */
+	hrtimer_cancel(&bp->rx_coalesce_timer);
 	napi_disable(&bp->napi);
+	hrtimer_cancel(&bp->rx_coalesce_timer);
 
 	if (bp->phy_dev)
 		phy_stop(bp->phy_dev);
@@ -1208,11 +1691,68 @@ static void macb_get_drvinfo(struct net_device *dev,
 	strcpy(info->bus_info, dev_name(&bp->pdev->dev));
 }
 
+static int macb_get_coalesce(struct net_device *dev,
+			     struct ethtool_coalesce *ec)
+{
+	struct macb *bp = netdev_priv(dev);
+	struct ethtool_coalesce *c = &bp->coalesce;
+
+	ec->rx_coalesce_usecs = c->rx_coalesce_usecs;
+	ec->rx_max_coalesced_frames = c->rx_max_coalesced_frames;
+	ec->use_adaptive_rx_coalesce = c->use_adaptive_rx_coalesce;
+	ec->rx_coalesce_usecs_low = c->rx_coalesce_usecs_low;
+	ec->rx_coalesce_usecs_high = c->rx_coalesce_usecs_high;
+	ec->pkt_rate_low = c->pkt_rate_low;
+	ec->pkt_rate_high = c->pkt_rate_high;
+	ec->rate_sample_interval = c->rate_sample_interval;
+
+	return 0;
+}
+
+/*
+ * The MAC has no interrupt moderation of its own; macb_poll() emulates
+ * it by keeping RX interrupts masked and re-polling from an hrtimer.
+ * TX completions are always handled from the interrupt.
+ */
+static int macb_set_coalesce(struct net_device *dev,
+			     struct ethtool_coalesce *ec)
+{
+	struct macb *bp = netdev_priv(dev);
+	unsigned long flags;
+
+	if (ec->rx_coalesce_usecs > MACB_MAX_COALESCE_USECS ||
+	    ec->rx_coalesce_usecs_low > MACB_MAX_COALESCE_USECS ||
+	    ec->rx_coalesce_usecs_high > MACB_MAX_COALESCE_USECS)
+		return -EINVAL;
+
+	if (ec->use_adaptive_rx_coalesce &&
+	    (!ec->rate_sample_interval ||
+	     ec->pkt_rate_high <= ec->pkt_rate_low ||
+	     ec->rx_coalesce_usecs_low > ec->rx_coalesce_usecs_high))
+		return -EINVAL;
+
+	if (ec->tx_coalesce_usecs || ec->tx_max_coalesced_frames ||
+	    ec->use_adaptive_tx_coalesce)
+		return -EOPNOTSUPP;
+
+	spin_lock_irqsave(&bp->lock, flags);
+	bp->coalesce = *ec;
+	bp->rx_coalesce_usecs = ec->use_adaptive_rx_coalesce ?
+		ec->rx_coalesce_usecs_low : ec->rx_coalesce_usecs;
+	bp->rx_rate_stamp = jiffies;
+	bp->rx_rate_pkts = 0;
+	spin_unlock_irqrestore(&bp->lock, flags);
+
+	return 0;
+}
+
 static const struct ethtool_ops macb_ethtool_ops = {
 	.get_settings		= macb_get_settings,
 	.set_settings		= macb_set_settings,
 	.get_drvinfo		= macb_get_drvinfo,
 	.get_link		= ethtool_op_get_link,
+	.get_coalesce		= macb_get_coalesce,
+	.set_coalesce		= macb_set_coalesce,
 };
 
 static int macb_ioctl(struct net_device *dev, struct ifreq *rq, int cmd)
@@ -1315,8 +1855,14 @@ static int __init macb_probe(struct platform_device *pdev)
 
 	SET_NETDEV_DEV(dev, &pdev->dev);
 
-	/* TODO: Actually, we have some interesting features... */
-	dev->features |= 0;
+	/*
+	 * The core only allows scatter-gather together with a checksum
+	 * feature.  The MAC cannot checksum, so macb_start_xmit() finishes
+	 * CHECKSUM_PARTIAL skbs in software; that costs less on these CPUs
+	 * than linearizing every fragmented skb.
+	 */
+	dev->hw_features = NETIF_F_SG | NETIF_F_IP_CSUM;
+	dev->features |= dev->hw_features;
 
 	bp = netdev_priv(dev);
 	bp->pdev = pdev;
@@ -1357,6 +1903,15 @@ static int __init macb_probe(struct platform_device *pdev)
 	netif_napi_add(dev, &bp->napi, macb_poll, 64);
 	dev->ethtool_ops = &macb_ethtool_ops;
 
+	hrtimer_init(&bp->rx_coalesce_timer, CLOCK_MONOTONIC,
+		     HRTIMER_MODE_REL);
+	bp->rx_coalesce_timer.function = macb_rx_coalesce_timer;
+	bp->coalesce.rate_sample_interval = 1;
+	bp->coalesce.pkt_rate_low = 2000;
+	bp->coalesce.pkt_rate_high = 20000;
+	bp->coalesce.rx_coalesce_usecs_high = 250;
+	bp->rx_rate_stamp = jiffies;
+
 	dev->base_addr = regs->start;
 
 	/* Set MII management clock divider */
@@ -1394,6 +1949,7 @@ static int __init macb_probe(struct platform_device *pdev)
 #endif
 
 	bp->tx_pending = DEF_TX_RING_PENDING;
+	bp->rx_zerocopy = rx_zerocopy;
 
 	err = register_netdev(dev);
 	if (err) {
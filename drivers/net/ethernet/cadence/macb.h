@@ -420,6 +420,19 @@ struct dma_desc {
 struct ring_info {
 	struct sk_buff		*skb;
 	dma_addr_t		mapping;
+	unsigned int		size;
+	bool			mapped_as_page;
+};
+
+/*
+ * Page-backed receive buffer.  In zero-copy mode every RX descriptor
+ * points into a page fragment which is handed up the stack as part of
+ * an skb instead of being copied out.
+ */
+struct macb_rx_page {
+	struct page		*page;
+	unsigned int		offset;
+	dma_addr_t		mapping;
 };
 
 /*
@@ -504,10 +517,21 @@ struct macb {
 	unsigned int		rx_tail;
 	struct dma_desc		*rx_ring;
 	void			*rx_buffers;
+	struct macb_rx_page	*rx_pages;
+
+	/* page currently being carved into RX buffers (zero-copy mode) */
+	struct page		*rx_page;
+	unsigned int		rx_page_offset;
+	/* carved-up pages waiting to be reused, see macb_rx_page_next() */
+	struct page		**rx_page_pool;
+	unsigned int		rx_page_pool_next;
+	bool			rx_zerocopy;
 
 	unsigned int		tx_head, tx_tail;
 	struct dma_desc		*tx_ring;
 	struct ring_info	*tx_skb;
+	/* TSTART written and the transmitter not yet seen idle */
+	bool			tx_kicked;
 
 	spinlock_t		lock;
 	struct platform_device	*pdev;
@@ -516,6 +540,14 @@ struct macb {
 	struct net_device	*dev;
 	struct napi_struct	napi;
 	struct net_device_stats	stats;
+
+	/* Software RX interrupt moderation, see macb_poll() */
+	struct ethtool_coalesce	coalesce;
+	struct hrtimer		rx_coalesce_timer;
+	unsigned int		rx_coalesce_usecs;
+	unsigned long		rx_rate_stamp;
+	unsigned int		rx_rate_pkts;
+
 	union {
 		struct macb_stats	macb;
 		struct gem_stats	gem;
@@ -15,16 +15,23 @@
 #include <linux/platform_device.h>
 #include <linux/delay.h>
 #include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
 #include <linux/err.h>
 #include <linux/interrupt.h>
+#include <linux/scatterlist.h>
 #include <linux/spi/spi.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
 
 #include <asm/io.h>
 #include <mach/board.h>
 #include <asm/gpio.h>
 #include <mach/cpu.h>
 
+#ifdef CONFIG_SPI_ATMEL_DMA
+#include <mach/at_hdmac.h>
+#endif
+
 /* SPI register offsets */
 #define SPI_CR					0x0000
 #define SPI_MR					0x0004
@@ -181,9 +188,25 @@
 
 
 /*
- * The core SPI transfer engine just talks to a register bank to set up
- * DMA transfers; transfer queue progress is driven by IRQs.  The clock
- * framework provides the base clock, subdivided for each spi_device.
+ * Transfers are cut into chunks which the PDC or the DMA engine can do
+ * in one go.  A chunk never exceeds half the scratch buffer: the first
+ * half is all zeroes and feeds transfers without tx_buf, the second one
+ * swallows data for transfers without rx_buf.
+ */
+struct atmel_spi_chunk {
+	dma_addr_t		tx_dma;
+	dma_addr_t		rx_dma;
+	u32			len;
+};
+
+#define ATMEL_SPI_MAX_SG	16
+
+/*
+ * Messages are queued and run one after the other by a pump on a
+ * dedicated workqueue.  Runs of transfers which don't need the chip
+ * select or a delay in between are handed to the DMA hardware as one
+ * batch; short transfers are done by PIO instead.  The clock framework
+ * provides the base clock, subdivided for each spi_device.
  */
 struct atmel_spi {
 	spinlock_t		lock;
@@ -196,10 +219,26 @@ struct atmel_spi {
 
 	u8			stopping;
 	struct list_head	queue;
-	struct spi_transfer	*current_transfer;
-	unsigned long		current_remaining_bytes;
-	struct spi_transfer	*next_transfer;
-	unsigned long		next_remaining_bytes;
+	struct workqueue_struct	*workqueue;
+	struct work_struct	work;
+
+	/* the batch being transferred */
+	struct spi_transfer	*cur_xfer;
+	struct spi_transfer	*last_xfer;
+	u32			cur_offset;
+	u8			bytes_per_word;
+	u8			pdc_loaded;
+	int			xfer_status;
+	struct completion	xfer_done;
+	unsigned long		timeout;	/* jiffies, for the batch */
+
+	/* dmaengine, when the SoC wires the SPI to its DMA controller */
+	struct at_dma_slave	*dma_rx_slave;
+	struct at_dma_slave	*dma_tx_slave;
+	struct dma_chan		*chan_rx;
+	struct dma_chan		*chan_tx;
+	struct scatterlist	sg_rx[ATMEL_SPI_MAX_SG];
+	struct scatterlist	sg_tx[ATMEL_SPI_MAX_SG];
 
 	void			*buffer;
 	dma_addr_t		buffer_dma;
@@ -212,8 +251,17 @@ struct atmel_spi_device {
 };
 
 #define BUFFER_SIZE		PAGE_SIZE
+#define SCRATCH_SIZE		(BUFFER_SIZE / 2)
 #define INVALID_DMA_ADDRESS	0xffffffff
 
+/* PDC and DMA controller transfer counters are 16 bits wide, in words */
+#define MAX_CHUNK_WORDS		0xffff
+
+/* transfers up to this size are not worth setting up DMA for */
+static unsigned int pio_max_len = 16;
+module_param(pio_max_len, uint, 0644);
+MODULE_PARM_DESC(pio_max_len, "Longest transfer done by PIO (bytes)");
+
 /*
  * Version 2 of the SPI controller has
  *  - CR.LASTXFER
@@ -332,153 +380,446 @@ static inline int atmel_spi_xfer_can_be_chained(struct spi_transfer *xfer)
 	return xfer->delay_usecs == 0 && !xfer->cs_change;
 }
 
-static void atmel_spi_next_xfer_data(struct spi_master *master,
-				struct spi_transfer *xfer,
-				dma_addr_t *tx_dma,
-				dma_addr_t *rx_dma,
-				u32 *plen)
+/*
+ * For DMA, tx_buf/tx_dma have the same relationship as rx_buf/rx_dma:
+ *  - The buffer is either valid for CPU access, else NULL
+ *  - If the buffer is valid, so is its DMA address
+ *
+ * This driver manages the dma address unless message->is_dma_mapped.
+ * Transfers done by PIO are never mapped.
+ */
+static int
+atmel_spi_dma_map_xfer(struct device *dev, struct spi_transfer *xfer)
 {
-	struct atmel_spi	*as = spi_master_get_devdata(master);
-	u32			len = *plen;
-
-	/* use scratch buffer only when rx or tx data is unspecified */
-	if (xfer->rx_buf)
-		*rx_dma = xfer->rx_dma + xfer->len - *plen;
-	else {
-		*rx_dma = as->buffer_dma;
-		if (len > BUFFER_SIZE)
-			len = BUFFER_SIZE;
+	xfer->tx_dma = xfer->rx_dma = INVALID_DMA_ADDRESS;
+	if (xfer->tx_buf) {
+		/* tx_buf is a const void* where we need a void * for the dma
+		 * mapping */
+		void *nonconst_tx = (void *)xfer->tx_buf;
+
+		xfer->tx_dma = dma_map_single(dev,
+				nonconst_tx, xfer->len,
+				DMA_TO_DEVICE);
+		if (dma_mapping_error(dev, xfer->tx_dma))
+			return -ENOMEM;
 	}
-	if (xfer->tx_buf)
-		*tx_dma = xfer->tx_dma + xfer->len - *plen;
-	else {
-		*tx_dma = as->buffer_dma;
-		if (len > BUFFER_SIZE)
-			len = BUFFER_SIZE;
-		memset(as->buffer, 0, len);
-		dma_sync_single_for_device(&as->pdev->dev,
-				as->buffer_dma, len, DMA_TO_DEVICE);
+	if (xfer->rx_buf) {
+		xfer->rx_dma = dma_map_single(dev,
+				xfer->rx_buf, xfer->len,
+				DMA_FROM_DEVICE);
+		if (dma_mapping_error(dev, xfer->rx_dma)) {
+			if (xfer->tx_buf)
+				dma_unmap_single(dev,
+						xfer->tx_dma, xfer->len,
+						DMA_TO_DEVICE);
+			return -ENOMEM;
+		}
 	}
+	return 0;
+}
 
-	*plen = len;
+static void atmel_spi_dma_unmap_xfer(struct device *dev,
+				     struct spi_transfer *xfer)
+{
+	if (xfer->tx_dma != INVALID_DMA_ADDRESS)
+		dma_unmap_single(dev, xfer->tx_dma,
+				 xfer->len, DMA_TO_DEVICE);
+	if (xfer->rx_dma != INVALID_DMA_ADDRESS)
+		dma_unmap_single(dev, xfer->rx_dma,
+				 xfer->len, DMA_FROM_DEVICE);
 }
 
 /*
- * Submit next transfer for DMA.
- * lock is held, spi irq is blocked
+ * Produce the next chunk of the batch cur_xfer..last_xfer.
+ * Called with the lock held from the pump, or from the PDC interrupt.
  */
-static void atmel_spi_next_xfer(struct spi_master *master,
-				struct spi_message *msg)
+static bool atmel_spi_next_chunk(struct atmel_spi *as,
+				 struct atmel_spi_chunk *chunk)
 {
-	struct atmel_spi	*as = spi_master_get_devdata(master);
-	struct spi_transfer	*xfer;
-	u32			len, remaining;
-	u32			ieval;
-	dma_addr_t		tx_dma, rx_dma;
+	struct spi_transfer	*xfer = as->cur_xfer;
+	u32			max_len;
+
+	while (xfer) {
+		if (as->cur_offset < xfer->len) {
+			/* a missing buffer is stood in for by the scratch one */
+			if (xfer->tx_buf && xfer->rx_buf)
+				max_len = MAX_CHUNK_WORDS * as->bytes_per_word;
+			else
+				max_len = SCRATCH_SIZE;
+			chunk->len = min_t(u32, xfer->len - as->cur_offset,
+					   max_len);
+			chunk->tx_dma = xfer->tx_buf ?
+				xfer->tx_dma + as->cur_offset :
+				as->buffer_dma;
+			chunk->rx_dma = xfer->rx_buf ?
+				xfer->rx_dma + as->cur_offset :
+				as->buffer_dma + SCRATCH_SIZE;
+			as->cur_offset += chunk->len;
+			return true;
+		}
 
-	if (!as->current_transfer)
-		xfer = list_entry(msg->transfers.next,
-				struct spi_transfer, transfer_list);
-	else if (!as->next_transfer)
-		xfer = list_entry(as->current_transfer->transfer_list.next,
-				struct spi_transfer, transfer_list);
-	else
-		xfer = NULL;
+		if (xfer == as->last_xfer)
+			xfer = NULL;
+		else
+			xfer = list_entry(xfer->transfer_list.next,
+					struct spi_transfer, transfer_list);
+		as->cur_xfer = xfer;
+		as->cur_offset = 0;
+	}
 
-	if (xfer) {
+	return false;
+}
+
+/*
+ * Keep both PDC register sets loaded.  Returns true once the whole
+ * batch went through; otherwise the matching interrupt is enabled.
+ */
+static bool atmel_spi_pdc_feed(struct atmel_spi *as)
+{
+	struct atmel_spi_chunk	chunk;
+
+	while (as->pdc_loaded) {
+		bool	next;
+
+		if (!spi_readl(as, RCR))
+			next = false;
+		else if (!spi_readl(as, RNCR))
+			next = true;
+		else
+			break;
+
+		if (!atmel_spi_next_chunk(as, &chunk)) {
+			as->pdc_loaded = 0;
+			break;
+		}
+
+		chunk.len /= as->bytes_per_word;
+		if (next) {
+			spi_writel(as, RNPR, chunk.rx_dma);
+			spi_writel(as, TNPR, chunk.tx_dma);
+			spi_writel(as, RNCR, chunk.len);
+			spi_writel(as, TNCR, chunk.len);
+		} else {
+			spi_writel(as, RPR, chunk.rx_dma);
+			spi_writel(as, TPR, chunk.tx_dma);
+			spi_writel(as, RCR, chunk.len);
+			spi_writel(as, TCR, chunk.len);
+		}
+	}
+
+	if (as->pdc_loaded) {
+		spi_writel(as, IER, SPI_BIT(ENDRX) | SPI_BIT(OVRES));
+		return false;
+	}
+
+	if (spi_readl(as, SR) & SPI_BIT(RXBUFF))
+		return true;
+
+	/* everything is loaded, wait for the receiver to drain it */
+	spi_writel(as, IDR, SPI_BIT(ENDRX));
+	spi_writel(as, IER, SPI_BIT(RXBUFF) | SPI_BIT(OVRES));
+	return false;
+}
+
+static int atmel_spi_pdc_run(struct atmel_spi *as)
+{
+	bool	done;
+
+	spin_lock_irq(&as->lock);
+	spi_writel(as, PTCR, SPI_BIT(RXTDIS) | SPI_BIT(TXTDIS));
+	spi_writel(as, RNCR, 0);
+	spi_writel(as, TNCR, 0);
+	spi_writel(as, RCR, 0);
+	spi_writel(as, TCR, 0);
+	INIT_COMPLETION(as->xfer_done);
+	as->xfer_status = 0;
+	as->pdc_loaded = 1;
+	done = atmel_spi_pdc_feed(as);
+	if (!done)
+		spi_writel(as, PTCR, SPI_BIT(TXTEN) | SPI_BIT(RXTEN));
+	spin_unlock_irq(&as->lock);
+
+	if (!done && !wait_for_completion_timeout(&as->xfer_done,
+						  as->timeout)) {
+		spin_lock_irq(&as->lock);
+		spi_writel(as, IDR, (SPI_BIT(RXBUFF) | SPI_BIT(ENDRX)
+				     | SPI_BIT(OVRES)));
 		spi_writel(as, PTCR, SPI_BIT(RXTDIS) | SPI_BIT(TXTDIS));
+		as->pdc_loaded = 0;
+		spin_unlock_irq(&as->lock);
+		return -ETIMEDOUT;
+	}
 
-		len = xfer->len;
-		atmel_spi_next_xfer_data(master, xfer, &tx_dma, &rx_dma, &len);
-		remaining = xfer->len - len;
+	return as->xfer_status;
+}
 
-		spi_writel(as, RPR, rx_dma);
-		spi_writel(as, TPR, tx_dma);
+static void atmel_spi_dma_callback(void *data)
+{
+	struct atmel_spi	*as = data;
 
-		if (msg->spi->bits_per_word > 8)
-			len >>= 1;
-		spi_writel(as, RCR, len);
-		spi_writel(as, TCR, len);
+	complete(&as->xfer_done);
+}
 
-		dev_dbg(&msg->spi->dev,
-			"  start xfer %p: len %u tx %p/%08x rx %p/%08x\n",
-			xfer, xfer->len, xfer->tx_buf, xfer->tx_dma,
-			xfer->rx_buf, xfer->rx_dma);
-	} else {
-		xfer = as->next_transfer;
-		remaining = as->next_remaining_bytes;
+/*
+ * Run the batch through the DMA engine, ATMEL_SPI_MAX_SG chunks at a
+ * time.  Only the receive side interrupts: it finishes last.
+ */
+static int atmel_spi_dmaengine_run(struct atmel_spi *as)
+{
+	struct dma_async_tx_descriptor	*rxdesc, *txdesc;
+	struct atmel_spi_chunk		chunk;
+	unsigned int			n;
+
+	for (;;) {
+		spin_lock_irq(&as->lock);
+		for (n = 0; n < ATMEL_SPI_MAX_SG; n++) {
+			if (!atmel_spi_next_chunk(as, &chunk))
+				break;
+			sg_dma_address(&as->sg_rx[n]) = chunk.rx_dma;
+			sg_dma_len(&as->sg_rx[n]) = chunk.len;
+			sg_dma_address(&as->sg_tx[n]) = chunk.tx_dma;
+			sg_dma_len(&as->sg_tx[n]) = chunk.len;
+		}
+		spin_unlock_irq(&as->lock);
+
+		if (!n)
+			return 0;
+
+		rxdesc = as->chan_rx->device->device_prep_slave_sg(as->chan_rx,
+				as->sg_rx, n, DMA_DEV_TO_MEM,
+				DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+		txdesc = as->chan_tx->device->device_prep_slave_sg(as->chan_tx,
+				as->sg_tx, n, DMA_MEM_TO_DEV, DMA_CTRL_ACK);
+		if (!rxdesc || !txdesc) {
+			dev_err(&as->pdev->dev, "failed to prepare DMA\n");
+			return -ENOMEM;
+		}
+
+		rxdesc->callback = atmel_spi_dma_callback;
+		rxdesc->callback_param = as;
+
+		INIT_COMPLETION(as->xfer_done);
+		as->xfer_status = 0;
+		spi_writel(as, IER, SPI_BIT(OVRES));
+
+		dmaengine_submit(rxdesc);
+		dmaengine_submit(txdesc);
+		dma_async_issue_pending(as->chan_rx);
+		dma_async_issue_pending(as->chan_tx);
+
+		if (!wait_for_completion_timeout(&as->xfer_done,
+						 as->timeout))
+			as->xfer_status = -ETIMEDOUT;
+		spi_writel(as, IDR, SPI_BIT(OVRES));
+
+		if (as->xfer_status) {
+			dmaengine_terminate_all(as->chan_tx);
+			dmaengine_terminate_all(as->chan_rx);
+			return as->xfer_status;
+		}
+	}
+}
+
+/*
+ * How long @len bytes may take on @spi: twice their time on the wire at
+ * the configured clock, plus 100 ms for scheduling latency.
+ */
+static unsigned long atmel_spi_timeout(struct atmel_spi *as,
+				       struct spi_device *spi,
+				       unsigned int len)
+{
+	struct atmel_spi_device	*asd = spi->controller_state;
+	unsigned long		bus_hz = clk_get_rate(as->clk);
+	u64			ms;
+
+	if (!atmel_spi_is_v2())
+		bus_hz /= 2;
+
+	ms = (u64)len * 8 * 2 * MSEC_PER_SEC * SPI_BFEXT(SCBR, asd->csr);
+	do_div(ms, bus_hz);
+	return msecs_to_jiffies(ms + 100);
+}
+
+static int atmel_spi_wait_sr(struct atmel_spi *as, u32 bit,
+			     unsigned long deadline)
+{
+	while (!(spi_readl(as, SR) & bit)) {
+		if (time_after(jiffies, deadline))
+			return -ETIMEDOUT;
+		cpu_relax();
+	}
+	return 0;
+}
+
+/*
+ * Short transfers: feed the data register directly.  One word at a
+ * time, so the receiver cannot overrun.
+ */
+static int atmel_spi_pio_xfer(struct atmel_spi *as, struct spi_device *spi,
+			      struct spi_transfer *xfer)
+{
+	const u8	*tx = xfer->tx_buf;
+	u8		*rx = xfer->rx_buf;
+	unsigned long	deadline;
+	u32		word;
+	unsigned int	i;
+	int		ret;
+
+	deadline = jiffies + atmel_spi_timeout(as, spi, xfer->len);
+
+	/* discard anything left over in the receive register */
+	while (spi_readl(as, SR) & SPI_BIT(RDRF))
+		spi_readl(as, RDR);
+
+	for (i = 0; i < xfer->len; i += as->bytes_per_word) {
+		word = 0;
+		if (tx)
+			word = as->bytes_per_word == 2 ?
+				*(const u16 *)(tx + i) : tx[i];
+
+		ret = atmel_spi_wait_sr(as, SPI_BIT(TDRE), deadline);
+		if (ret)
+			return ret;
+		spi_writel(as, TDR, word);
+
+		ret = atmel_spi_wait_sr(as, SPI_BIT(RDRF), deadline);
+		if (ret)
+			return ret;
+		word = spi_readl(as, RDR);
+
+		if (rx) {
+			if (as->bytes_per_word == 2)
+				*(u16 *)(rx + i) = word;
+			else
+				rx[i] = word;
+		}
 	}
 
-	as->current_transfer = xfer;
-	as->current_remaining_bytes = remaining;
+	return 0;
+}
+
+/*
+ * The CPU must not touch the buffers of a message the caller mapped
+ * for DMA, the mapping owns them.
+ */
+static inline bool atmel_spi_use_pio(struct spi_message *msg,
+				     struct spi_transfer *xfer)
+{
+	return !msg->is_dma_mapped && xfer->len <= pio_max_len;
+}
+
+static struct device *atmel_spi_dma_dev(struct atmel_spi *as)
+{
+	return as->chan_tx ? as->chan_tx->device->dev : &as->pdev->dev;
+}
 
-	if (remaining > 0)
-		len = remaining;
-	else if (!atmel_spi_xfer_is_last(msg, xfer)
-			&& atmel_spi_xfer_can_be_chained(xfer)) {
+/*
+ * Map and transfer first..last as one batch.
+ */
+static int atmel_spi_dma_xfers(struct atmel_spi *as, struct spi_message *msg,
+		struct spi_transfer *first, struct spi_transfer *last)
+{
+	struct device		*dev = atmel_spi_dma_dev(as);
+	struct spi_transfer	*xfer;
+	unsigned int		len = 0;
+	int			ret = 0;
+
+	if (!msg->is_dma_mapped) {
+		xfer = first;
+		do {
+			ret = atmel_spi_dma_map_xfer(dev, xfer);
+			if (ret) {
+				last = list_entry(xfer->transfer_list.prev,
+						struct spi_transfer,
+						transfer_list);
+				if (xfer == first)
+					return ret;
+				goto out_unmap;
+			}
+			xfer = list_entry(xfer->transfer_list.next,
+					struct spi_transfer, transfer_list);
+		} while (&xfer->transfer_list != last->transfer_list.next);
+	}
+
+	xfer = first;
+	while (&xfer->transfer_list != last->transfer_list.next) {
+		len += xfer->len;
 		xfer = list_entry(xfer->transfer_list.next,
 				struct spi_transfer, transfer_list);
-		len = xfer->len;
-	} else
-		xfer = NULL;
+	}
+	as->timeout = atmel_spi_timeout(as, msg->spi, len);
 
-	as->next_transfer = xfer;
+	as->cur_xfer = first;
+	as->last_xfer = last;
+	as->cur_offset = 0;
 
-	if (xfer) {
-		u32	total;
+	if (as->chan_rx)
+		ret = atmel_spi_dmaengine_run(as);
+	else
+		ret = atmel_spi_pdc_run(as);
 
-		total = len;
-		atmel_spi_next_xfer_data(master, xfer, &tx_dma, &rx_dma, &len);
-		as->next_remaining_bytes = total - len;
+	spi_writel(as, PTCR, SPI_BIT(RXTDIS) | SPI_BIT(TXTDIS));
 
-		spi_writel(as, RNPR, rx_dma);
-		spi_writel(as, TNPR, tx_dma);
+	if (ret) {
+		int timeout;
 
-		if (msg->spi->bits_per_word > 8)
-			len >>= 1;
-		spi_writel(as, RNCR, len);
-		spi_writel(as, TNCR, len);
+		if (ret == -EIO)
+			dev_warn(&as->pdev->dev, "overrun\n");
+		else if (ret == -ETIMEDOUT)
+			dev_warn(&as->pdev->dev, "transfer timed out\n");
 
-		dev_dbg(&msg->spi->dev,
-			"  next xfer %p: len %u tx %p/%08x rx %p/%08x\n",
-			xfer, xfer->len, xfer->tx_buf, xfer->tx_dma,
-			xfer->rx_buf, xfer->rx_dma);
-		ieval = SPI_BIT(ENDRX) | SPI_BIT(OVRES);
-	} else {
-		spi_writel(as, RNCR, 0);
-		spi_writel(as, TNCR, 0);
-		ieval = SPI_BIT(RXBUFF) | SPI_BIT(ENDRX) | SPI_BIT(OVRES);
+		/* make sure the data registers are empty */
+		for (timeout = 1000; timeout; timeout--)
+			if (spi_readl(as, SR) & SPI_BIT(TXEMPTY))
+				break;
+		if (!timeout)
+			dev_warn(&as->pdev->dev,
+				 "timeout waiting for TXEMPTY");
+		while (spi_readl(as, SR) & SPI_BIT(RDRF))
+			spi_readl(as, RDR);
+
+		/* Clear any overrun happening while cleaning up */
+		spi_readl(as, SR);
 	}
 
-	/* REVISIT: We're waiting for ENDRX before we start the next
-	 * transfer because we need to handle some difficult timing
-	 * issues otherwise. If we wait for ENDTX in one transfer and
-	 * then starts waiting for ENDRX in the next, it's difficult
-	 * to tell the difference between the ENDRX interrupt we're
-	 * actually waiting for and the ENDRX interrupt of the
-	 * previous transfer.
-	 *
-	 * It should be doable, though. Just not now...
-	 */
-	spi_writel(as, IER, ieval);
-	spi_writel(as, PTCR, SPI_BIT(TXTEN) | SPI_BIT(RXTEN));
+out_unmap:
+	if (!msg->is_dma_mapped) {
+		xfer = first;
+		while (&xfer->transfer_list != last->transfer_list.next) {
+			atmel_spi_dma_unmap_xfer(dev, xfer);
+			xfer = list_entry(xfer->transfer_list.next,
+					struct spi_transfer, transfer_list);
+		}
+	}
+
+	return ret;
 }
 
-static void atmel_spi_next_message(struct spi_master *master)
+static void atmel_spi_pump_message(struct spi_master *master,
+				   struct spi_message *msg)
 {
 	struct atmel_spi	*as = spi_master_get_devdata(master);
-	struct spi_message	*msg;
-	struct spi_device	*spi;
-
-	BUG_ON(as->current_transfer);
-
-	msg = list_entry(as->queue.next, struct spi_message, queue);
-	spi = msg->spi;
+	struct spi_device	*spi = msg->spi;
+	struct spi_transfer	*xfer, *last, *next;
+	int			status = 0;
+	int			stay = 0;
 
 	dev_dbg(master->dev.parent, "start message %p for %s\n",
 			msg, dev_name(&spi->dev));
 
+	as->bytes_per_word = spi->bits_per_word > 8 ? 2 : 1;
+#ifdef CONFIG_SPI_ATMEL_DMA
+	if (as->chan_rx) {
+		enum at_dma_slave_width width = spi->bits_per_word > 8 ?
+			AT_DMA_SLAVE_WIDTH_16BIT : AT_DMA_SLAVE_WIDTH_8BIT;
+
+		as->dma_rx_slave->reg_width = width;
+		as->dma_tx_slave->reg_width = width;
+	}
+#endif
+
 	/* select chip if it's not still active */
+	spin_lock_irq(&as->lock);
 	if (as->stay) {
 		if (as->stay != spi) {
 			cs_deactivate(as, as->stay);
@@ -487,88 +828,89 @@ static void atmel_spi_next_message(struct spi_master *master)
 		as->stay = NULL;
 	} else
 		cs_activate(as, spi);
+	spin_unlock_irq(&as->lock);
 
-	atmel_spi_next_xfer(master, msg);
-}
+	xfer = list_entry(msg->transfers.next, struct spi_transfer,
+			transfer_list);
+	for (;;) {
+		last = xfer;
+		if (atmel_spi_use_pio(msg, xfer)) {
+			status = atmel_spi_pio_xfer(as, spi, xfer);
+		} else {
+			/* batch everything up to the next PIO transfer */
+			while (!atmel_spi_xfer_is_last(msg, last)
+			       && atmel_spi_xfer_can_be_chained(last)) {
+				next = list_entry(last->transfer_list.next,
+						struct spi_transfer,
+						transfer_list);
+				if (atmel_spi_use_pio(msg, next))
+					break;
+				last = next;
+			}
+			status = atmel_spi_dma_xfers(as, msg, xfer, last);
+		}
+		if (status)
+			break;
 
-/*
- * For DMA, tx_buf/tx_dma have the same relationship as rx_buf/rx_dma:
- *  - The buffer is either valid for CPU access, else NULL
- *  - If the buffer is valid, so is its DMA address
- *
- * This driver manages the dma address unless message->is_dma_mapped.
- */
-static int
-atmel_spi_dma_map_xfer(struct atmel_spi *as, struct spi_transfer *xfer)
-{
-	struct device	*dev = &as->pdev->dev;
+		for (;;) {
+			msg->actual_length += xfer->len;
+			if (xfer == last)
+				break;
+			xfer = list_entry(xfer->transfer_list.next,
+					struct spi_transfer, transfer_list);
+		}
 
-	xfer->tx_dma = xfer->rx_dma = INVALID_DMA_ADDRESS;
-	if (xfer->tx_buf) {
-		/* tx_buf is a const void* where we need a void * for the dma
-		 * mapping */
-		void *nonconst_tx = (void *)xfer->tx_buf;
+		if (xfer->delay_usecs)
+			udelay(xfer->delay_usecs);
 
-		xfer->tx_dma = dma_map_single(dev,
-				nonconst_tx, xfer->len,
-				DMA_TO_DEVICE);
-		if (dma_mapping_error(dev, xfer->tx_dma))
-			return -ENOMEM;
-	}
-	if (xfer->rx_buf) {
-		xfer->rx_dma = dma_map_single(dev,
-				xfer->rx_buf, xfer->len,
-				DMA_FROM_DEVICE);
-		if (dma_mapping_error(dev, xfer->rx_dma)) {
-			if (xfer->tx_buf)
-				dma_unmap_single(dev,
-						xfer->tx_dma, xfer->len,
-						DMA_TO_DEVICE);
-			return -ENOMEM;
+		if (atmel_spi_xfer_is_last(msg, xfer)) {
+			stay = xfer->cs_change;
+			break;
 		}
-	}
-	return 0;
-}
 
-static void atmel_spi_dma_unmap_xfer(struct spi_master *master,
-				     struct spi_transfer *xfer)
-{
-	if (xfer->tx_dma != INVALID_DMA_ADDRESS)
-		dma_unmap_single(master->dev.parent, xfer->tx_dma,
-				 xfer->len, DMA_TO_DEVICE);
-	if (xfer->rx_dma != INVALID_DMA_ADDRESS)
-		dma_unmap_single(master->dev.parent, xfer->rx_dma,
-				 xfer->len, DMA_FROM_DEVICE);
-}
+		if (xfer->cs_change) {
+			cs_deactivate(as, spi);
+			udelay(1);
+			cs_activate(as, spi);
+		}
 
-static void
-atmel_spi_msg_done(struct spi_master *master, struct atmel_spi *as,
-		struct spi_message *msg, int status, int stay)
-{
+		xfer = list_entry(xfer->transfer_list.next,
+				struct spi_transfer, transfer_list);
+	}
+
+	spin_lock_irq(&as->lock);
 	if (!stay || status < 0)
-		cs_deactivate(as, msg->spi);
+		cs_deactivate(as, spi);
 	else
-		as->stay = msg->spi;
+		as->stay = spi;
+	spin_unlock_irq(&as->lock);
 
-	list_del(&msg->queue);
 	msg->status = status;
 
 	dev_dbg(master->dev.parent,
 		"xfer complete: %u bytes transferred\n",
 		msg->actual_length);
 
-	spin_unlock(&as->lock);
 	msg->complete(msg->context);
-	spin_lock(&as->lock);
+}
+
+static void atmel_spi_pump(struct work_struct *work)
+{
+	struct atmel_spi	*as = container_of(work, struct atmel_spi, work);
+	struct spi_master	*master = platform_get_drvdata(as->pdev);
+	struct spi_message	*msg;
 
-	as->current_transfer = NULL;
-	as->next_transfer = NULL;
+	spin_lock_irq(&as->lock);
+	while (!list_empty(&as->queue) && !as->stopping) {
+		msg = list_entry(as->queue.next, struct spi_message, queue);
+		list_del_init(&msg->queue);
+		spin_unlock_irq(&as->lock);
 
-	/* continue if needed */
-	if (list_empty(&as->queue) || as->stopping)
-		spi_writel(as, PTCR, SPI_BIT(RXTDIS) | SPI_BIT(TXTDIS));
-	else
-		atmel_spi_next_message(master);
+		atmel_spi_pump_message(master, msg);
+
+		spin_lock_irq(&as->lock);
+	}
+	spin_unlock_irq(&as->lock);
 }
 
 static irqreturn_t
@@ -576,110 +918,36 @@ atmel_spi_interrupt(int irq, void *dev_id)
 {
 	struct spi_master	*master = dev_id;
 	struct atmel_spi	*as = spi_master_get_devdata(master);
-	struct spi_message	*msg;
-	struct spi_transfer	*xfer;
 	u32			status, pending, imr;
 	int			ret = IRQ_NONE;
 
 	spin_lock(&as->lock);
 
-	xfer = as->current_transfer;
-	msg = list_entry(as->queue.next, struct spi_message, queue);
-
 	imr = spi_readl(as, IMR);
 	status = spi_readl(as, SR);
 	pending = status & imr;
 
 	if (pending & SPI_BIT(OVRES)) {
-		int timeout;
-
 		ret = IRQ_HANDLED;
 
-		spi_writel(as, IDR, (SPI_BIT(RXBUFF) | SPI_BIT(ENDRX)
-				     | SPI_BIT(OVRES)));
-
 		/*
 		 * When we get an overrun, we disregard the current
-		 * transfer. Data will not be copied back from any
-		 * bounce buffer and msg->actual_len will not be
-		 * updated with the last xfer.
-		 *
-		 * We will also not process any remaning transfers in
-		 * the message.
-		 *
-		 * First, stop the transfer and unmap the DMA buffers.
+		 * batch and the rest of the message.  The pump cleans
+		 * up the data registers.
 		 */
+		spi_writel(as, IDR, (SPI_BIT(RXBUFF) | SPI_BIT(ENDRX)
+				     | SPI_BIT(OVRES)));
 		spi_writel(as, PTCR, SPI_BIT(RXTDIS) | SPI_BIT(TXTDIS));
-		if (!msg->is_dma_mapped)
-			atmel_spi_dma_unmap_xfer(master, xfer);
-
-		/* REVISIT: udelay in irq is unfriendly */
-		if (xfer->delay_usecs)
-			udelay(xfer->delay_usecs);
-
-		dev_warn(master->dev.parent, "overrun (%u/%u remaining)\n",
-			 spi_readl(as, TCR), spi_readl(as, RCR));
-
-		/*
-		 * Clean up DMA registers and make sure the data
-		 * registers are empty.
-		 */
-		spi_writel(as, RNCR, 0);
-		spi_writel(as, TNCR, 0);
-		spi_writel(as, RCR, 0);
-		spi_writel(as, TCR, 0);
-		for (timeout = 1000; timeout; timeout--)
-			if (spi_readl(as, SR) & SPI_BIT(TXEMPTY))
-				break;
-		if (!timeout)
-			dev_warn(master->dev.parent,
-				 "timeout waiting for TXEMPTY");
-		while (spi_readl(as, SR) & SPI_BIT(RDRF))
-			spi_readl(as, RDR);
-
-		/* Clear any overrun happening while cleaning up */
-		spi_readl(as, SR);
-
-		atmel_spi_msg_done(master, as, msg, -EIO, 0);
+		as->pdc_loaded = 0;
+		as->xfer_status = -EIO;
+		complete(&as->xfer_done);
 	} else if (pending & (SPI_BIT(RXBUFF) | SPI_BIT(ENDRX))) {
 		ret = IRQ_HANDLED;
 
-		spi_writel(as, IDR, pending);
-
-		if (as->current_remaining_bytes == 0) {
-			msg->actual_length += xfer->len;
-
-			if (!msg->is_dma_mapped)
-				atmel_spi_dma_unmap_xfer(master, xfer);
-
-			/* REVISIT: udelay in irq is unfriendly */
-			if (xfer->delay_usecs)
-				udelay(xfer->delay_usecs);
-
-			if (atmel_spi_xfer_is_last(msg, xfer)) {
-				/* report completed message */
-				atmel_spi_msg_done(master, as, msg, 0,
-						xfer->cs_change);
-			} else {
-				if (xfer->cs_change) {
-					cs_deactivate(as, msg->spi);
-					udelay(1);
-					cs_activate(as, msg->spi);
-				}
-
-				/*
-				 * Not done yet. Submit the next transfer.
-				 *
-				 * FIXME handle protocol options for xfer
-				 */
-				atmel_spi_next_xfer(master, msg);
-			}
-		} else {
-			/*
-			 * Keep going, we still have data to send in
-			 * the current transfer.
-			 */
-			atmel_spi_next_xfer(master, msg);
+		if (atmel_spi_pdc_feed(as)) {
+			spi_writel(as, IDR, (SPI_BIT(RXBUFF) | SPI_BIT(ENDRX)
+					     | SPI_BIT(OVRES)));
+			complete(&as->xfer_done);
 		}
 	}
 
@@ -846,19 +1114,6 @@ static int atmel_spi_transfer(struct spi_device *spi, struct spi_message *msg)
 			dev_dbg(&spi->dev, "no protocol options yet\n");
 			return -ENOPROTOOPT;
 		}
-
-		/*
-		 * DMA map early, for performance (empties dcache ASAP) and
-		 * better fault reporting.  This is a DMA-only driver.
-		 *
-		 * NOTE that if dma_unmap_single() ever starts to do work on
-		 * platforms supported by this driver, we would need to clean
-		 * up mappings for previously-mapped transfers.
-		 */
-		if (!msg->is_dma_mapped) {
-			if (atmel_spi_dma_map_xfer(as, xfer) < 0)
-				return -ENOMEM;
-		}
 	}
 
 #ifdef VERBOSE
@@ -876,8 +1131,7 @@ static int atmel_spi_transfer(struct spi_device *spi, struct spi_message *msg)
 
 	spin_lock_irqsave(&as->lock, flags);
 	list_add_tail(&msg->queue, &as->queue);
-	if (!as->current_transfer)
-		atmel_spi_next_message(spi->master);
+	queue_work(as->workqueue, &as->work);
 	spin_unlock_irqrestore(&as->lock, flags);
 
 	return 0;
@@ -907,6 +1161,69 @@ static void atmel_spi_cleanup(struct spi_device *spi)
 
 /*-------------------------------------------------------------------------*/
 
+#ifdef CONFIG_SPI_ATMEL_DMA
+static bool atmel_spi_dma_filter(struct dma_chan *chan, void *slave)
+{
+	struct at_dma_slave	*sl = slave;
+
+	if (sl && sl->dma_dev == chan->device->dev) {
+		chan->private = sl;
+		return true;
+	}
+	return false;
+}
+
+static void atmel_spi_request_dma(struct atmel_spi *as)
+{
+	struct atmel_spi_data	*pdata = as->pdev->dev.platform_data;
+	dma_cap_mask_t		mask;
+
+	if (!pdata || !pdata->dma_rx_slave || !pdata->dma_tx_slave)
+		return;
+
+	as->dma_rx_slave = pdata->dma_rx_slave;
+	as->dma_rx_slave->rx_reg = (dma_addr_t)as->pdev->resource[0].start
+					+ SPI_RDR;
+	as->dma_tx_slave = pdata->dma_tx_slave;
+	as->dma_tx_slave->tx_reg = (dma_addr_t)as->pdev->resource[0].start
+					+ SPI_TDR;
+
+	dma_cap_zero(mask);
+	dma_cap_set(DMA_SLAVE, mask);
+
+	as->chan_rx = dma_request_channel(mask, atmel_spi_dma_filter,
+					  as->dma_rx_slave);
+	if (as->chan_rx)
+		as->chan_tx = dma_request_channel(mask, atmel_spi_dma_filter,
+						  as->dma_tx_slave);
+	if (!as->chan_tx) {
+		if (as->chan_rx)
+			dma_release_channel(as->chan_rx);
+		as->chan_rx = NULL;
+		dev_info(&as->pdev->dev, "no DMA channels, using PDC\n");
+		return;
+	}
+
+	sg_init_table(as->sg_rx, ATMEL_SPI_MAX_SG);
+	sg_init_table(as->sg_tx, ATMEL_SPI_MAX_SG);
+	dev_info(&as->pdev->dev, "using %s (rx) and %s (tx) for DMA\n",
+		 dma_chan_name(as->chan_rx), dma_chan_name(as->chan_tx));
+}
+
+static void atmel_spi_release_dma(struct atmel_spi *as)
+{
+	if (as->chan_tx)
+		dma_release_channel(as->chan_tx);
+	if (as->chan_rx)
+		dma_release_channel(as->chan_rx);
+	as->chan_tx = NULL;
+	as->chan_rx = NULL;
+}
+#else
+static void atmel_spi_request_dma(struct atmel_spi *as) {}
+static void atmel_spi_release_dma(struct atmel_spi *as) {}
+#endif
+
 static int __devinit atmel_spi_probe(struct platform_device *pdev)
 {
 	struct resource		*regs;
@@ -948,15 +1265,19 @@ static int __devinit atmel_spi_probe(struct platform_device *pdev)
 
 	/*
 	 * Scratch buffer is used for throwaway rx and tx data.
-	 * It's coherent to minimize dcache pollution.
+	 * It's coherent to minimize dcache pollution.  The tx half
+	 * stays zeroed for good.
 	 */
 	as->buffer = dma_alloc_coherent(&pdev->dev, BUFFER_SIZE,
 					&as->buffer_dma, GFP_KERNEL);
 	if (!as->buffer)
 		goto out_free;
+	memset(as->buffer, 0, SCRATCH_SIZE);
 
 	spin_lock_init(&as->lock);
 	INIT_LIST_HEAD(&as->queue);
+	INIT_WORK(&as->work, atmel_spi_pump);
+	init_completion(&as->xfer_done);
 	as->pdev = pdev;
 	as->regs = ioremap(regs->start, resource_size(regs));
 	if (!as->regs)
@@ -964,10 +1285,16 @@ static int __devinit atmel_spi_probe(struct platform_device *pdev)
 	as->irq = irq;
 	as->clk = clk;
 
+	as->workqueue = create_singlethread_workqueue(dev_name(&pdev->dev));
+	if (!as->workqueue)
+		goto out_unmap_regs;
+
 	ret = request_irq(irq, atmel_spi_interrupt, 0,
 			dev_name(&pdev->dev), master);
 	if (ret)
-		goto out_unmap_regs;
+		goto out_destroy_wq;
+
+	atmel_spi_request_dma(as);
 
 	/* Initialize the hardware */
 	clk_enable(clk);
@@ -991,7 +1318,10 @@ out_reset_hw:
 	spi_writel(as, CR, SPI_BIT(SWRST));
 	spi_writel(as, CR, SPI_BIT(SWRST)); /* AT91SAM9263 Rev B workaround */
 	clk_disable(clk);
+	atmel_spi_release_dma(as);
 	free_irq(irq, master);
+out_destroy_wq:
+	destroy_workqueue(as->workqueue);
 out_unmap_regs:
 	iounmap(as->regs);
 out_free_buffer:
@@ -1007,21 +1337,27 @@ static int __devexit atmel_spi_remove(struct platform_device *pdev)
 {
 	struct spi_master	*master = platform_get_drvdata(pdev);
 	struct atmel_spi	*as = spi_master_get_devdata(master);
-	struct spi_message	*msg;
+	struct spi_message	*msg, *tmp;
 
-	/* reset the hardware and block queue progress */
+	/* block queue progress, let the pump finish its message */
 	spin_lock_irq(&as->lock);
 	as->stopping = 1;
+	spin_unlock_irq(&as->lock);
+	flush_workqueue(as->workqueue);
+	destroy_workqueue(as->workqueue);
+
+	/* reset the hardware */
+	spin_lock_irq(&as->lock);
 	spi_writel(as, CR, SPI_BIT(SWRST));
 	spi_writel(as, CR, SPI_BIT(SWRST)); /* AT91SAM9263 Rev B workaround */
 	spi_readl(as, SR);
 	spin_unlock_irq(&as->lock);
 
-	/* Terminate remaining queued transfers */
-	list_for_each_entry(msg, &as->queue, queue) {
-		/* REVISIT unmapping the dma is a NOP on ARM and AVR32
-		 * but we shouldn't depend on that...
-		 */
+	atmel_spi_release_dma(as);
+
+	/* Terminate remaining queued transfers; none are mapped yet */
+	list_for_each_entry_safe(msg, tmp, &as->queue, queue) {
+		list_del_init(&msg->queue);
 		msg->status = -ESHUTDOWN;
 		msg->complete(msg->context);
 	}
@@ -36,6 +36,8 @@
 #include <linux/of.h>
 #include <linux/of_device.h>
 #include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
+#include <linux/scatterlist.h>
 #include <linux/atmel_pdc.h>
 #include <linux/atmel_serial.h>
 #include <linux/uaccess.h>
@@ -51,10 +53,18 @@
 #include <asm/gpio.h>
 #endif
 
+#ifdef CONFIG_SERIAL_ATMEL_DMA
+#include <mach/at_hdmac.h>
+#endif
+
 #define PDC_BUFFER_SIZE		512
 /* Revisit: We should calculate this based on the actual port settings */
 #define PDC_RX_TIMEOUT		(3 * 10)		/* 3 bytes */
 
+/* dmaengine receive ring, split in periods that each raise a callback */
+#define DMA_RX_SIZE		PAGE_SIZE
+#define DMA_RX_PERIODS		4
+
 #if defined(CONFIG_SERIAL_ATMEL_CONSOLE) && defined(CONFIG_MAGIC_SYSRQ)
 #define SUPPORT_SYSRQ
 #endif
@@ -148,6 +158,17 @@ struct atmel_uart_port {
 	short			use_dma_tx;	/* enable PDC transmitter */
 	struct atmel_dma_buffer	pdc_tx;		/* PDC transmitter */
 
+	struct at_dma_slave	*dma_rx_slave;
+	struct dma_chan		*chan_rx;	/* dmaengine receiver */
+	struct atmel_dma_buffer	dma_rx;		/* cyclic receive ring */
+	dma_cookie_t		cookie_rx;
+
+	struct at_dma_slave	*dma_tx_slave;
+	struct dma_chan		*chan_tx;	/* dmaengine transmitter */
+	struct atmel_dma_buffer	dma_tx;		/* ofs: bytes in flight */
+	struct scatterlist	sg_tx[2];
+	dma_cookie_t		cookie_tx;
+
 	struct tasklet_struct	tasklet;
 	unsigned int		irq_status;
 	unsigned int		irq_status_prev;
@@ -181,19 +202,34 @@ to_atmel_uart_port(struct uart_port *uart)
 	return container_of(uart, struct atmel_uart_port, uart);
 }
 
+static bool atmel_use_chan_rx(struct uart_port *port)
+{
+	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
+
+	return atmel_port->chan_rx != NULL;
+}
+
+static bool atmel_use_chan_tx(struct uart_port *port)
+{
+	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
+
+	return atmel_port->chan_tx != NULL;
+}
+
 #ifdef CONFIG_SERIAL_ATMEL_PDC
 static bool atmel_use_dma_rx(struct uart_port *port)
 {
 	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
 
-	return atmel_port->use_dma_rx;
+	/* a dmaengine channel takes precedence over the PDC */
+	return atmel_port->use_dma_rx && !atmel_port->chan_rx;
 }
 
 static bool atmel_use_dma_tx(struct uart_port *port)
 {
 	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
 
-	return atmel_port->use_dma_tx;
+	return atmel_port->use_dma_tx && !atmel_port->chan_tx;
 }
 #else
 static bool atmel_use_dma_rx(struct uart_port *port)
@@ -243,7 +279,8 @@ void atmel_config_rs485(struct uart_port *port, struct serial_rs485 *rs485conf)
 	UART_PUT_MR(port, mode);
 
 	/* Enable interrupts */
-	UART_PUT_IER(port, atmel_port->tx_done_mask);
+	if (!atmel_use_chan_tx(port))
+		UART_PUT_IER(port, atmel_port->tx_done_mask);
 
 	spin_unlock_irqrestore(&port->lock, flags);
 
@@ -365,6 +402,16 @@ static void atmel_start_tx(struct uart_port *port)
 {
 	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
 
+	if (atmel_use_chan_tx(port)) {
+		if ((atmel_port->rs485.flags & SER_RS485_ENABLED) &&
+		    !(atmel_port->rs485.flags & SER_RS485_RX_DURING_TX))
+			atmel_stop_rx(port);
+
+		/* the tasklet queues the next scatter-gather transfer */
+		tasklet_schedule(&atmel_port->tasklet);
+		return;
+	}
+
 	if (atmel_use_dma_tx(port)) {
 		if (UART_GET_PTSR(port) & ATMEL_PDC_TXTEN)
 			/* The transmitter is already running.  Yes, we
@@ -389,7 +436,9 @@ static void atmel_start_rx(struct uart_port *port)
 {
 	UART_PUT_CR(port, ATMEL_US_RSTSTA);  /* reset status and receiver */
 
-	if (atmel_use_dma_rx(port)) {
+	if (atmel_use_chan_rx(port)) {
+		UART_PUT_IER(port, ATMEL_US_TIMEOUT | port->read_status_mask);
+	} else if (atmel_use_dma_rx(port)) {
 		/* enable PDC controller */
 		UART_PUT_IER(port, ATMEL_US_ENDRX | ATMEL_US_TIMEOUT |
 			port->read_status_mask);
@@ -404,7 +453,9 @@ static void atmel_start_rx(struct uart_port *port)
  */
 static void atmel_stop_rx(struct uart_port *port)
 {
-	if (atmel_use_dma_rx(port)) {
+	if (atmel_use_chan_rx(port)) {
+		UART_PUT_IDR(port, ATMEL_US_TIMEOUT | port->read_status_mask);
+	} else if (atmel_use_dma_rx(port)) {
 		/* disable PDC receive */
 		UART_PUT_PTCR(port, ATMEL_PDC_RXTDIS);
 		UART_PUT_IDR(port, ATMEL_US_ENDRX | ATMEL_US_TIMEOUT |
@@ -569,7 +620,21 @@ atmel_handle_receive(struct uart_port *port, unsigned int pending)
 {
 	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
 
-	if (atmel_use_dma_rx(port)) {
+	if (atmel_use_chan_rx(port)) {
+		/*
+		 * The cyclic transfer runs on its own; the receiver
+		 * timeout tells us the line went idle with data left
+		 * in the current period.
+		 */
+		if (pending & ATMEL_US_TIMEOUT) {
+			UART_PUT_IDR(port, ATMEL_US_TIMEOUT);
+			tasklet_schedule(&atmel_port->tasklet);
+		}
+
+		if (pending & (ATMEL_US_RXBRK | ATMEL_US_OVRE |
+				ATMEL_US_FRAME | ATMEL_US_PARE))
+			atmel_pdc_rxerr(port, pending);
+	} else if (atmel_use_dma_rx(port)) {
 		/*
 		 * PDC receive. Just schedule the tasklet and let it
 		 * figure out the details.
@@ -707,6 +772,90 @@ static void atmel_tx_dma(struct uart_port *port)
 		uart_write_wakeup(port);
 }
 
+/*
+ * dmaengine completion callback: both directions are finished in the
+ * tasklet, which takes the port lock.  The DMA driver may call this
+ * with the port lock already held (from atmel_flush_buffer()).
+ */
+static void atmel_chan_complete(void *arg)
+{
+	struct uart_port *port = arg;
+	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
+
+	tasklet_schedule(&atmel_port->tasklet);
+}
+
+/*
+ * Called from tasklet.  Retire the finished transfer, if any, and send
+ * whatever is in the circular buffer as one scatter-gather transfer of
+ * at most two segments.
+ */
+static void atmel_tx_chan(struct uart_port *port)
+{
+	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
+	struct circ_buf *xmit = &port->state->xmit;
+	struct atmel_dma_buffer *dbuf = &atmel_port->dma_tx;
+	struct dma_chan *chan = atmel_port->chan_tx;
+	struct scatterlist *sg = atmel_port->sg_tx;
+	struct dma_async_tx_descriptor *desc;
+	unsigned int nents = 1;
+
+	if (dbuf->ofs) {
+		if (dma_async_is_tx_complete(chan, atmel_port->cookie_tx,
+					     NULL, NULL) != DMA_SUCCESS)
+			return;
+
+		xmit->tail += dbuf->ofs;
+		xmit->tail &= UART_XMIT_SIZE - 1;
+
+		port->icount.tx += dbuf->ofs;
+		dbuf->ofs = 0;
+	}
+
+	if (!uart_circ_empty(xmit) && !uart_tx_stopped(port)) {
+		dma_sync_single_for_device(chan->device->dev,
+					   dbuf->dma_addr,
+					   dbuf->dma_size,
+					   DMA_TO_DEVICE);
+
+		dbuf->ofs = CIRC_CNT_TO_END(xmit->head, xmit->tail,
+					    UART_XMIT_SIZE);
+		sg_dma_address(&sg[0]) = dbuf->dma_addr + xmit->tail;
+		sg_dma_len(&sg[0]) = dbuf->ofs;
+
+		/* the data wraps around: pick up the head in the same go */
+		if (xmit->head < xmit->tail && xmit->head) {
+			sg_dma_address(&sg[1]) = dbuf->dma_addr;
+			sg_dma_len(&sg[1]) = xmit->head;
+			dbuf->ofs += xmit->head;
+			nents = 2;
+		}
+
+		desc = chan->device->device_prep_slave_sg(chan, sg, nents,
+				DMA_MEM_TO_DEV,
+				DMA_PREP_INTERRUPT | DMA_CTRL_ACK);
+		if (!desc) {
+			dev_err(port->dev, "failed to prepare TX transfer\n");
+			dbuf->ofs = 0;
+			return;
+		}
+
+		desc->callback = atmel_chan_complete;
+		desc->callback_param = port;
+		atmel_port->cookie_tx = dmaengine_submit(desc);
+		dma_async_issue_pending(chan);
+	} else {
+		if ((atmel_port->rs485.flags & SER_RS485_ENABLED) &&
+		    !(atmel_port->rs485.flags & SER_RS485_RX_DURING_TX)) {
+			/* DMA done, stop TX, start RX for RS485 */
+			atmel_start_rx(port);
+		}
+	}
+
+	if (uart_circ_chars_pending(xmit) < WAKEUP_CHARS)
+		uart_write_wakeup(port);
+}
+
 static void atmel_rx_from_ring(struct uart_port *port)
 {
 	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
@@ -851,6 +1000,59 @@ static void atmel_rx_from_dma(struct uart_port *port)
 	UART_PUT_IER(port, ATMEL_US_ENDRX | ATMEL_US_TIMEOUT);
 }
 
+/*
+ * Called from tasklet, on receiver timeout or at the end of a period.
+ * Push everything between our tail and the DMA write position.
+ */
+static void atmel_rx_from_chan(struct uart_port *port)
+{
+	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
+	struct tty_struct *tty = port->state->port.tty;
+	struct atmel_dma_buffer *dbuf = &atmel_port->dma_rx;
+	struct dma_chan *chan = atmel_port->chan_rx;
+	struct dma_tx_state state;
+	unsigned int head;
+	unsigned int count;
+
+	/* Reset the UART timeout early so that we don't miss one */
+	UART_PUT_CR(port, ATMEL_US_STTTO);
+
+	chan->device->device_tx_status(chan, atmel_port->cookie_rx, &state);
+	head = dbuf->dma_size - state.residue;
+
+	if (head != dbuf->ofs) {
+		dma_sync_single_for_cpu(chan->device->dev, dbuf->dma_addr,
+				dbuf->dma_size, DMA_FROM_DEVICE);
+
+		/* the DMA wrapped: first take the end of the ring */
+		if (head < dbuf->ofs) {
+			count = dbuf->dma_size - dbuf->ofs;
+			tty_insert_flip_string(tty, dbuf->buf + dbuf->ofs,
+					       count);
+			port->icount.rx += count;
+			dbuf->ofs = 0;
+		}
+
+		count = head - dbuf->ofs;
+		tty_insert_flip_string(tty, dbuf->buf + dbuf->ofs, count);
+		port->icount.rx += count;
+		dbuf->ofs = head % dbuf->dma_size;
+
+		dma_sync_single_for_device(chan->device->dev, dbuf->dma_addr,
+				dbuf->dma_size, DMA_FROM_DEVICE);
+	}
+
+	/*
+	 * Drop the lock here since it might end up calling
+	 * uart_start(), which takes the lock.
+	 */
+	spin_unlock(&port->lock);
+	tty_flip_buffer_push(tty);
+	spin_lock(&port->lock);
+
+	UART_PUT_IER(port, ATMEL_US_TIMEOUT);
+}
+
 /*
  * tasklet handling tty stuff outside the interrupt handler.
  */
@@ -864,7 +1066,9 @@ static void atmel_tasklet_func(unsigned long data)
 	/* The interrupt handler does not take the lock */
 	spin_lock(&port->lock);
 
-	if (atmel_use_dma_tx(port))
+	if (atmel_use_chan_tx(port))
+		atmel_tx_chan(port);
+	else if (atmel_use_dma_tx(port))
 		atmel_tx_dma(port);
 	else
 		atmel_tx_chars(port);
@@ -889,7 +1093,9 @@ static void atmel_tasklet_func(unsigned long data)
 		atmel_port->irq_status_prev = status;
 	}
 
-	if (atmel_use_dma_rx(port))
+	if (atmel_use_chan_rx(port))
+		atmel_rx_from_chan(port);
+	else if (atmel_use_dma_rx(port))
 		atmel_rx_from_dma(port);
 	else
 		atmel_rx_from_ring(port);
@@ -897,6 +1103,148 @@ static void atmel_tasklet_func(unsigned long data)
 	spin_unlock(&port->lock);
 }
 
+#ifdef CONFIG_SERIAL_ATMEL_DMA
+static bool atmel_dma_filter(struct dma_chan *chan, void *slave)
+{
+	struct at_dma_slave *sl = slave;
+
+	if (sl->dma_dev == chan->device->dev) {
+		chan->private = sl;
+		return true;
+	} else {
+		return false;
+	}
+}
+
+static struct dma_chan *atmel_request_chan(struct uart_port *port,
+					   struct at_dma_slave *sl)
+{
+	dma_cap_mask_t mask;
+
+	if (!sl)
+		return NULL;
+
+	sl->rx_reg = port->mapbase + ATMEL_US_RHR;
+	sl->tx_reg = port->mapbase + ATMEL_US_THR;
+	sl->reg_width = AT_DMA_SLAVE_WIDTH_8BIT;
+
+	dma_cap_zero(mask);
+	dma_cap_set(DMA_SLAVE, mask);
+	return dma_request_channel(mask, atmel_dma_filter, sl);
+}
+#else
+static struct dma_chan *atmel_request_chan(struct uart_port *port,
+					   struct at_dma_slave *sl)
+{
+	return NULL;
+}
+#endif
+
+/*
+ * Start the cyclic receive transfer.  On failure the port falls back
+ * to PDC or interrupt driven reception.
+ */
+static void atmel_prepare_chan_rx(struct uart_port *port)
+{
+	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
+	struct atmel_dma_buffer *dbuf = &atmel_port->dma_rx;
+	struct dma_async_tx_descriptor *desc;
+	struct dma_chan *chan;
+
+	chan = atmel_request_chan(port, atmel_port->dma_rx_slave);
+	if (!chan)
+		return;
+
+	dbuf->buf = kmalloc(DMA_RX_SIZE, GFP_KERNEL);
+	if (!dbuf->buf)
+		goto err_buf;
+
+	dbuf->dma_addr = dma_map_single(chan->device->dev, dbuf->buf,
+					DMA_RX_SIZE, DMA_FROM_DEVICE);
+	if (dma_mapping_error(chan->device->dev, dbuf->dma_addr))
+		goto err_map;
+	dbuf->dma_size = DMA_RX_SIZE;
+	dbuf->ofs = 0;
+
+	desc = chan->device->device_prep_dma_cyclic(chan, dbuf->dma_addr,
+			DMA_RX_SIZE, DMA_RX_SIZE / DMA_RX_PERIODS,
+			DMA_DEV_TO_MEM);
+	if (!desc)
+		goto err_prep;
+
+	desc->callback = atmel_chan_complete;
+	desc->callback_param = port;
+	atmel_port->cookie_rx = dmaengine_submit(desc);
+	dma_async_issue_pending(chan);
+
+	atmel_port->chan_rx = chan;
+	dev_dbg(port->dev, "using %s for RX\n", dma_chan_name(chan));
+	return;
+
+err_prep:
+	dma_unmap_single(chan->device->dev, dbuf->dma_addr, DMA_RX_SIZE,
+			 DMA_FROM_DEVICE);
+err_map:
+	kfree(dbuf->buf);
+err_buf:
+	dma_release_channel(chan);
+	dev_warn(port->dev, "RX DMA setup failed, not using dmaengine\n");
+}
+
+static void atmel_prepare_chan_tx(struct uart_port *port)
+{
+	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
+	struct atmel_dma_buffer *dbuf = &atmel_port->dma_tx;
+	struct circ_buf *xmit = &port->state->xmit;
+	struct dma_chan *chan;
+
+	chan = atmel_request_chan(port, atmel_port->dma_tx_slave);
+	if (!chan)
+		return;
+
+	dbuf->buf = xmit->buf;
+	dbuf->dma_addr = dma_map_single(chan->device->dev, dbuf->buf,
+					UART_XMIT_SIZE, DMA_TO_DEVICE);
+	if (dma_mapping_error(chan->device->dev, dbuf->dma_addr)) {
+		dma_release_channel(chan);
+		dev_warn(port->dev, "TX DMA setup failed, not using dmaengine\n");
+		return;
+	}
+	dbuf->dma_size = UART_XMIT_SIZE;
+	dbuf->ofs = 0;
+	sg_init_table(atmel_port->sg_tx, ARRAY_SIZE(atmel_port->sg_tx));
+
+	atmel_port->chan_tx = chan;
+	dev_dbg(port->dev, "using %s for TX\n", dma_chan_name(chan));
+}
+
+static void atmel_release_chan_rx(struct uart_port *port)
+{
+	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
+	struct atmel_dma_buffer *dbuf = &atmel_port->dma_rx;
+	struct dma_chan *chan = atmel_port->chan_rx;
+
+	dmaengine_terminate_all(chan);
+	dma_unmap_single(chan->device->dev, dbuf->dma_addr, dbuf->dma_size,
+			 DMA_FROM_DEVICE);
+	kfree(dbuf->buf);
+	atmel_port->chan_rx = NULL;
+	dma_release_channel(chan);
+}
+
+static void atmel_release_chan_tx(struct uart_port *port)
+{
+	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
+	struct atmel_dma_buffer *dbuf = &atmel_port->dma_tx;
+	struct dma_chan *chan = atmel_port->chan_tx;
+
+	dmaengine_terminate_all(chan);
+	dma_unmap_single(chan->device->dev, dbuf->dma_addr, dbuf->dma_size,
+			 DMA_TO_DEVICE);
+	atmel_port->chan_tx = NULL;
+	dma_release_channel(chan);
+}
+
 /*
  * Perform initialization and enable port for reception
  */
@@ -926,6 +1274,9 @@ static int atmel_startup(struct uart_port *port)
 	/*
 	 * Initialize DMA (if necessary)
 	 */
+	atmel_prepare_chan_rx(port);
+	atmel_prepare_chan_tx(port);
+
 	if (atmel_use_dma_rx(port)) {
 		int i;
 
@@ -996,7 +1347,13 @@ static int atmel_startup(struct uart_port *port)
 	/* enable xmit & rcvr */
 	UART_PUT_CR(port, ATMEL_US_TXEN | ATMEL_US_RXEN);
 
-	if (atmel_use_dma_rx(port)) {
+	if (atmel_use_chan_rx(port)) {
+		/* set UART timeout, the DMA handshake does the rest */
+		UART_PUT_RTOR(port, PDC_RX_TIMEOUT);
+		UART_PUT_CR(port, ATMEL_US_STTTO);
+
+		UART_PUT_IER(port, ATMEL_US_TIMEOUT);
+	} else if (atmel_use_dma_rx(port)) {
 		/* set UART timeout */
 		UART_PUT_RTOR(port, PDC_RX_TIMEOUT);
 		UART_PUT_CR(port, ATMEL_US_STTTO);
@@ -1027,7 +1384,9 @@ static void atmel_shutdown(struct uart_port *port)
 	/*
 	 * Shut-down the DMA.
 	 */
-	if (atmel_use_dma_rx(port)) {
+	if (atmel_use_chan_rx(port)) {
+		atmel_release_chan_rx(port);
+	} else if (atmel_use_dma_rx(port)) {
 		int i;
 
 		for (i = 0; i < 2; i++) {
@@ -1040,7 +1399,9 @@ static void atmel_shutdown(struct uart_port *port)
 			kfree(pdc->buf);
 		}
 	}
-	if (atmel_use_dma_tx(port)) {
+	if (atmel_use_chan_tx(port)) {
+		atmel_release_chan_tx(port);
+	} else if (atmel_use_dma_tx(port)) {
 		struct atmel_dma_buffer *pdc = &atmel_port->pdc_tx;
 
 		dma_unmap_single(port->dev,
@@ -1076,7 +1437,10 @@ static void atmel_flush_buffer(struct uart_port *port)
 {
 	struct atmel_uart_port *atmel_port = to_atmel_uart_port(port);
 
-	if (atmel_use_dma_tx(port)) {
+	if (atmel_use_chan_tx(port)) {
+		dmaengine_terminate_all(atmel_port->chan_tx);
+		atmel_port->dma_tx.ofs = 0;
+	} else if (atmel_use_dma_tx(port)) {
 		UART_PUT_TCR(port, 0);
 		atmel_port->pdc_tx.ofs = 0;
 	}
@@ -1189,7 +1553,7 @@ static void atmel_set_termios(struct uart_port *port, struct ktermios *termios,
 	if (termios->c_iflag & (BRKINT | PARMRK))
 		port->read_status_mask |= ATMEL_US_RXBRK;
 
-	if (atmel_use_dma_rx(port))
+	if (atmel_use_dma_rx(port) || atmel_use_chan_rx(port))
 		/* need to enable error interrupts */
 		UART_PUT_IER(port, port->read_status_mask);
 
@@ -1466,6 +1830,10 @@ static void __devinit atmel_init_port(struct atmel_uart_port *atmel_port,
 		atmel_port->use_dma_rx	= pdata->use_dma_rx;
 		atmel_port->use_dma_tx	= pdata->use_dma_tx;
 		atmel_port->rs485	= pdata->rs485;
+#ifdef CONFIG_SERIAL_ATMEL_DMA
+		atmel_port->dma_rx_slave = pdata->dma_rx_slave;
+		atmel_port->dma_tx_slave = pdata->dma_tx_slave;
+#endif
 	}
 
 	port->iotype		= UPIO_MEM;
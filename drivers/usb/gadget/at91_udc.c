@@ -112,6 +112,11 @@ static void proc_ep_show(struct seq_file *s, struct at91_ep *ep)
 				? (ep->fifo_bank ? "pong" : "ping")
 				: "",
 			ep->stopped ? " stopped" : "");
+	if (ep->fifo_staged)
+		seq_printf(s, "staged %d%s\n", ep->staged_len,
+				ep->staged_last ? " (last)" : "");
+	else if (ep->last_sent)
+		seq_printf(s, "last packet sent\n");
 	seq_printf(s, "csr %08x rxbytes=%d %s %s %s" EIGHTBITS "\n",
 		csr,
 		(csr & 0x07ff0000) >> 16,
@@ -377,20 +382,46 @@ rescan:
 	return is_done;
 }
 
-/* load fifo for an IN packet */
+/*
+ * Writes to TXPKTRDY cross from the MCK to the UDPCK clock domain and take
+ * a few cycles to show up in the CSR.  Wait for that before loading the
+ * other bank, else the data would land in the bank just handed over.
+ */
+static int wait_txpktrdy(struct at91_ep *ep)
+{
+	unsigned	i;
+
+	for (i = 0; i < 32; i++) {
+		if (__raw_readl(ep->creg) & AT91_UDP_TXPKTRDY)
+			return 0;
+	}
+
+	ERR("%s: TXPKTRDY not set\n", ep->ep.name);
+	return -ETIMEDOUT;
+}
+
+/*
+ * load fifo for IN packets; on pingpong endpoints, the idle bank is
+ * loaded too (see handle_ep), so the next packet is ready to go as soon
+ * as the current one has been sent.  Only packets of the same request
+ * are staged that way, and a pingpong request completes on the TXCOMP
+ * of its last packet, so the fifo never holds data of a request that
+ * was already given back.
+ */
 static int write_fifo(struct at91_ep *ep, struct at91_request *req)
 {
 	u32 __iomem	*creg = ep->creg;
 	u32		csr = __raw_readl(creg);
 	u8 __iomem	*dreg = ep->creg + (AT91_UDP_FDR(0) - AT91_UDP_CSR(0));
-	unsigned	total, count, is_last;
+	unsigned	total, count, is_last, stage = 0;
 	u8		*buf;
 
 	/*
-	 * TODO: allow for writing two packets to the fifo ... that'll
-	 * reduce the amount of IN-NAKing, but probably won't affect
-	 * throughput much.  (Unlike preventing OUT-NAKing!)
+	 * the idle bank already holds this request's next packet, or its
+	 * last packet has been handed over already
 	 */
+	if (ep->fifo_staged || ep->last_sent)
+		return 0;
 
 	/*
 	 * If ep_queue() calls us, the queue is empty and possibly in
@@ -405,45 +436,106 @@ static int write_fifo(struct at91_ep *ep, struct at91_request *req)
 			__raw_writel(csr, creg);
 			csr = __raw_readl(creg);
 		}
-		if (csr & AT91_UDP_TXPKTRDY)
-			return 0;
+		if (csr & AT91_UDP_TXPKTRDY) {
+			if (!ep->is_pingpong)
+				return 0;
+			stage = 1;
+		}
 	}
 
 	buf = req->req.buf + req->req.actual;
 	prefetch(buf);
 	total = req->req.length - req->req.actual;
-	if (ep->ep.maxpacket < total) {
-		count = ep->ep.maxpacket;
-		is_last = 0;
-	} else {
-		count = total;
-		is_last = (count < ep->ep.maxpacket) || !req->req.zero;
+
+	for (;;) {
+		if (ep->ep.maxpacket < total) {
+			count = ep->ep.maxpacket;
+			is_last = 0;
+		} else {
+			count = total;
+			is_last = (count < ep->ep.maxpacket) || !req->req.zero;
+		}
+
+		/*
+		 * Write the packet, maybe it's a ZLP.  The UDP data register
+		 * moves a byte per access, so there's no wider access to use.
+		 *
+		 * NOTE:  incrementing req->actual before we receive the ACK
+		 * means gadget driver IN bytecounts can be wrong in fault
+		 * cases.  That's fixable with PIO drivers like this one (save
+		 * "count" here, and do the increment later on TX irq), but
+		 * not for most DMA hardware.
+		 *
+		 * So all gadget drivers must accept that potential error.
+		 * Some hardware supports precise fifo status reporting,
+		 * letting them recover when the actual bytecount matters
+		 * (e.g. for USB Test and Measurement Class devices).
+		 */
+		__raw_writesb(dreg, buf, count);
+		req->req.actual += count;
+
+		if (stage) {
+			/* TXPKTRDY is set for it when the busy bank is sent */
+			ep->fifo_staged = 1;
+			ep->staged_last = is_last;
+			ep->staged_len = count;
+			PACKET("%s %p in/%d staged%s\n", ep->ep.name,
+					&req->req, count,
+					is_last ? " (last)" : "");
+			return 0;
+		}
+
+		csr &= ~SET_FX;
+		csr |= CLR_FX | AT91_UDP_TXPKTRDY;
+		__raw_writel(csr, creg);
+
+		PACKET("%s %p in/%d%s\n", ep->ep.name, &req->req, count,
+				is_last ? " (done)" : "");
+		if (is_last) {
+			if (ep->is_pingpong) {
+				/* completed by handle_ep() on TXCOMP */
+				ep->last_sent = 1;
+				return 0;
+			}
+			done(ep, req, 0);
+			return 1;
+		}
+		if (!ep->is_pingpong)
+			return 0;
+
+		/* load the next packet into the other bank */
+		if (wait_txpktrdy(ep))
+			return 0;
+		buf += count;
+		total -= count;
+		stage = 1;
 	}
+}
 
-	/*
-	 * Write the packet, maybe it's a ZLP.
-	 *
-	 * NOTE:  incrementing req->actual before we receive the ACK means
-	 * gadget driver IN bytecounts can be wrong in fault cases.  That's
-	 * fixable with PIO drivers like this one (save "count" here, and
-	 * do the increment later on TX irq), but not for most DMA hardware.
-	 *
-	 * So all gadget drivers must accept that potential error.  Some
-	 * hardware supports precise fifo status reporting, letting them
-	 * recover when the actual bytecount matters (e.g. for USB Test
-	 * and Measurement Class devices).
-	 */
-	__raw_writesb(dreg, buf, count);
-	csr &= ~SET_FX;
-	csr |= CLR_FX | AT91_UDP_TXPKTRDY;
-	__raw_writel(csr, creg);
-	req->req.actual += count;
+/*
+ * Drop a packet staged in the idle bank after the fifo was reset; the
+ * request it came from will load it again.  A request whose last packet
+ * was already handed over is given back, rather than ending with a
+ * stray ZLP.
+ */
+static void unstage_fifo(struct at91_ep *ep)
+{
+	struct at91_request	*req;
 
-	PACKET("%s %p in/%d%s\n", ep->ep.name, &req->req, count,
-			is_last ? " (done)" : "");
-	if (is_last)
+	if (list_empty(&ep->queue)) {
+		ep->fifo_staged = 0;
+		ep->last_sent = 0;
+		return;
+	}
+	req = list_entry(ep->queue.next, struct at91_request, queue);
+
+	if (ep->fifo_staged) {
+		ep->fifo_staged = 0;
+		req->req.actual -= ep->staged_len;
+	} else if (ep->last_sent) {
+		ep->last_sent = 0;
 		done(ep, req, 0);
-	return is_last;
+	}
 }
 
 static void nuke(struct at91_ep *ep, int status)
@@ -452,6 +544,8 @@ static void nuke(struct at91_ep *ep, int status)
 
 	/* terminate any request in the queue */
 	ep->stopped = 1;
+	ep->fifo_staged = 0;
+	ep->last_sent = 0;
 	if (list_empty(&ep->queue))
 		return;
 
@@ -531,6 +625,8 @@ ok:
 
 	ep->desc = desc;
 	ep->ep.maxpacket = maxpacket;
+	ep->fifo_staged = 0;
+	ep->last_sent = 0;
 
 	/*
 	 * reset/init endpoint fifo.  NOTE:  leaves fifo_bank alone,
@@ -723,6 +819,19 @@ static int at91_ep_dequeue(struct usb_ep *_ep, struct usb_request *_req)
 		return -EINVAL;
 	}
 
+	/*
+	 * Only the head request can have data in the fifo, so resetting
+	 * it to drop a staged packet loses nothing else.
+	 */
+	if (ep->queue.next == &req->queue) {
+		if (ep->fifo_staged) {
+			at91_udp_write(udc, AT91_UDP_RST_EP, ep->int_mask);
+			at91_udp_write(udc, AT91_UDP_RST_EP, 0);
+			ep->fifo_staged = 0;
+		}
+		ep->last_sent = 0;
+	}
+
 	done(ep, req, -ECONNRESET);
 	spin_unlock_irqrestore(&udc->lock, flags);
 	return 0;
@@ -834,6 +943,8 @@ static void udc_reinit(struct at91_udc *udc)
 		ep->desc = NULL;
 		ep->stopped = 0;
 		ep->fifo_bank = 0;
+		ep->fifo_staged = 0;
+		ep->last_sent = 0;
 		ep->ep.maxpacket = ep->maxpacket;
 		ep->creg = (void __iomem *) udc->udp_baseaddr + AT91_UDP_CSR(i);
 		/* initialize one queue per endpoint */
@@ -998,26 +1109,57 @@ static const struct usb_gadget_ops at91_udc_ops = {
 
 /*-------------------------------------------------------------------------*/
 
+static inline struct at91_request *next_request(struct at91_ep *ep)
+{
+	if (list_empty(&ep->queue))
+		return NULL;
+	return list_entry(ep->queue.next, struct at91_request, queue);
+}
+
+/*
+ * Pingpong endpoints keep both banks busy, and several packets may be
+ * handled per irq:  for IN, the staged packet is sent as soon as the
+ * other bank is free and the freed bank is loaded again right away, and
+ * a request completes once its last packet has been sent; for OUT, both
+ * banks are drained, even across request boundaries.
+ */
 static int handle_ep(struct at91_ep *ep)
 {
-	struct at91_request	*req;
+	struct at91_request	*req = next_request(ep);
 	u32 __iomem		*creg = ep->creg;
 	u32			csr = __raw_readl(creg);
-
-	if (!list_empty(&ep->queue))
-		req = list_entry(ep->queue.next,
-			struct at91_request, queue);
-	else
-		req = NULL;
+	int			is_done = 0;
 
 	if (ep->is_in) {
 		if (csr & (AT91_UDP_STALLSENT | AT91_UDP_TXCOMP)) {
+			unsigned	txcomp = csr & AT91_UDP_TXCOMP;
+			unsigned	release = txcomp && ep->fifo_staged;
+
 			csr |= CLR_FX;
 			csr &= ~(SET_FX | AT91_UDP_STALLSENT | AT91_UDP_TXCOMP);
+			if (release) {
+				/* the staged packet goes out next */
+				csr |= AT91_UDP_TXPKTRDY;
+				ep->fifo_staged = 0;
+			}
 			__raw_writel(csr, creg);
+
+			if (release) {
+				if (ep->staged_last)
+					ep->last_sent = 1;
+				/* don't load the bank just handed over */
+				if (wait_txpktrdy(ep))
+					return 0;
+			} else if (txcomp && ep->last_sent && req) {
+				/* the request's last packet is out */
+				ep->last_sent = 0;
+				done(ep, req, 0);
+				req = next_request(ep);
+				is_done = 1;
+			}
 		}
-		if (req)
-			return write_fifo(ep, req);
+		if (req && write_fifo(ep, req))
+			is_done = 1;
 
 	} else {
 		if (csr & AT91_UDP_STALLSENT) {
@@ -1029,10 +1171,19 @@ static int handle_ep(struct at91_ep *ep)
 			__raw_writel(csr, creg);
 			csr = __raw_readl(creg);
 		}
-		if (req && (csr & RX_DATA_READY))
-			return read_fifo(ep, req);
+		while (req && (csr & RX_DATA_READY)) {
+			if (!read_fifo(ep, req))
+				break;
+			is_done = 1;
+			if (!ep->is_pingpong)
+				break;
+			req = next_request(ep);
+
+			/* see read_fifo() about the RXBYTECNT glitch */
+			csr = __raw_readl(creg);
+		}
 	}
-	return 0;
+	return is_done;
 }
 
 union setup {
@@ -1226,6 +1377,7 @@ static void handle_setup(struct at91_udc *udc, struct at91_ep *ep, u32 csr)
 
 		at91_udp_write(udc, AT91_UDP_RST_EP, ep->int_mask);
 		at91_udp_write(udc, AT91_UDP_RST_EP, 0);
+		unstage_fifo(ep);
 		tmp = __raw_readl(ep->creg);
 		tmp |= CLR_FX;
 		tmp &= ~(SET_FX | AT91_UDP_FORCESTALL);
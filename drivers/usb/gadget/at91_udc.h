@@ -105,6 +105,10 @@ struct at91_ep {
 	unsigned			is_in:1;
 	unsigned			is_iso:1;
 	unsigned			fifo_bank:1;
+	unsigned			fifo_staged:1;
+	unsigned			staged_last:1;
+	unsigned			last_sent:1;
+	u16				staged_len;
 
 	const struct usb_endpoint_descriptor
 					*desc;
@@ -15,6 +15,7 @@
 #include <linux/slab.h>
 #include <linux/device.h>
 #include <linux/dma-mapping.h>
+#include <linux/dmapool.h>
 #include <linux/list.h>
 #include <linux/platform_device.h>
 #include <linux/usb/ch9.h>
@@ -369,16 +370,62 @@ static void next_fifo_transaction(struct usba_ep *ep, struct usba_request *req)
 	req->req.actual += transaction_len;
 }
 
+static inline bool usba_req_can_chain(struct usba_ep *ep,
+				      struct usba_request *req)
+{
+	return ep->is_in && req->desc && req->req.length && !req->req.zero;
+}
+
+/*
+ * Link the unsubmitted requests queued behind @req through their
+ * descriptors, so the controller moves from one buffer to the next on
+ * its own.  IN only: on OUT endpoints a short packet would end a buffer
+ * early and its length would be lost once the next descriptor loads.
+ * Requests only join a chain while the channel is idle; those queued
+ * later wait for the next chain.
+ */
+static void usba_dma_chain(struct usba_ep *ep, struct usba_request *first)
+{
+	struct usba_request *prev = first;
+	struct usba_request *next = first;
+
+	first->chain_next = 0;
+	if (!usba_req_can_chain(ep, first))
+		return;
+
+	list_for_each_entry_continue(next, &ep->queue, queue) {
+		if (next->submitted || !usba_req_can_chain(ep, next))
+			break;
+
+		next->desc->next = 0;
+		next->desc->addr = next->req.dma;
+		next->desc->ctrl = next->ctrl;
+		next->chain_next = 0;
+		next->submitted = 1;
+
+		/* the first request is linked through NXT_DSC directly */
+		prev->chain_next = next->desc_dma;
+		if (prev != first) {
+			prev->desc->next = next->desc_dma;
+			prev->desc->ctrl |= USBA_DMA_LINK;
+		}
+		prev = next;
+	}
+
+	/* descriptors must be in memory before the channel starts */
+	wmb();
+}
+
 static void submit_request(struct usba_ep *ep, struct usba_request *req)
 {
 	DBG(DBG_QUEUE, "%s: submit_request: req %p (length %d)\n",
 		ep->ep.name, req, req->req.length);
 
-	req->req.actual = 0;
-	req->submitted = 1;
-
 	if (req->using_dma) {
+		unsigned int remaining = req->req.length - req->req.actual;
+
 		if (req->req.length == 0) {
+			req->submitted = 1;
 			usba_ep_writel(ep, CTL_ENB, USBA_TX_PK_RDY);
 			return;
 		}
@@ -388,9 +435,16 @@ static void submit_request(struct usba_ep *ep, struct usba_request *req)
 		else
 			usba_ep_writel(ep, CTL_DIS, USBA_SHORT_PACKET);
 
-		usba_dma_writel(ep, ADDRESS, req->req.dma);
-		usba_dma_writel(ep, CONTROL, req->ctrl);
+		/* req->req.actual is non-zero when resuming after dequeue */
+		usba_dma_chain(ep, req);
+		req->submitted = 1;
+		usba_dma_writel(ep, NXT_DSC, req->chain_next);
+		usba_dma_writel(ep, ADDRESS, req->req.dma + req->req.actual);
+		usba_dma_writel(ep, CONTROL,
+				USBA_BFINS(DMA_BUF_LEN, remaining, req->ctrl)
+				| (req->chain_next ? USBA_DMA_LINK : 0));
 	} else {
+		req->submitted = 1;
 		next_fifo_transaction(ep, req);
 		if (req->last_transaction) {
 			usba_ep_writel(ep, CTL_DIS, USBA_TX_PK_RDY);
@@ -664,6 +718,7 @@ static int usba_ep_disable(struct usb_ep *_ep)
 	if (ep->can_dma) {
 		usba_dma_writel(ep, CONTROL, 0);
 		usba_dma_writel(ep, ADDRESS, 0);
+		usba_dma_writel(ep, NXT_DSC, 0);
 		usba_dma_readl(ep, STATUS);
 	}
 	usba_ep_writel(ep, CTL_DIS, USBA_EPT_ENABLE);
@@ -699,9 +754,12 @@ static void
 usba_ep_free_request(struct usb_ep *_ep, struct usb_request *_req)
 {
 	struct usba_request *req = to_usba_req(_req);
+	struct usba_ep *ep = to_usba_ep(_ep);
 
 	DBG(DBG_GADGET, "ep_free_request: %p, %p\n", _ep, _req);
 
+	if (req->desc)
+		dma_pool_free(ep->udc->desc_pool, req->desc, req->desc_dma);
 	kfree(req);
 }
 
@@ -741,9 +799,15 @@ static int queue_dma(struct usba_udc *udc, struct usba_ep *ep,
 			| USBA_DMA_CH_EN | USBA_DMA_END_BUF_IE
 			| USBA_DMA_END_TR_EN | USBA_DMA_END_TR_IE;
 
-	if (ep->is_in)
+	if (ep->is_in) {
 		req->ctrl |= USBA_DMA_END_BUF_EN;
 
+		/* without a descriptor, the request just isn't chained */
+		if (!req->desc && udc->desc_pool)
+			req->desc = dma_pool_alloc(udc->desc_pool, gfp_flags,
+						   &req->desc_dma);
+	}
+
 	/*
 	 * Add this request to the queue and submit for DMA if
 	 * possible. Check if we're still alive first -- we may have
@@ -752,10 +816,9 @@ static int queue_dma(struct usba_udc *udc, struct usba_ep *ep,
 	ret = -ESHUTDOWN;
 	spin_lock_irqsave(&udc->lock, flags);
 	if (ep->desc) {
-		if (list_empty(&ep->queue))
-			submit_request(ep, req);
-
 		list_add_tail(&req->queue, &ep->queue);
+		if (ep->queue.next == &req->queue)
+			submit_request(ep, req);
 		ret = 0;
 	}
 	spin_unlock_irqrestore(&udc->lock, flags);
@@ -781,6 +844,7 @@ usba_ep_queue(struct usb_ep *_ep, struct usb_request *_req, gfp_t gfp_flags)
 	req->submitted = 0;
 	req->using_dma = 0;
 	req->last_transaction = 0;
+	req->chain_next = 0;
 
 	_req->status = -EINPROGRESS;
 	_req->actual = 0;
@@ -814,6 +878,34 @@ usba_update_req(struct usba_ep *ep, struct usba_request *req, u32 status)
 	req->req.actual = req->req.length - USBA_BFEXT(DMA_BUF_LEN, status);
 }
 
+/*
+ * Move the submitted requests the DMA channel is done with to @done.
+ * While the channel is @running, NXT_DSC tells which request of the
+ * chain it is working on; that one is returned.  Returns NULL when the
+ * whole chain has been transferred.
+ */
+static struct usba_request *usba_dma_reap(struct usba_ep *ep, u32 status,
+		bool running, struct list_head *done)
+{
+	struct usba_request *req, *tmp_req;
+	dma_addr_t nxt_dsc = usba_dma_readl(ep, NXT_DSC);
+
+	list_for_each_entry_safe(req, tmp_req, &ep->queue, queue) {
+		if (!req->submitted)
+			break;
+		if (running && req->chain_next == nxt_dsc)
+			return req;
+
+		if (req->chain_next)
+			req->req.actual = req->req.length;
+		else
+			usba_update_req(ep, req, status);
+		list_move_tail(&req->queue, done);
+	}
+
+	return NULL;
+}
+
 static int stop_dma(struct usba_ep *ep, u32 *pstatus)
 {
 	unsigned int timeout;
@@ -851,7 +943,10 @@ static int usba_ep_dequeue(struct usb_ep *_ep, struct usb_request *_req)
 	struct usba_ep *ep = to_usba_ep(_ep);
 	struct usba_udc *udc = ep->udc;
 	struct usba_request *req = to_usba_req(_req);
+	struct usba_request *active, *tmp_req;
+	LIST_HEAD(done);
 	unsigned long flags;
+	bool running;
 	u32 status;
 
 	DBG(DBG_GADGET | DBG_QUEUE, "ep_dequeue: %s, req %p\n",
@@ -859,24 +954,33 @@ static int usba_ep_dequeue(struct usb_ep *_ep, struct usb_request *_req)
 
 	spin_lock_irqsave(&udc->lock, flags);
 
-	if (req->using_dma) {
+	if (req->using_dma && req->submitted) {
 		/*
-		 * If this request is currently being transferred,
-		 * stop the DMA controller and reset the FIFO.
+		 * This request is part of the chain being transferred.
+		 * Stop the DMA controller; requests it is done with are
+		 * completed, the others are chained again below.
 		 */
-		if (ep->queue.next == &req->queue) {
-			status = usba_dma_readl(ep, STATUS);
-			if (status & USBA_DMA_CH_EN)
-				stop_dma(ep, &status);
+		status = usba_dma_readl(ep, STATUS);
+		running = status & USBA_DMA_CH_EN;
+		if (running)
+			stop_dma(ep, &status);
 
 #ifdef CONFIG_USB_GADGET_DEBUG_FS
-			ep->last_dma_status = status;
+		ep->last_dma_status = status;
 #endif
 
+		active = usba_dma_reap(ep, status, running, &done);
+		if (active == req) {
+			/* stopped in the middle of it: reset the FIFO */
 			usba_writel(udc, EPT_RST, 1 << ep->index);
-
 			usba_update_req(ep, req, status);
+		} else if (active) {
+			/* submit_request() resumes it where it stopped */
+			usba_update_req(ep, active, status);
 		}
+
+		list_for_each_entry(tmp_req, &ep->queue, queue)
+			tmp_req->submitted = 0;
 	}
 
 	/*
@@ -886,6 +990,7 @@ static int usba_ep_dequeue(struct usb_ep *_ep, struct usb_request *_req)
 	list_del_init(&req->queue);
 
 	request_complete(ep, req, -ECONNRESET);
+	request_complete_list(ep, &done, 0);
 
 	/* Process the next request if any */
 	submit_next_request(ep);
@@ -1603,8 +1708,9 @@ static void usba_ep_irq(struct usba_udc *udc, struct usba_ep *ep)
 
 static void usba_dma_irq(struct usba_udc *udc, struct usba_ep *ep)
 {
-	struct usba_request *req;
+	struct usba_request *active;
 	u32 status, control, pending;
+	unsigned int timeout;
 
 	status = usba_dma_readl(ep, STATUS);
 	control = usba_dma_readl(ep, CONTROL);
@@ -1614,30 +1720,44 @@ static void usba_dma_irq(struct usba_udc *udc, struct usba_ep *ep)
 	pending = status & control;
 	DBG(DBG_INT | DBG_DMA, "dma irq, s/%#08x, c/%#08x\n", status, control);
 
-	if (status & USBA_DMA_CH_EN) {
-		dev_err(&udc->pdev->dev,
-			"DMA_CH_EN is set after transfer is finished!\n");
-		dev_err(&udc->pdev->dev,
-			"status=%#08x, pending=%#08x, control=%#08x\n",
-			status, pending, control);
-
-		/*
-		 * try to pretend nothing happened. We might have to
-		 * do something here...
-		 */
-	}
-
 	if (list_empty(&ep->queue))
 		/* Might happen if a reset comes along at the right moment */
 		return;
 
 	if (pending & (USBA_DMA_END_TR_ST | USBA_DMA_END_BUF_ST)) {
-		req = list_entry(ep->queue.next, struct usba_request, queue);
-		usba_update_req(ep, req, status);
+		LIST_HEAD(done);
 
-		list_del_init(&req->queue);
-		submit_next_request(ep);
-		request_complete(ep, req, 0);
+		/*
+		 * Complete everything the chain got through since the
+		 * last interrupt; the channel carries on with the rest.
+		 */
+		active = usba_dma_reap(ep, status, status & USBA_DMA_CH_EN,
+				       &done);
+		if (active && list_empty(&done)) {
+			/*
+			 * The end of a buffer can be flagged before CH_EN
+			 * drops or NXT_DSC moves on.  Give the channel a few
+			 * microseconds; if it is still busy, leave the chain
+			 * alone, it is completed from a later interrupt.
+			 */
+			for (timeout = 40; timeout; --timeout) {
+				status = usba_dma_readl(ep, STATUS);
+				if (!(status & USBA_DMA_CH_EN))
+					break;
+				udelay(1);
+			}
+			if (status & USBA_DMA_CH_EN) {
+				DBG(DBG_DMA, "%s: DMA still busy, s/%#08x\n",
+				    ep->ep.name, status);
+				return;
+			}
+			active = usba_dma_reap(ep, status, false, &done);
+		}
+
+		/* start the next chain before running the callbacks */
+		if (!active)
+			submit_next_request(ep);
+		request_complete_list(ep, &done, 0);
 	}
 }
 
@@ -1950,6 +2070,12 @@ static int __init usba_udc_probe(struct platform_device *pdev)
 	if (!usba_ep)
 		goto err_alloc_ep;
 
+	/* DMA descriptors for chaining requests; optional */
+	udc->desc_pool = dma_pool_create("usba_desc", &pdev->dev,
+					 sizeof(struct usba_dma_desc), 16, 0);
+	if (!udc->desc_pool)
+		dev_warn(&pdev->dev, "no descriptor pool, not chaining DMA\n");
+
 	the_udc.gadget.ep0 = &usba_ep[0].ep;
 
 	INIT_LIST_HEAD(&usba_ep[0].ep.ep_list);
@@ -2045,6 +2171,8 @@ err_add_udc:
 err_device_add:
 	free_irq(irq, udc);
 err_request_irq:
+	if (udc->desc_pool)
+		dma_pool_destroy(udc->desc_pool);
 	kfree(usba_ep);
 err_alloc_ep:
 	iounmap(udc->fifo);
@@ -2080,6 +2208,8 @@ static int __exit usba_udc_remove(struct platform_device *pdev)
 	}
 
 	free_irq(udc->irq, udc);
+	if (udc->desc_pool)
+		dma_pool_destroy(udc->desc_pool);
 	kfree(usba_ep);
 	iounmap(udc->fifo);
 	iounmap(udc->regs);
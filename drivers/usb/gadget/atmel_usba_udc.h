@@ -305,6 +305,12 @@ struct usba_request {
 
 	u32					ctrl;
 
+	/* hardware descriptor, to be linked behind another request */
+	struct usba_dma_desc			*desc;
+	dma_addr_t				desc_dma;
+	/* NXT_DSC while this request is transferred, 0 if last */
+	dma_addr_t				chain_next;
+
 	unsigned int				submitted:1;
 	unsigned int				last_transaction:1;
 	unsigned int				using_dma:1;
@@ -326,6 +332,7 @@ struct usba_udc {
 	int vbus_pin_inverted;
 	struct clk *pclk;
 	struct clk *hclk;
+	struct dma_pool *desc_pool;
 
 	u16 devstatus;
 
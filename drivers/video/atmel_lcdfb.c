@@ -11,6 +11,7 @@
 #include <linux/kernel.h>
 #include <linux/platform_device.h>
 #include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
 #include <linux/interrupt.h>
 #include <linux/clk.h>
 #include <linux/fb.h>
@@ -19,6 +20,8 @@
 #include <linux/backlight.h>
 #include <linux/gfp.h>
 #include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
 
 #include <mach/board.h>
 #include <mach/cpu.h>
@@ -761,6 +764,425 @@ static int atmel_lcdfb_blank(int blank_mode, struct fb_info *info)
 	return ((blank_mode == FB_BLANK_NORMAL) ? 1 : 0);
 }
 
+#ifdef CONFIG_FB_ATMEL_DMA
+/*
+ * Drawing acceleration.  A DMA channel able to do strided memory to memory
+ * copies (one chunk per line) is all that copyarea needs, and fillrect too
+ * once the CPU has drawn the first line.  The transfers are polled for
+ * before returning, which is fine with the console lock held; in atomic
+ * context, or for areas too small to be worth setting up the DMA, the
+ * cfb_* routines do the job.
+ */
+#define ATMEL_LCDFB_DMA_MIN_LEN		4096	/* bytes */
+#define ATMEL_LCDFB_DMA_MIN_BAND	4	/* lines */
+
+static void atmel_lcdfb_init_dma(struct atmel_lcdfb_info *sinfo)
+{
+	dma_cap_mask_t mask;
+
+	sinfo->dma_xt = kzalloc(sizeof(struct dma_interleaved_template)
+				+ sizeof(struct data_chunk), GFP_KERNEL);
+	if (!sinfo->dma_xt)
+		return;
+
+	dma_cap_zero(mask);
+	dma_cap_set(DMA_INTERLEAVE, mask);
+	sinfo->dma_chan = dma_request_channel(mask, NULL, NULL);
+	if (!sinfo->dma_chan) {
+		kfree(sinfo->dma_xt);
+		sinfo->dma_xt = NULL;
+		return;
+	}
+
+	dev_info(&sinfo->pdev->dev, "using %s for drawing\n",
+		 dma_chan_name(sinfo->dma_chan));
+}
+
+static void atmel_lcdfb_exit_dma(struct atmel_lcdfb_info *sinfo)
+{
+	if (sinfo->dma_chan)
+		dma_release_channel(sinfo->dma_chan);
+	sinfo->dma_chan = NULL;
+	kfree(sinfo->dma_xt);
+	sinfo->dma_xt = NULL;
+}
+
+static bool atmel_lcdfb_can_dma(struct fb_info *info,
+				u32 x, u32 width, u32 height)
+{
+	struct atmel_lcdfb_info *sinfo = info->par;
+	u32 bpp = info->var.bits_per_pixel;
+
+	if (!sinfo->dma_chan || info->state != FBINFO_STATE_RUNNING)
+		return false;
+	if (in_interrupt() || irqs_disabled())
+		return false;
+
+	/* the DMA moves whole bytes */
+	if ((x * bpp) % 8 || (width * bpp) % 8)
+		return false;
+
+	return width * height * bpp / 8 >= ATMEL_LCDFB_DMA_MIN_LEN;
+}
+
+/* queue a copy of @lines lines of @len bytes each */
+static dma_cookie_t atmel_lcdfb_dma_copy(struct atmel_lcdfb_info *sinfo,
+		dma_addr_t dst, dma_addr_t src, size_t len, u32 lines)
+{
+	struct dma_chan *chan = sinfo->dma_chan;
+	struct dma_interleaved_template *xt = sinfo->dma_xt;
+	struct dma_async_tx_descriptor *desc;
+
+	xt->src_start = src;
+	xt->dst_start = dst;
+	xt->dir = DMA_MEM_TO_MEM;
+	xt->src_inc = true;
+	xt->dst_inc = true;
+	xt->src_sgl = true;
+	xt->dst_sgl = true;
+	xt->numf = lines;
+	xt->frame_size = 1;
+	xt->sgl[0].size = len;
+	xt->sgl[0].icg = sinfo->info->fix.line_length - len;
+
+	desc = chan->device->device_prep_interleaved_dma(chan, xt,
+							 DMA_CTRL_ACK);
+	if (!desc)
+		return -ENOMEM;
+
+	return dmaengine_submit(desc);
+}
+
+/* wait for the copies queued so far, up to the one with @cookie */
+static bool atmel_lcdfb_dma_wait(struct atmel_lcdfb_info *sinfo,
+				 dma_cookie_t cookie)
+{
+	if (cookie <= 0)
+		return true;
+	if (dma_sync_wait(sinfo->dma_chan, cookie) == DMA_SUCCESS)
+		return true;
+
+	dev_warn(&sinfo->pdev->dev, "drawing DMA timed out\n");
+	dmaengine_terminate_all(sinfo->dma_chan);
+	return false;
+}
+
+static void atmel_lcdfb_dma_fillrect(struct fb_info *info,
+				     const struct fb_fillrect *rect)
+{
+	struct atmel_lcdfb_info *sinfo = info->par;
+	struct fb_fillrect part = *rect;
+	u32 line = info->fix.line_length;
+	size_t len = rect->width * info->var.bits_per_pixel / 8;
+	dma_addr_t first;
+	dma_cookie_t cookie = 0, ret;
+	u32 done, n;
+
+	if (rect->rop != ROP_COPY || rect->height < 2
+	    || !atmel_lcdfb_can_dma(info, rect->dx, rect->width, rect->height)) {
+		cfb_fillrect(info, rect);
+		return;
+	}
+
+	/* draw the first line, then keep doubling what's been filled */
+	part.height = 1;
+	cfb_fillrect(info, &part);
+	wmb();
+
+	first = info->fix.smem_start + rect->dy * line
+		+ rect->dx * info->var.bits_per_pixel / 8;
+	for (done = 1; done < rect->height; done += n) {
+		n = min(done, rect->height - done);
+		ret = atmel_lcdfb_dma_copy(sinfo, first + done * line, first,
+					   len, n);
+		if (ret < 0)
+			break;
+		cookie = ret;
+	}
+
+	if (!atmel_lcdfb_dma_wait(sinfo, cookie))
+		done = 0;
+
+	/* out of descriptors: finish by hand */
+	if (done < rect->height) {
+		part.dy = rect->dy + done;
+		part.height = rect->height - done;
+		cfb_fillrect(info, &part);
+	}
+}
+
+static void atmel_lcdfb_dma_copyarea(struct fb_info *info,
+				     const struct fb_copyarea *area)
+{
+	struct atmel_lcdfb_info *sinfo = info->par;
+	struct fb_copyarea part = *area;
+	u32 bpp = info->var.bits_per_pixel;
+	u32 line = info->fix.line_length;
+	size_t len = area->width * bpp / 8;
+	dma_addr_t src, dst;
+	dma_cookie_t cookie;
+	u32 band, left, n;
+
+	if (!atmel_lcdfb_can_dma(info, area->sx | area->dx,
+				 area->width, area->height))
+		goto soft;
+
+	/* addresses only increment: a line can't move right onto itself */
+	if (area->dy == area->sy && area->dx > area->sx
+	    && area->dx < area->sx + area->width)
+		goto soft;
+
+	src = info->fix.smem_start + area->sy * line + area->sx * bpp / 8;
+	dst = info->fix.smem_start + area->dy * line + area->dx * bpp / 8;
+	wmb();
+
+	if (area->dy <= area->sy || area->dy >= area->sy + area->height) {
+		cookie = atmel_lcdfb_dma_copy(sinfo, dst, src, len,
+					      area->height);
+		if (cookie < 0)
+			goto soft;
+		if (!atmel_lcdfb_dma_wait(sinfo, cookie))
+			goto soft;
+		return;
+	}
+
+	/*
+	 * Moving down over itself: copy bands no taller than the distance
+	 * moved, the bottom one first, so no line is overwritten before it
+	 * has been copied.
+	 */
+	band = area->dy - area->sy;
+	if (band < ATMEL_LCDFB_DMA_MIN_BAND)
+		goto soft;
+
+	cookie = 0;
+	for (left = area->height; left; left -= n) {
+		dma_cookie_t ret;
+
+		n = min(left, band);
+		ret = atmel_lcdfb_dma_copy(sinfo, dst + (left - n) * line,
+					   src + (left - n) * line, len, n);
+		if (ret < 0)
+			break;
+		cookie = ret;
+	}
+	if (!atmel_lcdfb_dma_wait(sinfo, cookie))
+		goto soft;
+
+	/* out of descriptors: the top bands are left to do by hand */
+	if (left) {
+		part.height = left;
+		cfb_copyarea(info, &part);
+	}
+	return;
+
+soft:
+	cfb_copyarea(info, area);
+}
+#else
+static inline void atmel_lcdfb_init_dma(struct atmel_lcdfb_info *sinfo)
+{
+}
+
+static inline void atmel_lcdfb_exit_dma(struct atmel_lcdfb_info *sinfo)
+{
+}
+
+#define atmel_lcdfb_dma_fillrect	cfb_fillrect
+#define atmel_lcdfb_dma_copyarea	cfb_copyarea
+#endif
+
+#ifdef CONFIG_FB_ATMEL_DEFIO
+/*
+ * Deferred I/O.  Everything is drawn into a cached shadow of the frame
+ * buffer; pages written through mmap() are tracked by fb_defio, all other
+ * drawing widens a damage range.  At most every ATMEL_LCDFB_DEFIO_DELAY,
+ * or on fsync(), just those parts are copied to the scanout buffer.
+ */
+#define ATMEL_LCDFB_DEFIO_DELAY		(HZ / 25)
+
+static void atmel_lcdfb_damage(struct fb_info *info,
+			       unsigned long start, unsigned long end)
+{
+	struct atmel_lcdfb_info *sinfo = info->par;
+	unsigned long flags;
+
+	end = min_t(unsigned long, end, info->fix.smem_len);
+	if (start >= end)
+		return;
+
+	spin_lock_irqsave(&sinfo->lock, flags);
+	if (sinfo->damage_start >= sinfo->damage_end) {
+		sinfo->damage_start = start;
+		sinfo->damage_end = end;
+	} else {
+		sinfo->damage_start = min(sinfo->damage_start, start);
+		sinfo->damage_end = max(sinfo->damage_end, end);
+	}
+	spin_unlock_irqrestore(&sinfo->lock, flags);
+
+	schedule_delayed_work(&info->deferred_work, info->fbdefio->delay);
+}
+
+static inline void atmel_lcdfb_damage_lines(struct fb_info *info,
+					    u32 y, u32 height)
+{
+	atmel_lcdfb_damage(info, y * info->fix.line_length,
+			   (y + height) * info->fix.line_length);
+}
+
+static void atmel_lcdfb_flush(struct atmel_lcdfb_info *sinfo,
+			      unsigned long offs, unsigned long len)
+{
+	struct fb_info *info = sinfo->info;
+
+	memcpy((void __force *)sinfo->screen + offs,
+	       (void __force *)info->screen_base + offs, len);
+}
+
+static void atmel_lcdfb_deferred_io(struct fb_info *info,
+				    struct list_head *pagelist)
+{
+	struct atmel_lcdfb_info *sinfo = info->par;
+	unsigned long start, end, offs;
+	struct page *page;
+
+	spin_lock_irq(&sinfo->lock);
+	start = sinfo->damage_start;
+	end = sinfo->damage_end;
+	sinfo->damage_start = 0;
+	sinfo->damage_end = 0;
+	spin_unlock_irq(&sinfo->lock);
+
+	list_for_each_entry(page, pagelist, lru) {
+		offs = page->index << PAGE_SHIFT;
+		if (offs >= start && offs + PAGE_SIZE <= end)
+			continue;
+		atmel_lcdfb_flush(sinfo, offs,
+				  min_t(unsigned long, PAGE_SIZE,
+					info->fix.smem_len - offs));
+	}
+
+	if (start < end)
+		atmel_lcdfb_flush(sinfo, start, end - start);
+}
+
+static struct fb_deferred_io atmel_lcdfb_defio = {
+	.delay		= ATMEL_LCDFB_DEFIO_DELAY,
+	.deferred_io	= atmel_lcdfb_deferred_io,
+};
+
+static int atmel_lcdfb_init_shadow(struct atmel_lcdfb_info *sinfo)
+{
+	struct fb_info *info = sinfo->info;
+	void *shadow;
+
+	shadow = vmalloc(info->fix.smem_len);
+	if (!shadow)
+		return -ENOMEM;
+
+	/* keep whatever is on screen, maybe a splash image */
+	memcpy(shadow, (void __force *)info->screen_base, info->fix.smem_len);
+
+	spin_lock_init(&sinfo->lock);
+	sinfo->screen = info->screen_base;
+	info->screen_base = (char __iomem __force *)shadow;
+	info->flags |= FBINFO_VIRTFB;
+
+	info->fbdefio = &atmel_lcdfb_defio;
+	fb_deferred_io_init(info);
+
+	return 0;
+}
+
+static void atmel_lcdfb_exit_shadow(struct atmel_lcdfb_info *sinfo)
+{
+	struct fb_info *info = sinfo->info;
+
+	if (!sinfo->screen)
+		return;
+
+	fb_deferred_io_cleanup(info);
+	info->fbdefio = NULL;
+
+	vfree((void __force *)info->screen_base);
+	info->screen_base = sinfo->screen;
+	info->flags &= ~FBINFO_VIRTFB;
+	sinfo->screen = NULL;
+}
+
+static inline bool atmel_lcdfb_shadowed(struct fb_info *info)
+{
+	return info->fbdefio != NULL;
+}
+
+static ssize_t atmel_lcdfb_write(struct fb_info *info, const char __user *buf,
+				 size_t count, loff_t *ppos)
+{
+	loff_t pos = *ppos;
+	ssize_t ret;
+
+	ret = fb_sys_write(info, buf, count, ppos);
+	if (ret > 0)
+		atmel_lcdfb_damage(info, pos, pos + ret);
+
+	return ret;
+}
+#else
+static inline int atmel_lcdfb_init_shadow(struct atmel_lcdfb_info *sinfo)
+{
+	return 0;
+}
+
+static inline void atmel_lcdfb_exit_shadow(struct atmel_lcdfb_info *sinfo)
+{
+}
+
+static inline bool atmel_lcdfb_shadowed(struct fb_info *info)
+{
+	return false;
+}
+
+static inline void atmel_lcdfb_damage_lines(struct fb_info *info,
+					    u32 y, u32 height)
+{
+}
+
+#endif
+
+static void atmel_lcdfb_fillrect(struct fb_info *info,
+				 const struct fb_fillrect *rect)
+{
+	if (atmel_lcdfb_shadowed(info)) {
+		sys_fillrect(info, rect);
+		atmel_lcdfb_damage_lines(info, rect->dy, rect->height);
+	} else {
+		atmel_lcdfb_dma_fillrect(info, rect);
+	}
+}
+
+static void atmel_lcdfb_copyarea(struct fb_info *info,
+				 const struct fb_copyarea *area)
+{
+	if (atmel_lcdfb_shadowed(info)) {
+		sys_copyarea(info, area);
+		atmel_lcdfb_damage_lines(info, area->dy, area->height);
+	} else {
+		atmel_lcdfb_dma_copyarea(info, area);
+	}
+}
+
+static void atmel_lcdfb_imageblit(struct fb_info *info,
+				  const struct fb_image *image)
+{
+	if (atmel_lcdfb_shadowed(info)) {
+		sys_imageblit(info, image);
+		atmel_lcdfb_damage_lines(info, image->dy, image->height);
+	} else {
+		cfb_imageblit(info, image);
+	}
+}
+
 static struct fb_ops atmel_lcdfb_ops = {
 	.owner		= THIS_MODULE,
 	.fb_check_var	= atmel_lcdfb_check_var,
@@ -768,9 +1190,13 @@ static struct fb_ops atmel_lcdfb_ops = {
 	.fb_setcolreg	= atmel_lcdfb_setcolreg,
 	.fb_blank	= atmel_lcdfb_blank,
 	.fb_pan_display	= atmel_lcdfb_pan_display,
-	.fb_fillrect	= cfb_fillrect,
-	.fb_copyarea	= cfb_copyarea,
-	.fb_imageblit	= cfb_imageblit,
+	.fb_fillrect	= atmel_lcdfb_fillrect,
+	.fb_copyarea	= atmel_lcdfb_copyarea,
+	.fb_imageblit	= atmel_lcdfb_imageblit,
+#ifdef CONFIG_FB_ATMEL_DEFIO
+	.fb_read	= fb_sys_read,
+	.fb_write	= atmel_lcdfb_write,
+#endif
 };
 
 static irqreturn_t atmel_lcdfb_interrupt(int irq, void *dev_id)
@@ -953,6 +1379,12 @@ static int __init atmel_lcdfb_probe(struct platform_device *pdev)
 		}
 	}
 
+	ret = atmel_lcdfb_init_shadow(sinfo);
+	if (ret < 0) {
+		dev_err(dev, "cannot allocate shadow framebuffer\n");
+		goto free_fb;
+	}
+
 	/* LCDC registers */
 	info->fix.mmio_start = regs->start;
 	info->fix.mmio_len = resource_size(regs);
@@ -1003,13 +1435,15 @@ static int __init atmel_lcdfb_probe(struct platform_device *pdev)
 
 	dev_set_drvdata(dev, info);
 
+	atmel_lcdfb_init_dma(sinfo);
+
 	/*
 	 * Tell the world that we're ready to go
 	 */
 	ret = register_framebuffer(info);
 	if (ret < 0) {
 		dev_err(dev, "failed to register framebuffer device: %d\n", ret);
-		goto reset_drvdata;
+		goto exit_dma;
 	}
 
 	/* add selected videomode to modelist */
@@ -1025,7 +1459,8 @@ static int __init atmel_lcdfb_probe(struct platform_device *pdev)
 
 	return 0;
 
-reset_drvdata:
+exit_dma:
+	atmel_lcdfb_exit_dma(sinfo);
 	dev_set_drvdata(dev, NULL);
 free_cmap:
 	fb_dealloc_cmap(&info->cmap);
@@ -1038,6 +1473,7 @@ unmap_mmio:
 release_mem:
  	release_mem_region(info->fix.mmio_start, info->fix.mmio_len);
 free_fb:
+	atmel_lcdfb_exit_shadow(sinfo);
 	if (map)
 		iounmap(info->screen_base);
 	else
@@ -1074,6 +1510,7 @@ static int __exit atmel_lcdfb_remove(struct platform_device *pdev)
 	if (sinfo->atmel_lcdfb_power_control)
 		sinfo->atmel_lcdfb_power_control(0);
 	unregister_framebuffer(info);
+	atmel_lcdfb_exit_dma(sinfo);
 	atmel_lcdfb_stop_clock(sinfo);
 	clk_put(sinfo->lcdc_clk);
 	if (sinfo->bus_clk)
@@ -1082,6 +1519,7 @@ static int __exit atmel_lcdfb_remove(struct platform_device *pdev)
 	free_irq(sinfo->irq_base, info);
 	iounmap(sinfo->mmio);
  	release_mem_region(info->fix.mmio_start, info->fix.mmio_len);
+	atmel_lcdfb_exit_shadow(sinfo);
 	if (platform_get_resource(pdev, IORESOURCE_MEM, 1)) {
 		iounmap(info->screen_base);
 		release_mem_region(info->fix.smem_start, info->fix.smem_len);
@@ -7,6 +7,7 @@
 struct ssc_device {
 	struct list_head	list;
 	void __iomem		*regs;
+	resource_size_t		phybase;
 	struct platform_device	*pdev;
 	struct clk		*clk;
 	int			user;
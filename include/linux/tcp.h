@@ -106,6 +106,7 @@ enum {
 #define TCP_THIN_LINEAR_TIMEOUTS 16      /* Use linear timeouts for thin streams*/
 #define TCP_THIN_DUPACK         17      /* Fast retrans. after 1 dupack */
 #define TCP_USER_TIMEOUT	18	/* How long for loss retry before timeout */
+#define TCP_FASTOPEN		23	/* Enable FastOpen on listeners */
 
 /* for TCP_INFO socket option */
 #define TCPI_OPT_TIMESTAMPS	1
@@ -277,6 +278,24 @@ static inline void tcp_clear_options(struct tcp_options_received *rx_opt)
  * only four options will fit in a standard TCP header */
 #define TCP_NUM_SACKS 4
 
+/* TCP Fast Open cookie, as carried in the experimental option */
+#define TCP_FASTOPEN_COOKIE_MIN	4	/* Min Fast Open Cookie size in bytes */
+#define TCP_FASTOPEN_COOKIE_MAX	16	/* Max Fast Open Cookie size in bytes */
+#define TCP_FASTOPEN_COOKIE_SIZE 8	/* the size employed by this impl. */
+
+struct tcp_fastopen_cookie {
+	s8	len;	/* < 0: no option, 0: cookie request, > 0: cookie */
+	u8	val[TCP_FASTOPEN_COOKIE_MAX];
+};
+
+/* Data to be sent in the SYN of an active Fast Open connection */
+struct tcp_fastopen_request {
+	struct tcp_fastopen_cookie	cookie;	/* cookie for the SYN */
+	struct msghdr			*data;	/* data in MSG_FASTOPEN */
+	size_t				size;
+	int				copied;	/* queued in tcp_connect() */
+};
+
 struct tcp_cookie_values;
 struct tcp_request_sock_ops;
 
@@ -289,6 +308,10 @@ struct tcp_request_sock {
 	u32				rcv_isn;
 	u32				snt_isn;
 	u32				snt_synack; /* synack sent time */
+	u32				rcv_nxt; /* the ack # by SYNACK. For
+						  * FastOpen it's the seq#
+						  * after data-in-SYN.
+						  */
 };
 
 static inline struct tcp_request_sock *tcp_rsk(const struct request_sock *req)
@@ -323,6 +346,13 @@ struct tcp_sock {
 	u32	rcv_tstamp;	/* timestamp of last received ACK (for keepalives) */
 	u32	lsndtime;	/* timestamp of last sent data packet (for restart window) */
 
+	/* TCP small queues and pacing, see tcp_write_xmit() */
+	struct list_head	tsq_node; /* anchor in tsq_tasklet.head list */
+	unsigned long	tsq_flags;
+	u32	pacing_rate;	/* bytes per second, 0 if unknown	*/
+	ktime_t	pacing_next;	/* earliest time of the next transmit	*/
+	struct hrtimer	pacing_timer;
+
 	/* Data for direct copy to user */
 	struct {
 		struct sk_buff_head	prequeue;
@@ -353,7 +383,8 @@ struct tcp_sock {
 	u8	nonagle     : 4,/* Disable Nagle algorithm?             */
 		thin_lto    : 1,/* Use linear timeouts for thin streams */
 		thin_dupack : 1,/* Fast retransmit on first dupack      */
-		unused      : 2;
+		syn_fastopen : 1,/* SYN includes Fast Open option       */
+		syn_data    : 1;/* SYN includes data                    */
 
 /* RTT measurement */
 	u32	srtt;		/* smoothed round trip time << 3	*/
@@ -472,6 +503,14 @@ struct tcp_sock {
 	 * contains related tcp_cookie_transactions fields.
 	 */
 	struct tcp_cookie_values  *cookie_values;
+
+/* TCP Fast Open */
+	struct tcp_fastopen_request *fastopen_req;
+	/* A passively opened child keeps the request_sock it was created
+	 * from until the handshake completes, to retransmit the SYN-ACK.
+	 */
+	struct request_sock *fastopen_rsk;
+	int	fastopen_max_qlen;	/* listener: TCP_FASTOPEN backlog */
 };
 
 static inline struct tcp_sock *tcp_sk(const struct sock *sk)
@@ -496,6 +535,19 @@ struct tcp_timewait_sock {
 	struct tcp_cookie_values  *tw_cookie_values;
 };
 
+/* Bits in tcp_sock->tsq_flags */
+enum tsq_flags {
+	TSQ_THROTTLED,		/* tcp_write_xmit() hit the queue limit */
+	TSQ_QUEUED,		/* socket is on the tsq tasklet list */
+	TCP_TSQ_DEFERRED,	/* tcp_tasklet_func() found socket owned */
+};
+
+static inline bool tcp_passive_fastopen(const struct sock *sk)
+{
+	return (sk->sk_state == TCP_SYN_RECV &&
+		tcp_sk(sk)->fastopen_rsk != NULL);
+}
+
 static inline struct tcp_timewait_sock *tcp_twsk(const struct sock *sk)
 {
 	return (struct tcp_timewait_sock *)sk;
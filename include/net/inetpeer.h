@@ -40,6 +40,10 @@ struct inet_peer {
 	u32			pmtu_orig;
 	u32			pmtu_learned;
 	struct inetpeer_addr_base redirect_learned;
+	/* TCP Fast Open: MSS and server cookie learned from this peer */
+	__u16			tcp_fastopen_mss;
+	__s8			tcp_fastopen_cookie_len;
+	__u8			tcp_fastopen_cookie[16];
 	struct list_head	gc_list;
 	/*
 	 * Once inet_peer is queued for deletion (refcnt == -1), following fields
@@ -62,6 +62,16 @@ struct atmel_lcdfb_info {
 	void (*atmel_lcdfb_power_control)(int on);
 	struct fb_monspecs	*default_monspecs;
 	u32			pseudo_palette[16];
+
+#ifdef CONFIG_FB_ATMEL_DMA
+	struct dma_chan		*dma_chan;
+	struct dma_interleaved_template *dma_xt;
+#endif
+#ifdef CONFIG_FB_ATMEL_DEFIO
+	void __iomem		*screen;	/* scanout behind the shadow */
+	unsigned long		damage_start;
+	unsigned long		damage_end;
+#endif
 };
 
 #define ATMEL_LCDC_DMABADDR1	0x00
@@ -0,0 +1,153 @@
+/*
+ * TCP Fast Open: data in the SYN, authorised by a server cookie.
+ *
+ *	This program is free software; you can redistribute it and/or
+ *      modify it under the terms of the GNU General Public License
+ *      as published by the Free Software Foundation; either version
+ *      2 of the License, or (at your option) any later version.
+ */
+
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/random.h>
+#include <linux/cryptohash.h>
+#include <linux/seqlock.h>
+#include <linux/tcp.h>
+#include <net/inetpeer.h>
+#include <net/tcp.h>
+
+int sysctl_tcp_fastopen __read_mostly = TFO_CLIENT_ENABLE;
+
+/* The cookie is a keyed hash of the client address, computed the same
+ * way as the SYN cookies.  A client only ever echoes it back, so the
+ * secret may change across reboots without harm: a stale cookie just
+ * costs one ordinary three way handshake and fetches a fresh one.
+ */
+static u32 tcp_fastopen_secret[SHA_MESSAGE_BYTES / 4];
+
+static __init int tcp_fastopen_init(void)
+{
+	BUILD_BUG_ON(sizeof(((struct inet_peer *)0)->tcp_fastopen_cookie) !=
+		     TCP_FASTOPEN_COOKIE_MAX);
+	get_random_bytes(tcp_fastopen_secret, sizeof(tcp_fastopen_secret));
+	return 0;
+}
+__initcall(tcp_fastopen_init);
+
+/* Computes the cookie for a peer address of @words 32-bit words. */
+void tcp_fastopen_cookie_gen(const __be32 *addr, int words,
+			     struct tcp_fastopen_cookie *foc)
+{
+	__u32 workspace[SHA_WORKSPACE_WORDS];
+	__u32 digest[SHA_DIGEST_WORDS];
+	__u32 msg[SHA_MESSAGE_BYTES / 4];
+	int i;
+
+	memcpy(msg, tcp_fastopen_secret, sizeof(msg));
+	for (i = 0; i < words; i++)
+		msg[i] ^= (__force u32)addr[i];
+
+	sha_init(digest);
+	sha_transform(digest, (char *)msg, workspace);
+
+	memcpy(foc->val, digest, TCP_FASTOPEN_COOKIE_SIZE);
+	foc->len = TCP_FASTOPEN_COOKIE_SIZE;
+}
+
+/* The client remembers the cookie and the MSS of each server in the
+ * inet_peer entry of its address, next to the TIME-WAIT timestamps.
+ */
+static DEFINE_SEQLOCK(fastopen_seqlock);
+
+void tcp_fastopen_cache_get(struct sock *sk, u16 *mss,
+			    struct tcp_fastopen_cookie *cookie)
+{
+	struct inet_peer *peer;
+	bool release_it;
+	unsigned int seq;
+
+	peer = inet_csk(sk)->icsk_af_ops->get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	do {
+		seq = read_seqbegin(&fastopen_seqlock);
+		if (peer->tcp_fastopen_mss)
+			*mss = peer->tcp_fastopen_mss;
+		cookie->len = peer->tcp_fastopen_cookie_len;
+		if (cookie->len > 0)
+			memcpy(cookie->val, peer->tcp_fastopen_cookie,
+			       cookie->len);
+	} while (read_seqretry(&fastopen_seqlock, seq));
+
+	if (release_it)
+		inet_putpeer(peer);
+}
+
+void tcp_fastopen_cache_set(struct sock *sk, u16 mss,
+			    struct tcp_fastopen_cookie *cookie)
+{
+	struct inet_peer *peer;
+	bool release_it;
+
+	peer = inet_csk(sk)->icsk_af_ops->get_peer(sk, &release_it);
+	if (!peer)
+		return;
+
+	write_seqlock_bh(&fastopen_seqlock);
+	if (mss)
+		peer->tcp_fastopen_mss = mss;
+	if (cookie->len > 0) {
+		memcpy(peer->tcp_fastopen_cookie, cookie->val, cookie->len);
+		peer->tcp_fastopen_cookie_len = cookie->len;
+	}
+	write_sequnlock_bh(&fastopen_seqlock);
+
+	if (release_it)
+		inet_putpeer(peer);
+}
+
+/* Create the child of a listener straight from a SYN that carries data
+ * and a valid cookie, and queue that data for reading.  The child starts
+ * out in SYN_RECV and keeps @req until the handshake completes, to
+ * retransmit the SYN-ACK; the accept queue gets a request_sock of its own.
+ * Called with the listener locked, after the SYN-ACK has been built.
+ * Returns the child with a reference held for the caller, or NULL.
+ */
+struct sock *tcp_fastopen_create_child(struct sock *sk, struct sk_buff *skb,
+			       struct request_sock *req)
+{
+	u32 end_seq = TCP_SKB_CB(skb)->end_seq;
+	struct request_sock *acc_req;
+	struct tcp_sock *tp;
+	struct sock *child;
+
+	acc_req = reqsk_alloc(req->rsk_ops);
+	if (acc_req == NULL)
+		return NULL;
+
+	child = inet_csk(sk)->icsk_af_ops->syn_recv_sock(sk, skb, req, NULL);
+	if (child == NULL) {
+		__reqsk_free(acc_req);
+		return NULL;
+	}
+
+	tp = tcp_sk(child);
+	tp->fastopen_rsk = req;
+
+	/* The payload keeps its TCP header and SYN sequence number, which
+	 * tcp_recvmsg() knows to skip.
+	 */
+	skb = skb_get(skb);
+	skb_dst_drop(skb);
+	__skb_pull(skb, tcp_hdr(skb)->doff * 4);
+	skb_set_owner_r(skb, child);
+	__skb_queue_tail(&child->sk_receive_queue, skb);
+	tp->rcv_nxt = tp->rcv_wup = end_seq;
+
+	inet_csk_reqsk_queue_add(sk, acc_req, child);
+	sk->sk_data_ready(sk, 0);
+
+	bh_unlock_sock(child);
+	return child;
+}
@@ -776,7 +776,8 @@ static void tcp_v4_reqsk_send_ack(struct sock *sk, struct sk_buff *skb,
  */
 static int tcp_v4_send_synack(struct sock *sk, struct dst_entry *dst,
 			      struct request_sock *req,
-			      struct request_values *rvp)
+			      struct request_values *rvp,
+			      struct tcp_fastopen_cookie *foc)
 {
 	const struct inet_request_sock *ireq = inet_rsk(req);
 	struct flowi4 fl4;
@@ -787,7 +788,7 @@ static int tcp_v4_send_synack(struct sock *sk, struct dst_entry *dst,
 	if (!dst && (dst = inet_csk_route_req(sk, &fl4, req)) == NULL)
 		return -1;
 
-	skb = tcp_make_synack(sk, dst, req, rvp);
+	skb = tcp_make_synack(sk, dst, req, rvp, foc);
 
 	if (skb) {
 		__tcp_v4_send_check(skb, ireq->loc_addr, ireq->rmt_addr);
@@ -806,7 +807,102 @@ static int tcp_v4_rtx_synack(struct sock *sk, struct request_sock *req,
 			      struct request_values *rvp)
 {
 	TCP_INC_STATS_BH(sock_net(sk), TCP_MIB_RETRANSSEGS);
-	return tcp_v4_send_synack(sk, NULL, req, rvp);
+	return tcp_v4_send_synack(sk, NULL, req, rvp, NULL);
+}
+
+/*
+ *	TCP Fast Open, server side: decide whether the data in a SYN can be
+ *	handed to a new socket right away.  A cookie request or an invalid
+ *	cookie is answered with a valid one in @valid_foc for the SYN-ACK.
+ */
+static bool tcp_v4_fastopen_check(struct sock *sk, struct sk_buff *skb,
+				  struct tcp_fastopen_cookie *foc,
+				  struct tcp_fastopen_cookie *valid_foc)
+{
+	const struct tcp_sock *tp = tcp_sk(sk);
+	bool data = TCP_SKB_CB(skb)->end_seq != TCP_SKB_CB(skb)->seq + 1;
+
+	if (!(sysctl_tcp_fastopen & TFO_SERVER_ENABLE) ||
+	    tp->fastopen_max_qlen <= 0)
+		return false;
+
+	if (foc->len < 0) {
+		/* No Fast Open option at all */
+		if (!data || !(sysctl_tcp_fastopen & TFO_SERVER_COOKIE_NOT_REQD))
+			return false;
+	} else {
+		tcp_fastopen_cookie_gen(&ip_hdr(skb)->saddr, 1, valid_foc);
+		if (foc->len != valid_foc->len ||
+		    memcmp(foc->val, valid_foc->val, foc->len)) {
+			if (foc->len == 0)
+				NET_INC_STATS_BH(sock_net(sk),
+					LINUX_MIB_TCPFASTOPENCOOKIEREQD);
+			return false;
+		}
+		/* The client has the right cookie already */
+		valid_foc->len = -1;
+		if (!data)
+			return false;
+	}
+
+	/* Bound the children that hold SYN data before the handshake has
+	 * proven the peer's address; the rest fall back to plain SYNs.
+	 */
+	if (sk->sk_ack_backlog >= tp->fastopen_max_qlen) {
+		NET_INC_STATS_BH(sock_net(sk),
+				 LINUX_MIB_TCPFASTOPENLISTENOVERFLOW);
+		return false;
+	}
+	return true;
+}
+
+/*
+ *	Send the SYN-ACK of a Fast Open request and create the child socket
+ *	in one go: the child must inherit the window chosen for the SYN-ACK,
+ *	and the SYN-ACK must not acknowledge data that no socket took.
+ */
+static int tcp_v4_conn_req_fastopen(struct sock *sk, struct sk_buff *skb,
+				    struct dst_entry *dst,
+				    struct request_sock *req,
+				    struct request_values *rvp)
+{
+	const struct inet_request_sock *ireq = inet_rsk(req);
+	struct ip_options_rcu *opt;
+	struct sk_buff *synack;
+	struct sock *child;
+	struct flowi4 fl4;
+
+	if (dst)
+		dst_clone(dst);
+	else if ((dst = inet_csk_route_req(sk, &fl4, req)) == NULL)
+		return -1;
+
+	synack = tcp_make_synack(sk, dst, req, rvp, NULL);
+	dst_release(dst);
+	if (synack == NULL)
+		return -1;
+
+	child = tcp_fastopen_create_child(sk, skb, req);
+	if (child == NULL) {
+		NET_INC_STATS_BH(sock_net(sk),
+				 LINUX_MIB_TCPFASTOPENPASSIVEFAIL);
+		kfree_skb(synack);
+		return -1;
+	}
+	NET_INC_STATS_BH(sock_net(sk), LINUX_MIB_TCPFASTOPENPASSIVE);
+
+	/* A lost SYN-ACK is resent by the child when the client repeats
+	 * its SYN, see tcp_rcv_state_process().  The IP options moved
+	 * from the request to the child in syn_recv_sock().
+	 */
+	__tcp_v4_send_check(synack, ireq->loc_addr, ireq->rmt_addr);
+	rcu_read_lock();
+	opt = rcu_dereference(inet_sk(child)->inet_opt);
+	ip_build_and_send_pkt(synack, sk, ireq->loc_addr, ireq->rmt_addr,
+			      opt);
+	rcu_read_unlock();
+	sock_put(child);
+	return 0;
 }
 
 /*
@@ -1257,6 +1353,8 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 {
 	struct tcp_extend_values tmp_ext;
 	struct tcp_options_received tmp_opt;
+	struct tcp_fastopen_cookie foc = { .len = -1 };
+	struct tcp_fastopen_cookie valid_foc = { .len = -1 };
 	const u8 *hash_location;
 	struct request_sock *req;
 	struct inet_request_sock *ireq;
@@ -1300,7 +1398,8 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 	tcp_clear_options(&tmp_opt);
 	tmp_opt.mss_clamp = TCP_MSS_DEFAULT;
 	tmp_opt.user_mss  = tp->rx_opt.user_mss;
-	tcp_parse_options(skb, &tmp_opt, &hash_location, 0);
+	tcp_parse_options(skb, &tmp_opt, &hash_location, 0,
+			  want_cookie ? NULL : &foc);
 
 	if (tmp_opt.cookie_plus > 0 &&
 	    tmp_opt.saw_tstamp &&
@@ -1404,10 +1503,25 @@ int tcp_v4_conn_request(struct sock *sk, struct sk_buff *skb)
 		isn = tcp_v4_init_sequence(skb);
 	}
 	tcp_rsk(req)->snt_isn = isn;
+
+	if (!want_cookie &&
+	    tcp_v4_fastopen_check(sk, skb, &foc, &valid_foc)) {
+		tcp_rsk(req)->rcv_nxt = TCP_SKB_CB(skb)->end_seq;
+		if (tcp_v4_conn_req_fastopen(sk, skb, dst, req,
+				(struct request_values *)&tmp_ext) == 0) {
+			dst_release(dst);
+			return 0;
+		}
+		/* Drop the data; the client sends it again after a
+		 * regular handshake.
+		 */
+		tcp_rsk(req)->rcv_nxt = tcp_rsk(req)->rcv_isn + 1;
+	}
 	tcp_rsk(req)->snt_synack = tcp_time_stamp;
 
 	if (tcp_v4_send_synack(sk, dst, req,
-			       (struct request_values *)&tmp_ext) ||
+			       (struct request_values *)&tmp_ext,
+			       &valid_foc) ||
 	    want_cookie)
 		goto drop_and_free;
 
@@ -1782,6 +1896,7 @@ do_time_wait:
 	case TCP_TW_SYN: {
 		struct sock *sk2 = inet_lookup_listener(dev_net(skb->dev),
 							&tcp_hashinfo,
+							iph->saddr, th->source,
 							iph->daddr, th->dest,
 							inet_iif(skb));
 		if (sk2) {
@@ -1984,6 +2099,13 @@ void tcp_v4_destroy_sock(struct sock *sk)
 		tp->cookie_values = NULL;
 	}
 
+	/* TCP Fast Open */
+	tcp_free_fastopen_req(tp);
+	if (tp->fastopen_rsk != NULL) {
+		reqsk_free(tp->fastopen_rsk);
+		tp->fastopen_rsk = NULL;
+	}
+
 	sk_sockets_allocated_dec(sk);
 	sock_release_memcg(sk);
 }
@@ -2624,6 +2746,7 @@ struct proto tcp_prot = {
 	.sendmsg		= tcp_sendmsg,
 	.sendpage		= tcp_sendpage,
 	.backlog_rcv		= tcp_v4_do_rcv,
+	.release_cb		= tcp_release_cb,
 	.hash			= inet_hash,
 	.unhash			= inet_unhash,
 	.get_port		= inet_csk_get_port,
@@ -36,9 +36,13 @@
 #include <linux/platform_device.h>
 #include <linux/slab.h>
 #include <linux/dma-mapping.h>
+#include <linux/dmaengine.h>
 #include <linux/atmel_pdc.h>
 #include <linux/atmel-ssc.h>
 
+#include <mach/at_hdmac.h>
+#include <mach/board.h>
+
 #include <sound/core.h>
 #include <sound/pcm.h>
 #include <sound/pcm_params.h>
@@ -78,6 +82,10 @@ struct atmel_runtime_data {
 
 	dma_addr_t period_ptr;		/* physical address of next period */
 
+	/* cyclic dmaengine transfer, used instead of the PDC if set */
+	struct dma_chan *chan;
+	dma_cookie_t cookie;
+
 	/* PDC register save */
 	u32 pdc_xpr_save;
 	u32 pdc_xcr_save;
@@ -113,6 +121,116 @@ static int atmel_pcm_preallocate_dma_buffer(struct snd_pcm *pcm,
 	buf->bytes = size;
 	return 0;
 }
+/*--------------------------------------------------------------------------*\
+ * dmaengine
+\*--------------------------------------------------------------------------*/
+/*
+ * Where the SSC is wired to the AHB DMA controller, the whole buffer is
+ * one cyclic transfer: the controller walks through all periods on its
+ * own, so period boundaries don't depend on the SSC interrupt being
+ * serviced in time, and the position is read from the channel itself.
+ */
+#ifdef CONFIG_SND_ATMEL_SOC_DMA
+static bool atmel_pcm_dma_filter(struct dma_chan *chan, void *slave)
+{
+	struct at_dma_slave *sl = slave;
+
+	if (sl->dma_dev == chan->device->dev) {
+		chan->private = sl;
+		return true;
+	} else {
+		return false;
+	}
+}
+
+static struct dma_chan *atmel_pcm_request_chan(
+	struct snd_pcm_substream *substream,
+	struct atmel_pcm_dma_params *params)
+{
+	struct atmel_ssc_data *pdata = params->ssc->pdev->dev.platform_data;
+	struct at_dma_slave *sl;
+	dma_cap_mask_t mask;
+
+	if (!pdata)
+		return NULL;
+
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		sl = pdata->dma_tx_slave;
+	else
+		sl = pdata->dma_rx_slave;
+	if (!sl)
+		return NULL;
+
+	sl->tx_reg = params->ssc->phybase + SSC_THR;
+	sl->rx_reg = params->ssc->phybase + SSC_RHR;
+
+	dma_cap_zero(mask);
+	dma_cap_set(DMA_SLAVE, mask);
+	dma_cap_set(DMA_CYCLIC, mask);
+	return dma_request_channel(mask, atmel_pcm_dma_filter, sl);
+}
+
+static void atmel_pcm_set_width(struct dma_chan *chan, int xfer_size)
+{
+	struct at_dma_slave *sl = chan->private;
+
+	switch (xfer_size) {
+	case 1:
+		sl->reg_width = AT_DMA_SLAVE_WIDTH_8BIT;
+		break;
+	case 2:
+		sl->reg_width = AT_DMA_SLAVE_WIDTH_16BIT;
+		break;
+	default:
+		sl->reg_width = AT_DMA_SLAVE_WIDTH_32BIT;
+		break;
+	}
+}
+#else
+static inline struct dma_chan *atmel_pcm_request_chan(
+	struct snd_pcm_substream *substream,
+	struct atmel_pcm_dma_params *params)
+{
+	return NULL;
+}
+
+static inline void atmel_pcm_set_width(struct dma_chan *chan, int xfer_size)
+{
+}
+#endif
+
+static void atmel_pcm_dma_complete(void *arg)
+{
+	struct snd_pcm_substream *substream = arg;
+
+	snd_pcm_period_elapsed(substream);
+}
+
+static int atmel_pcm_dma_start(struct snd_pcm_substream *substream)
+{
+	struct atmel_runtime_data *prtd = substream->runtime->private_data;
+	struct dma_chan *chan = prtd->chan;
+	struct dma_async_tx_descriptor *desc;
+
+	desc = chan->device->device_prep_dma_cyclic(chan, prtd->dma_buffer,
+			prtd->dma_buffer_end - prtd->dma_buffer,
+			prtd->period_size,
+			substream->stream == SNDRV_PCM_STREAM_PLAYBACK
+			? DMA_MEM_TO_DEV : DMA_DEV_TO_MEM);
+	if (!desc) {
+		pr_err("atmel-pcm: cannot prepare cyclic DMA for %s\n",
+			prtd->params->name);
+		return -ENOMEM;
+	}
+
+	desc->callback = atmel_pcm_dma_complete;
+	desc->callback_param = substream;
+	prtd->cookie = dmaengine_submit(desc);
+	dma_async_issue_pending(chan);
+
+	return 0;
+}
+
 /*--------------------------------------------------------------------------*\
  * ISR
 \*--------------------------------------------------------------------------*/
@@ -180,15 +298,24 @@ static int atmel_pcm_hw_params(struct snd_pcm_substream *substream,
 	runtime->dma_bytes = params_buffer_bytes(params);
 
 	prtd->params = snd_soc_dai_get_dma_data(rtd->cpu_dai, substream);
-	prtd->params->dma_intr_handler = atmel_pcm_dma_irq;
+
+	if (!prtd->chan)
+		prtd->chan = atmel_pcm_request_chan(substream, prtd->params);
+	if (prtd->chan) {
+		atmel_pcm_set_width(prtd->chan, prtd->params->pdc_xfer_size);
+		prtd->params->dma_intr_handler = NULL;
+	} else {
+		prtd->params->dma_intr_handler = atmel_pcm_dma_irq;
+	}
 
 	prtd->dma_buffer = runtime->dma_addr;
 	prtd->dma_buffer_end = runtime->dma_addr + runtime->dma_bytes;
 	prtd->period_size = params_period_bytes(params);
 
 	pr_debug("atmel-pcm: "
-		"hw_params: DMA for %s initialized "
+		"hw_params: %s for %s initialized "
 		"(dma_bytes=%u, period_size=%u)\n",
+		prtd->chan ? dma_chan_name(prtd->chan) : "PDC",
 		prtd->params->name,
 		runtime->dma_bytes,
 		prtd->period_size);
@@ -200,6 +327,12 @@ static int atmel_pcm_hw_free(struct snd_pcm_substream *substream)
 	struct atmel_runtime_data *prtd = substream->runtime->private_data;
 	struct atmel_pcm_dma_params *params = prtd->params;
 
+	if (prtd->chan) {
+		dmaengine_terminate_all(prtd->chan);
+		dma_release_channel(prtd->chan);
+		prtd->chan = NULL;
+	}
+
 	if (params != NULL) {
 		ssc_writex(params->ssc->regs, SSC_PDC_PTCR,
 			   params->mask->pdc_disable);
@@ -233,6 +366,27 @@ static int atmel_pcm_trigger(struct snd_pcm_substream *substream,
 		"dma_area = %p, dma_bytes = %u\n",
 		rtd->buffer_size, rtd->dma_area, rtd->dma_bytes);
 
+	if (prtd->chan) {
+		switch (cmd) {
+		case SNDRV_PCM_TRIGGER_START:
+			return atmel_pcm_dma_start(substream);
+
+		case SNDRV_PCM_TRIGGER_STOP:
+		case SNDRV_PCM_TRIGGER_SUSPEND:
+			dmaengine_terminate_all(prtd->chan);
+			return 0;
+
+		case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
+			return dmaengine_pause(prtd->chan);
+
+		case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
+			return dmaengine_resume(prtd->chan);
+
+		default:
+			return -EINVAL;
+		}
+	}
+
 	switch (cmd) {
 	case SNDRV_PCM_TRIGGER_START:
 		prtd->period_ptr = prtd->dma_buffer;
@@ -293,9 +447,19 @@ static snd_pcm_uframes_t atmel_pcm_pointer(
 	struct snd_pcm_runtime *runtime = substream->runtime;
 	struct atmel_runtime_data *prtd = runtime->private_data;
 	struct atmel_pcm_dma_params *params = prtd->params;
+	struct dma_tx_state state;
 	dma_addr_t ptr;
 	snd_pcm_uframes_t x;
 
+	if (prtd->chan) {
+		prtd->chan->device->device_tx_status(prtd->chan, prtd->cookie,
+						     &state);
+		x = bytes_to_frames(runtime, runtime->dma_bytes - state.residue);
+		if (x >= runtime->buffer_size)
+			x = 0;
+		return x;
+	}
+
 	ptr = (dma_addr_t) ssc_readx(params->ssc->regs, params->pdc->xpr);
 	x = bytes_to_frames(runtime, ptr - prtd->dma_buffer);
 
@@ -334,6 +498,8 @@ static int atmel_pcm_close(struct snd_pcm_substream *substream)
 {
 	struct atmel_runtime_data *prtd = substream->runtime->private_data;
 
+	if (prtd->chan)
+		dma_release_channel(prtd->chan);
 	kfree(prtd);
 	return 0;
 }
@@ -427,6 +593,10 @@ static int atmel_pcm_suspend(struct snd_soc_dai *dai)
 	prtd = runtime->private_data;
 	params = prtd->params;
 
+	/* the cyclic transfer was stopped by the SUSPEND trigger */
+	if (prtd->chan)
+		return 0;
+
 	/* disable the PDC and save the PDC registers */
 
 	ssc_writel(params->ssc->regs, PDC_PTCR, params->mask->pdc_disable);
@@ -451,6 +621,9 @@ static int atmel_pcm_resume(struct snd_soc_dai *dai)
 	prtd = runtime->private_data;
 	params = prtd->params;
 
+	if (prtd->chan)
+		return 0;
+
 	/* restore the PDC registers and enable the PDC */
 	ssc_writex(params->ssc->regs, params->pdc->xpr, prtd->pdc_xpr_save);
 	ssc_writex(params->ssc->regs, params->pdc->xcr, prtd->pdc_xcr_save);